@@ -0,0 +1,24 @@
+#ifndef ASSET_WATCHER_H_
+#define ASSET_WATCHER_H_
+
+#include <scene.h>
+#include <string>
+#include <vector>
+
+/**
+ * Watches the directories of a scene's files with inotify, for hot reloading.
+ * Polling never blocks, so it can run once per frame.
+ */
+typedef struct {
+  int fd;
+  std::vector<int> watches;
+  std::vector<std::string> directories; // canonical, parallel to watches
+} asset_watcher_t;
+
+int start_asset_watcher(asset_watcher_t *watcher, const std::vector<scene_asset_t> &assets,
+                        const std::vector<std::string> &textures);
+void poll_asset_watcher(asset_watcher_t *watcher, std::vector<std::string> *changed);
+void stop_asset_watcher(asset_watcher_t *watcher);
+std::string canonical_path(const std::string &path);
+
+#endif // ASSET_WATCHER_H_
@@ -0,0 +1,38 @@
+#ifndef DRAW_RANGE_H_
+#define DRAW_RANGE_H_
+
+#include <model.h>
+#include <vector>
+
+// Largest vertex span a 16 bit draw range can address relative to its base vertex.
+#define DRAW_RANGE_MAX_SPAN 65536
+// Meshes whose 16 bit ranges would average fewer indices than this stay a single 32 bit range instead,
+// since many tiny draws cost more than the index bandwidth they save.
+#define DRAW_RANGE_MIN_INDICES 3072
+
+/**
+ * One draw call into the element buffer. Indices are relative to baseVertex,
+ * which lets every range that spans fewer than DRAW_RANGE_MAX_SPAN vertices use 16 bit indices.
+ * Every range is culled as a whole, with the bounds of its meshlet, or of its mesh if there are no meshlets.
+ * A mesh's ranges of all its detail levels are in the list, only those of the level selected for a view are drawn.
+ */
+typedef struct {
+  unsigned int mesh;        // index into model_t::meshes
+  unsigned int indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+  size_t byteOffset;        // into the element buffer, aligned to the index size
+  unsigned int indexCount;
+  int baseVertex;
+  float center[3];
+  float radius;
+  float coneAxis[3];
+  float coneCutoff;
+  unsigned int lod;         // detail level of the mesh, 0 is full resolution
+} draw_range_t;
+
+size_t max_packed_index_size(const model_t *model);
+size_t pack_mesh_indices(const model_t *model, unsigned int mesh, const meshlet_t *meshlets, size_t byteOffset,
+                         std::vector<char> *packed, std::vector<draw_range_t> *ranges);
+size_t pack_model_indices(const model_t *model, std::vector<char> *packed, std::vector<draw_range_t> *ranges);
+void print_draw_range_stats(const model_t *model, const std::vector<draw_range_t> &ranges, size_t packedSize);
+
+#endif // DRAW_RANGE_H_
@@ -0,0 +1,8 @@
+#ifndef GLTF_LOADER_H_
+#define GLTF_LOADER_H_
+
+#include <model.h>
+
+int load_gltf(model_t *model, const char *path, const load_options_t *options);
+
+#endif // GLTF_LOADER_H_
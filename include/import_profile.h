@@ -0,0 +1,18 @@
+#ifndef IMPORT_PROFILE_H_
+#define IMPORT_PROFILE_H_
+
+#include <assimp/scene.h>
+
+// A named set of assimp post-processing steps, selectable with --profile.
+typedef struct {
+  const char *name;
+  unsigned int postProcessFlags;
+} import_profile_t;
+
+#define DEFAULT_IMPORT_PROFILE "max"
+
+const import_profile_t *find_import_profile(const char *name);
+void print_import_profiles();
+const struct aiScene *import_scene(const char *path, unsigned int postProcessFlags, bool report);
+
+#endif // IMPORT_PROFILE_H_
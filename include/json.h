@@ -0,0 +1,37 @@
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+typedef enum {
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT,
+} json_type_t;
+
+/**
+ * A parsed JSON value. Objects keep their members in file order, keys[i] names items[i].
+ * Lookups are linear, which is fine for the small objects of a glTF file.
+ */
+typedef struct json_value_t {
+  json_type_t type;
+  double number;                  // also 0 or 1 for booleans
+  std::string string;
+  std::vector<json_value_t> items; // array elements or object members
+  std::vector<std::string> keys;   // only for objects
+} json_value_t;
+
+int parse_json(const char *text, size_t length, json_value_t *root);
+const json_value_t *json_member(const json_value_t *object, const char *key);
+const json_value_t *json_item(const json_value_t *array, size_t index);
+size_t json_size(const json_value_t *array);
+double json_number(const json_value_t *value, double fallback);
+size_t json_index(const json_value_t *value, size_t fallback);
+const char *json_string(const json_value_t *value);
+
+#endif // JSON_H_
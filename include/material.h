@@ -0,0 +1,17 @@
+#ifndef MATERIAL_H_
+#define MATERIAL_H_
+
+#include <assimp/color4.h>
+#include <stddef.h>
+#include <vector>
+
+// Size of the material table the shaders declare. 1024 vec4s is the 16 KB every GL implementation supports for a block.
+#define MAX_MATERIALS 1024
+// Uniform buffer binding point of the Materials block.
+#define MATERIAL_BLOCK_BINDING 0
+
+void upload_materials(unsigned int buffer, const std::vector<aiColor4D> &materials);
+void update_materials(unsigned int buffer, unsigned int offset, const aiColor4D *materials, size_t count);
+void bind_material_block(unsigned int program);
+
+#endif // MATERIAL_H_
@@ -0,0 +1,82 @@
+#ifndef MATERIAL_TEXTURES_H_
+#define MATERIAL_TEXTURES_H_
+
+#include <texture.h>
+#include <texture_loader.h>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Array textures the maps are sorted into. texture.frag has a case for each in sampleGroup().
+#define MAX_TEXTURE_GROUPS 8
+// Texture unit of the first group, the others follow. Units below are left to the other textures.
+#define MATERIAL_TEXTURE_UNIT 3
+// Uniform buffer binding point of the MaterialMaps block.
+#define MATERIAL_MAPS_BLOCK_BINDING 2
+// Levels this many texels on a side and smaller are uploaded with the maps and always stay resident.
+#define TEXTURE_RESIDENT_SIZE 64
+// Default VRAM the groups' levels may take, finer levels are streamed in only as far as it allows.
+#define TEXTURE_RESIDENCY_BUDGET (256 * 1024 * 1024)
+
+// Layers of group 0, which stand in for the maps that aren't loaded (yet) and that a material doesn't have.
+enum {
+  PLACEHOLDER_DIFFUSE, // white
+  PLACEHOLDER_NORMAL,  // flat
+};
+
+// Where one map file ended up. group is -1 until its levels arrive.
+typedef struct {
+  int group;
+  int layer;
+  int kind; // TEXTURE_COLOR or TEXTURE_NORMAL
+} material_map_t;
+
+/**
+ * Maps of one size, format and level count, one per layer of texture. The array doubles whenever it is full.
+ * Only the levels from residentLevel on are allocated and sampled, see stream_material_levels(). Since
+ * GL_TEXTURE_BASE_LEVEL applies to the whole array, all of a group's maps share its residency.
+ */
+typedef struct {
+  texture_levels_t shape;              // sizes and formats of the levels, without data
+  unsigned int texture;
+  unsigned int layerCount;
+  unsigned int layerCapacity;
+  std::vector<texture_levels_t> layers; // every layer's levels, kept to stream finer ones from; no data if unused
+  uint32_t residentLevel;
+  uint32_t neededLevel;                // finest level any of its maps was requested at since the last stream
+  int streamingLevel;                  // residentLevel - 1 while its layers are uploaded, -1 otherwise
+  unsigned int streamedLayers;
+  unsigned long lastNeeded[TEXTURE_MAX_LEVELS]; // frame each level was last requested in, 0 if never
+} texture_group_t;
+
+/**
+ * The diffuse and normal maps of every material of the scene, as layers of GL_TEXTURE_2D_ARRAYs grouped by size
+ * and format. All groups are bound at once, and a table parallel to the material table tells the shaders
+ * every material's groups and layers, so no draw has to bind textures, however many materials the scene has.
+ */
+typedef struct {
+  std::vector<texture_group_t> groups;
+  std::map<std::string, material_map_t> maps; // by path, materials using the same file share its layer
+  std::vector<std::string> diffuseMapPaths;   // per material of the scene, empty if it has none
+  std::vector<std::string> normalMapPaths;
+  std::vector<int32_t> table;                 // contents of the MaterialMaps buffer, 4 entries per material
+  unsigned int buffer;                        // the MaterialMaps uniform buffer
+  size_t residentBytes;                       // VRAM taken by the groups' allocated levels
+  unsigned long frame;                        // counts calls to stream_material_levels(), for eviction
+} material_textures_t;
+
+void create_material_textures(material_textures_t *textures);
+void set_material_maps(material_textures_t *textures, texture_loader_t *loader, unsigned int offset,
+                       const std::vector<std::string> &diffuseMapPaths, const std::vector<std::string> &normalMapPaths);
+bool reload_material_map(material_textures_t *textures, texture_loader_t *loader, const std::string &path);
+unsigned int update_material_textures(material_textures_t *textures, texture_loader_t *loader, size_t budget);
+void request_material_level(material_textures_t *textures, unsigned int material, float uvPerPixel);
+void stream_material_levels(material_textures_t *textures, texture_loader_t *loader, size_t budget,
+                            size_t residencyBudget);
+std::vector<std::string> material_map_paths(const material_textures_t *textures);
+void bind_material_textures(const material_textures_t *textures);
+void set_material_texture_units(unsigned int program);
+void bind_material_maps_block(unsigned int program);
+
+#endif // MATERIAL_TEXTURES_H_
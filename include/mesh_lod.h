@@ -0,0 +1,33 @@
+#ifndef MESH_LOD_H_
+#define MESH_LOD_H_
+
+#include <model.h>
+#include <vector>
+
+// Every level aims for this fraction of the previous level's triangles.
+#define LOD_REDUCTION 0.5f
+// A level that keeps more than this fraction of the previous level's triangles ends the chain, it isn't worth its indices.
+#define LOD_MIN_REDUCTION 0.9f
+// Largest simplification error of the coarsest level, relative to the mesh's bounding radius.
+#define LOD_MAX_ERROR 0.05f
+// Largest acceptable error on screen, in pixels, for the camera and for the shadow cubemap.
+// Shadows are blurred by the filtering anyway, so they get by with much coarser levels.
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_SHADOW_PIXEL_ERROR 4.0f
+
+// Level statistics over all meshes.
+typedef struct {
+  size_t meshes;
+  size_t simplifiedMeshes;
+  size_t triangles[MESH_MAX_LODS]; // per level, meshes without that level count with their finest one
+  size_t indices;                  // added to the index stream
+} lod_stats_t;
+
+size_t simplify_mesh(const model_t *model, const mesh_range_t &range, const unsigned int *indices, size_t indexCount,
+                     size_t targetIndexCount, float maxError, unsigned int *destination, float *error);
+void build_mesh_lods(const model_t *model, mesh_range_t *range, std::vector<unsigned int> *lodIndices);
+int build_lods(model_t *model, lod_stats_t *stats);
+void print_lod_stats(const lod_stats_t *stats);
+unsigned int select_mesh_lod(const mesh_range_t &range, const float eye[3], float lodScale, float pixelError);
+
+#endif // MESH_LOD_H_
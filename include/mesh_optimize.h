@@ -0,0 +1,22 @@
+#ifndef MESH_OPTIMIZE_H_
+#define MESH_OPTIMIZE_H_
+
+#include <model.h>
+
+// Size of the simulated FIFO post-transform cache that ACMR/ATVR are measured with.
+#define VERTEX_CACHE_MEASURE_SIZE 16
+
+// Vertex cache statistics of the index buffer, before and after optimisation.
+typedef struct {
+  size_t triangles;
+  size_t vertices;
+  size_t missesBefore;
+  size_t missesAfter;
+} optimize_stats_t;
+
+size_t count_cache_misses(const unsigned int *indices, size_t indexCount, unsigned int vertexCount, unsigned int cacheSize);
+void optimize_mesh(model_t *model, const mesh_range_t &range, optimize_stats_t *stats);
+void optimize_model(model_t *model, optimize_stats_t *stats);
+void print_optimize_stats(const optimize_stats_t *stats);
+
+#endif // MESH_OPTIMIZE_H_
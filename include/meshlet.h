@@ -0,0 +1,49 @@
+#ifndef MESHLET_H_
+#define MESHLET_H_
+
+#include <model.h>
+#include <vector>
+
+// Cluster limits, as recommended for mesh shaders. 124 triangles leave room for a 4 byte header in 128.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Meshlet statistics over all meshes.
+typedef struct {
+  size_t meshlets;
+  size_t triangles;
+  size_t vertices;
+} meshlet_stats_t;
+
+/**
+ * A view to cull against: the frustum planes (pointing inwards) and the eye position for the cone test.
+ * The eye also picks every mesh's detail level, see select_mesh_lod().
+ * Everything is in the space of the meshes' vertices, see transform_cull_view() for meshes placed by a model matrix.
+ */
+typedef struct {
+  float planes[6][4];
+  float eye[3];
+  bool cull;           // test draw ranges against the frustum and their cones
+  float lodScale;      // pixels per world unit at distance one, 0 draws every mesh at full resolution
+  float lodPixelError;
+} cull_view_t;
+
+// Draw ranges that were tested against a view, those that survived, and the meshes drawn at every detail level.
+typedef struct {
+  size_t tested;
+  size_t drawn;
+  size_t levels[MESH_MAX_LODS];
+} cull_stats_t;
+
+void build_mesh_meshlets(model_t *model, const mesh_range_t &range, std::vector<meshlet_t> *meshlets);
+void gather_meshlets(model_t *model, const std::vector<std::vector<meshlet_t>> &meshMeshlets, meshlet_stats_t *stats);
+void build_meshlets(model_t *model, meshlet_stats_t *stats);
+void print_meshlet_stats(const meshlet_stats_t *stats);
+
+void make_cull_view(cull_view_t *view, const float viewProjection[4][4], const float eye[3]);
+void transform_cull_view(cull_view_t *local, const cull_view_t *world, const float model[4][4],
+                         const float inverseModel[4][4]);
+bool sphere_visible(const cull_view_t *view, const float center[3], float radius);
+bool cone_backfacing(const cull_view_t *view, const float center[3], float radius, const float axis[3], float cutoff);
+
+#endif // MESHLET_H_
@@ -0,0 +1,124 @@
+#ifndef MODEL_H_
+#define MODEL_H_
+
+#include <assimp/color4.h>
+#include <assimp/scene.h>
+#include <assimp/vector3.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#define MODEL_STREAM_COUNT 7
+// Detail levels per mesh, including the full resolution one.
+#define MESH_MAX_LODS 4
+
+// A simplified version of a mesh, see build_mesh_lods(). Its indices follow all full resolution ones in the index stream.
+typedef struct {
+  unsigned int indexOffset; // absolute, into model_t::indices
+  unsigned int indexCount;
+  float error;              // world space deviation from the full resolution mesh
+} mesh_lod_t;
+
+// Where one mesh of the flattened node graph lives in the model's streams.
+typedef struct {
+  unsigned int meshId;
+  unsigned int materialIndex;
+  unsigned int vertexOffset;
+  unsigned int vertexCount;
+  unsigned int indexOffset;
+  unsigned int indexCount;
+  // Axis aligned bounds of the mesh's vertices, see compute_mesh_bounds().
+  aiVector3D boundsMin;
+  aiVector3D boundsMax;
+  // Uv units per world unit across its triangles, which decides the mip levels its maps need, see compute_mesh_bounds().
+  float uvDensity;
+  // The mesh's clusters in model_t::meshlets, if they were built.
+  unsigned int meshletOffset;
+  unsigned int meshletCount;
+  // Coarser detail levels, lods[0] is level 1. Level 0 is the range above.
+  unsigned int lodCount;
+  mesh_lod_t lods[MESH_MAX_LODS - 1];
+} mesh_range_t;
+
+/**
+ * A small cluster of one mesh's triangles, see build_mesh_meshlets(). Its triangles are contiguous in the index stream.
+ * The bounding sphere and normal cone let whole clusters be culled against a frustum and by their facing.
+ */
+typedef struct {
+  unsigned int indexOffset; // absolute, into model_t::indices
+  unsigned int indexCount;
+  unsigned int vertexCount;
+  float center[3];
+  float radius;
+  float coneAxis[3];
+  float coneCutoff;         // sine of the cone's half angle, 1 if the cluster can face every direction
+} meshlet_t;
+
+// How a scene is turned into a model_t.
+typedef struct {
+  unsigned int postProcessFlags;
+  bool parallelExtract;
+  bool importReport;
+  bool weld;
+  bool optimize;
+  bool meshlets;
+  bool lods;
+  bool nativeLoaders; // .gltf and .obj files skip assimp, see load_gltf() and load_obj()
+} load_options_t;
+
+typedef struct {
+  aiVector3D *vertices;
+  unsigned int *materialIds; // per vertex, indexes materials
+  aiVector3D *normals;
+  aiVector2D *uvs;
+  aiVector3D *tangents;
+  aiVector3D *bitangents;
+  unsigned int *indices;
+
+  // Diffuse colour of every material of the scene, uploaded once as a table instead of per vertex.
+  std::vector<aiColor4D> materials;
+  // Each material's maps, parallel to materials. Empty for materials without one.
+  std::vector<std::string> diffuseMapPaths;
+  std::vector<std::string> normalMapPaths;
+
+  // One entry per mesh reference, in extraction order.
+  std::vector<mesh_range_t> meshes;
+  std::vector<meshlet_t> meshlets;
+
+  // Write cursors used while extracting. After extraction they equal the counts.
+  unsigned int vertexOffset;
+  unsigned indexOffset;
+
+  // Exact sizes, determined by count_model() before allocation.
+  unsigned int vertexCount;
+  unsigned int indexCount;
+
+  // Single allocation backing all of the streams above.
+  // If mapping is set, the arena points into a memory mapped scene cache instead of the heap.
+  char *arena;
+  size_t arenaSize;
+  void *mapping;
+  size_t mappingSize;
+} model_t;
+
+size_t model_stream_sizes(const model_t *model, size_t sizes[MODEL_STREAM_COUNT]);
+size_t model_stream_stride(int stream);
+const char *model_stream(const model_t *model, int stream);
+void layout_model(model_t *model, char *data);
+int allocate_model(model_t *model);
+int grow_model_indices(model_t *model, unsigned int indexCount);
+void free_model(model_t &model);
+
+void count_model(model_t *model, struct aiNode *node, const struct aiScene *scene);
+void extract_indices(model_t *model, struct aiNode *node, const struct aiScene *scene);
+void extract_indices_parallel(model_t *model, const struct aiScene *scene);
+void compute_mesh_bounds(model_t *model, mesh_range_t *range);
+void compute_mesh_normals(model_t *model, const mesh_range_t &range);
+void compute_mesh_tangents(model_t *model, const mesh_range_t &range);
+void extract_mesh(model_t *model, const struct aiScene *scene, const mesh_range_t &range);
+void extract_materials(model_t *model, const struct aiScene *scene);
+void extract_textures(model_t *model, const struct aiScene *scene);
+int import_model(model_t *model, const char *path, const load_options_t *options);
+int run_model_passes(model_t *model, const load_options_t *options);
+
+#endif // MODEL_H_
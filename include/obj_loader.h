@@ -0,0 +1,8 @@
+#ifndef OBJ_LOADER_H_
+#define OBJ_LOADER_H_
+
+#include <model.h>
+
+int load_obj(model_t *model, const char *path, const load_options_t *options);
+
+#endif // OBJ_LOADER_H_
@@ -0,0 +1,23 @@
+#ifndef POINT_LIGHT_H_
+#define POINT_LIGHT_H_
+
+#include <stddef.h>
+#include <vector>
+
+// Size of the light table the shaders declare. Two vec4s per light, so 512 fill the 16 KB every GL implementation supports.
+#define MAX_POINT_LIGHTS 512
+// Uniform buffer binding point of the PointLights block, next to the Materials block.
+#define POINT_LIGHT_BLOCK_BINDING 1
+
+// An unshadowed point light, on top of the shadow casting one. Laid out like the shaders' PointLight struct.
+typedef struct {
+  float position[3];
+  float radius;      // the light fades to nothing at this distance
+  float color[3];
+  float padding;
+} point_light_t;
+
+void upload_point_lights(unsigned int buffer, const std::vector<point_light_t> &lights);
+void bind_point_light_block(unsigned int program);
+
+#endif // POINT_LIGHT_H_
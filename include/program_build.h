@@ -0,0 +1,40 @@
+#ifndef PROGRAM_BUILD_H_
+#define PROGRAM_BUILD_H_
+
+#include <program_cache.h>
+#include <glad/glad.h>
+#include <stdint.h>
+
+// From GL_KHR_parallel_shader_compile, which glad was generated without. GL_ARB_parallel_shader_compile has the same.
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+// Vertex, geometry and fragment.
+#define PROGRAM_MAX_STAGES 3
+
+enum {
+  PROGRAM_COMPILING,
+  PROGRAM_READY,
+  PROGRAM_FAILED,
+};
+
+/**
+ * A program that was handed to the driver by submit_program() and is compiled and linked while the caller goes on,
+ * on drivers that compile on their own threads. poll_program() tells when it can be used.
+ */
+typedef struct {
+  const char *name;                         // also names its program cache, see program_cache_path()
+  unsigned int program;
+  unsigned int shaders[PROGRAM_MAX_STAGES]; // none if the program came from the cache
+  int shaderCount;
+  uint64_t sourceHash;
+  int status;
+  bool cached;
+} program_build_t;
+
+bool enable_parallel_shader_compile(GLADloadproc load);
+void submit_program(program_build_t *build, const program_cache_t *cache, const char *name, const char *const *sources,
+                    const unsigned int *stages, int stageCount);
+int poll_program(program_build_t *build, const program_cache_t *cache, bool parallel);
+
+#endif // PROGRAM_BUILD_H_
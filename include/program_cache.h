@@ -0,0 +1,27 @@
+#ifndef PROGRAM_CACHE_H_
+#define PROGRAM_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+
+// Bump whenever the layout of the cache changes.
+#define PROGRAM_CACHE_VERSION 1
+
+/**
+ * Linked programs as the driver hands them out through glGetProgramBinary(), cached on disk so later starts skip
+ * compiling and linking. Binaries only load into the driver that produced them, so they are keyed by it as well
+ * as by the programs' sources.
+ */
+typedef struct {
+  bool supported;      // the context has glGetProgramBinary() and at least one binary format
+  uint64_t driverHash; // of GL_VENDOR, GL_RENDERER and GL_VERSION
+} program_cache_t;
+
+void open_program_cache(program_cache_t *cache);
+std::string program_cache_path(const char *name);
+uint64_t hash_program_sources(const char *const *sources, int count);
+void mark_program_retrievable(const program_cache_t *cache, unsigned int program);
+unsigned int load_cached_program(const program_cache_t *cache, const char *name, uint64_t sourceHash);
+int write_cached_program(const program_cache_t *cache, const char *name, uint64_t sourceHash, unsigned int program);
+
+#endif // PROGRAM_CACHE_H_
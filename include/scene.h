@@ -0,0 +1,52 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <model.h>
+#include <draw_range.h>
+#include <material_textures.h>
+#include <meshlet.h>
+#include <texture_loader.h>
+#include <string>
+#include <vector>
+
+/**
+ * One file of a composed scene. Its meshes are a contiguous span of the scene's shared model,
+ * so all assets live in the same buffers and VAO, and only differ in their model matrix.
+ * Their materials' maps are part of the scene's material_textures_t, at the asset's materialOffset.
+ */
+typedef struct {
+  std::string path;
+  float transform[4][4];        // column major model matrix
+  float inverseTransform[4][4];
+  unsigned int meshOffset;      // first of its meshes in the shared model
+  unsigned int meshCount;
+  // Its share of the buffers. A reloaded asset is written over it in place as long as it still fits.
+  unsigned int vertexOffset;
+  unsigned int vertexCapacity;
+  unsigned int materialOffset;
+  unsigned int materialCapacity;
+  size_t indexByteOffset;       // into the element buffer, see assign_index_spans()
+  size_t indexByteCapacity;
+} scene_asset_t;
+
+void make_asset_transform(scene_asset_t *asset, const float translation[3], float scale, float rotationY);
+int parse_scene_file(const char *path, std::vector<scene_asset_t> *assets);
+int append_model(model_t *pool, const model_t *part);
+int load_scene(model_t *model, std::vector<scene_asset_t> *assets, const load_options_t *options);
+void assign_index_spans(std::vector<scene_asset_t> *assets, const std::vector<draw_range_t> &ranges, size_t indexBytes);
+int reload_asset(std::vector<scene_asset_t> *assets, unsigned int index, model_t *model, std::vector<draw_range_t> *ranges,
+                 const load_options_t *options, const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                 material_textures_t *textures, texture_loader_t *textureLoader);
+int reload_scene(std::vector<scene_asset_t> *assets, model_t *model, std::vector<draw_range_t> *ranges,
+                 const load_options_t *options, const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                 material_textures_t *textures, texture_loader_t *textureLoader);
+void reload_changed_assets(const std::vector<std::string> &changed, std::vector<scene_asset_t> *assets, model_t *model,
+                           std::vector<draw_range_t> *ranges, const load_options_t *options,
+                           const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                           material_textures_t *textures, texture_loader_t *textureLoader);
+void draw_scene(unsigned int program, const std::vector<scene_asset_t> &assets, const std::vector<mesh_range_t> &meshes,
+                const std::vector<draw_range_t> &ranges, const cull_view_t *view, cull_stats_t *stats);
+void request_scene_levels(material_textures_t *textures, const std::vector<scene_asset_t> &assets,
+                          const std::vector<mesh_range_t> &meshes, const cull_view_t *view, float pixelScale);
+
+#endif // SCENE_H_
@@ -0,0 +1,20 @@
+#ifndef SCENE_CACHE_H_
+#define SCENE_CACHE_H_
+
+#include <model.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Bump whenever the layout of the cache or of model_t's arena changes.
+#define SCENE_CACHE_VERSION 9
+
+std::string scene_cache_path(const char *scenePath);
+std::vector<std::string> scene_source_files(const char *scenePath);
+uint64_t hash_bytes(uint64_t hash, const unsigned char *data, size_t size);
+uint64_t hash_source_file(const char *path);
+uint64_t hash_scene_source(const char *scenePath);
+int load_scene_cache(model_t *model, const char *scenePath, const load_options_t *options);
+int write_scene_cache(const model_t *model, const char *scenePath, const load_options_t *options);
+
+#endif // SCENE_CACHE_H_
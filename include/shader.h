@@ -2,5 +2,6 @@
 #define SHADER_H_
 
 char *read_shader_from_file(const char *filepath);
+char *read_shader_with_prelude(const char *filepath, const char *prelude);
 
 #endif // SHADER_H_
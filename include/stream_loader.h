@@ -0,0 +1,58 @@
+#ifndef STREAM_LOADER_H_
+#define STREAM_LOADER_H_
+
+#include <model.h>
+#include <draw_range.h>
+#include <vertex_format.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Bytes uploaded per frame by stream_loader_update().
+#define STREAM_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+enum {
+  STREAM_IMPORTING,
+  STREAM_EXTRACTING,
+  STREAM_DONE,
+  STREAM_FAILED,
+};
+
+/**
+ * Loads a scene on a background thread while the render loop keeps going.
+ * The worker publishes the model's sizes first and then every mesh as soon as it is extracted,
+ * the render thread uploads whatever has landed in bounded chunks and appends the mesh's draw ranges to drawRanges.
+ */
+typedef struct {
+  std::string scenePath;
+  load_options_t options;
+
+  // Shared with the worker. model's sizes and mesh list are valid once state left STREAM_IMPORTING,
+  // the first meshesExtracted meshes of the arena are complete.
+  std::thread worker;
+  std::atomic<int> state;
+  std::atomic<unsigned int> meshesExtracted;
+  model_t model;
+  std::vector<std::vector<meshlet_t>> meshMeshlets; // per mesh, while importing; the cache fills model.meshlets instead
+
+  // Render thread only.
+  bool reserved;
+  unsigned int meshesUploaded;
+  int uploadStream;
+  size_t uploadStreamBytes;
+  size_t indexBytes;                       // packed indices uploaded so far
+  std::vector<char> packedIndices;         // the mesh currently uploaded, packed
+  std::vector<draw_range_t> pendingRanges; // its draw ranges, drawable once all of its streams are uploaded
+#ifdef COMPACT_VERTICES
+  std::vector<compact_vertex_t> compactVertices; // the mesh currently uploaded, encoded
+#endif
+  std::vector<draw_range_t> drawRanges;
+  bool finished;
+} stream_loader_t;
+
+void start_stream_loader(stream_loader_t *loader, const char *scenePath, const load_options_t *options);
+bool stream_loader_update(stream_loader_t *loader, const unsigned int buffers[MODEL_STREAM_COUNT],
+                          unsigned int materialBuffer, size_t budget);
+float stream_loader_progress(const stream_loader_t *loader);
+
+#endif // STREAM_LOADER_H_
@@ -0,0 +1,30 @@
+#ifndef STRESS_SCENE_H_
+#define STRESS_SCENE_H_
+
+#include <model.h>
+#include <point_light.h>
+#include <vector>
+
+// Every mirror is marked with its own stencil value, 0 means no mirror.
+#define STRESS_MAX_MIRRORS 255
+// How often the average frame time of a generated scene is printed.
+#define STRESS_REPORT_SECONDS 5.0
+
+// How large a generated scene is, see generate_stress_scene().
+typedef struct {
+  unsigned int boxes;
+  unsigned int lights;
+  unsigned int mirrors;
+} stress_options_t;
+
+// A planar mirror: the quad that is reflective, and the plane it lies in.
+typedef struct {
+  float corners[4][3];
+  float point[3];
+  float normal[3]; // points towards the viewer
+} mirror_t;
+
+int generate_stress_scene(model_t *model, const stress_options_t *stress, const load_options_t *options,
+                          std::vector<point_light_t> *lights, std::vector<mirror_t> *mirrors);
+
+#endif // STRESS_SCENE_H_
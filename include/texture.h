@@ -0,0 +1,63 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most mip levels a texture can have, enough for 32768 texels on a side.
+#define TEXTURE_MAX_LEVELS 16
+
+// What a texture holds, which decides how its mipmaps are filtered (see texture_mips.h) and how it is compressed.
+enum {
+  TEXTURE_COLOR,  // sRGB; BC1, or BC3 if it has alpha
+  TEXTURE_NORMAL, // unit vectors; BC5, x and y only, the shaders reconstruct z
+};
+
+// Decoded 8 bit image, as returned by stb_image.
+typedef struct {
+  unsigned char *data;
+  int width;
+  int height;
+  int components;
+} image_t;
+
+// Where one mip level of a texture_levels_t is, relative to its data.
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset;
+  uint64_t size;
+} texture_level_t;
+
+/**
+ * A texture with all of its mip levels, in the GL formats it is uploaded with.
+ * format and type are 0 for block compressed levels, see texture_compress.h.
+ * The levels are packed into data, which either points into a memory mapped texture cache (mapping is set)
+ * or was allocated with malloc.
+ */
+typedef struct {
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t type;
+  uint32_t levelCount;
+  texture_level_t levels[TEXTURE_MAX_LEVELS];
+  unsigned char *data;
+  size_t dataSize;
+  void *mapping;
+  size_t mappingSize;
+} texture_levels_t;
+
+int decode_image(image_t *image, const char *path);
+void free_image(image_t *image);
+void allocate_texture_array(unsigned int texture, const texture_levels_t *shape, uint32_t firstLevel,
+                            unsigned int layers);
+void allocate_texture_array_level(unsigned int texture, const texture_levels_t *shape, uint32_t level,
+                                  unsigned int layers);
+void set_texture_array_base_level(unsigned int texture, uint32_t level);
+void upload_texture_layer(unsigned int texture, unsigned int layer, const texture_levels_t *levels,
+                          uint32_t firstLevel, uint32_t lastLevel, unsigned int pixelBuffer);
+void copy_texture_array(unsigned int source, unsigned int target, const texture_levels_t *shape, uint32_t firstLevel,
+                        unsigned int layers);
+void free_texture_levels(texture_levels_t *levels);
+
+#endif // TEXTURE_H_
@@ -0,0 +1,14 @@
+#ifndef TEXTURE_CACHE_H_
+#define TEXTURE_CACHE_H_
+
+#include <texture.h>
+#include <string>
+
+// Bump whenever the layout of the cache changes, or how the levels in it are generated.
+#define TEXTURE_CACHE_VERSION 3
+
+std::string texture_cache_path(const char *imagePath);
+int load_texture_cache(texture_levels_t *levels, const char *imagePath);
+int write_texture_cache(const texture_levels_t *levels, const char *imagePath);
+
+#endif // TEXTURE_CACHE_H_
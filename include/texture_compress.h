@@ -0,0 +1,17 @@
+#ifndef TEXTURE_COMPRESS_H_
+#define TEXTURE_COMPRESS_H_
+
+#include <texture.h>
+
+// S3TC formats from EXT_texture_compression_s3tc, which the GL loader was generated without.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+bool s3tc_supported();
+int compress_texture_levels(const texture_levels_t *source, int kind, bool s3tc, texture_levels_t *compressed);
+
+#endif // TEXTURE_COMPRESS_H_
@@ -0,0 +1,51 @@
+#ifndef TEXTURE_LOADER_H_
+#define TEXTURE_LOADER_H_
+
+#include <texture.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes of texture levels handed out per frame by texture_loader_update(). At least one texture goes each frame.
+#define TEXTURE_UPLOAD_BUDGET (16 * 1024 * 1024)
+// Pixel unpack buffers used in turn, so an upload doesn't wait for the previous one's transfer.
+#define TEXTURE_UPLOAD_BUFFERS 2
+
+// One image on its way from file to texture.
+typedef struct {
+  std::string path;
+  int kind;                // TEXTURE_COLOR or TEXTURE_NORMAL
+  texture_levels_t levels; // all levels, mapped from the texture cache or generated; data stays NULL on failure
+} texture_job_t;
+
+/**
+ * Loads images on a pool of worker threads and hands them to the GL thread with all of their levels.
+ * Images with a texture cache are mapped, block compressed. The others are decoded, their mipmaps generated
+ * (see texture_mips.h), compressed and cached by the workers before they are handed out, see texture_cache.h.
+ */
+typedef struct {
+  // Shared with the workers, guarded by mutex.
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<texture_job_t> queued;
+  std::deque<texture_job_t> decoded;
+  bool stopping;
+  bool s3tc; // whether colour can be block compressed, set before the workers start
+
+  // GL thread only.
+  unsigned int pending; // queued, being decoded or waiting for upload
+  unsigned int pixelBuffers[TEXTURE_UPLOAD_BUFFERS];
+  unsigned int nextPixelBuffer;
+} texture_loader_t;
+
+void start_texture_loader(texture_loader_t *loader);
+void queue_texture(texture_loader_t *loader, const std::string &path, int kind);
+unsigned int next_pixel_buffer(texture_loader_t *loader);
+unsigned int texture_loader_update(texture_loader_t *loader, size_t budget, std::vector<texture_job_t> *loaded);
+void stop_texture_loader(texture_loader_t *loader);
+
+#endif // TEXTURE_LOADER_H_
@@ -0,0 +1,11 @@
+#ifndef TEXTURE_MIPS_H_
+#define TEXTURE_MIPS_H_
+
+#include <texture.h>
+
+// Level 0 rows per task are 1 << MIP_BAND_LEVELS, each task filters its band that many levels down.
+#define MIP_BAND_LEVELS 4
+
+int generate_texture_levels(const image_t *image, int kind, texture_levels_t *levels);
+
+#endif // TEXTURE_MIPS_H_
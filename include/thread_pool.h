@@ -0,0 +1,10 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <functional>
+#include <stddef.h>
+
+unsigned int worker_count();
+void parallel_for(size_t count, const std::function<void(size_t)> &task);
+
+#endif // THREAD_POOL_H_
@@ -0,0 +1,44 @@
+#ifndef VERTEX_FORMAT_H_
+#define VERTEX_FORMAT_H_
+
+#include <draw_range.h>
+#include <meshlet.h>
+#include <model.h>
+#include <stdint.h>
+
+// Build with COMPACT_VERTICES=1 to store the vertices quantised in one interleaved buffer, see compact_vertex_t.
+// The vertex shaders pick the matching decode path from shaders/vertex_format.glsl.
+
+#ifdef COMPACT_VERTICES
+// Defines the vertex shaders need to decode this build's vertex format.
+#define VERTEX_FORMAT_DEFINES "#define COMPACT_VERTICES\n"
+
+/**
+ * 24 bytes instead of the 56 bytes the full format spreads over six buffers.
+ * Positions are quantised to the bounds of their mesh, so every mesh is drawn with its own scale/offset.
+ */
+typedef struct {
+  uint16_t position[4]; // xyz quantised to the mesh bounds, w is the bitangent's sign (0 or 65535)
+  uint16_t material;
+  uint16_t padding;
+  int16_t normal[2];    // octahedral
+  uint16_t uv[2];       // half floats
+  int16_t tangent[2];   // octahedral
+} compact_vertex_t;
+
+void encode_compact_vertices(const model_t *model, const mesh_range_t &range, compact_vertex_t *destination);
+#else
+#define VERTEX_FORMAT_DEFINES ""
+#endif
+
+size_t gpu_stream_sizes(const model_t *model, size_t sizes[MODEL_STREAM_COUNT]);
+void setup_vertex_attributes(const unsigned int buffers[MODEL_STREAM_COUNT]);
+size_t upload_model_buffers(const unsigned int buffers[MODEL_STREAM_COUNT], const model_t *model,
+                            std::vector<draw_range_t> *ranges);
+void upload_vertices_at(const unsigned int buffers[MODEL_STREAM_COUNT], const model_t *model, unsigned int vertexOffset);
+void set_mesh_uniforms(unsigned int program, const mesh_range_t &range);
+void reset_mesh_uniforms(unsigned int program);
+void draw_meshes(unsigned int program, const std::vector<mesh_range_t> &meshes, const draw_range_t *ranges,
+                 size_t rangeCount, const cull_view_t *view, cull_stats_t *stats);
+
+#endif // VERTEX_FORMAT_H_
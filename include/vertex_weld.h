@@ -0,0 +1,16 @@
+#ifndef VERTEX_WELD_H_
+#define VERTEX_WELD_H_
+
+#include <model.h>
+
+typedef struct {
+  size_t verticesBefore;
+  size_t verticesAfter;
+} weld_stats_t;
+
+void weld_mesh(model_t *model, mesh_range_t *range, weld_stats_t *stats);
+void compact_model(model_t *model);
+void weld_model(model_t *model, weld_stats_t *stats);
+void print_weld_stats(const weld_stats_t *stats);
+
+#endif // VERTEX_WELD_H_
@@ -4,17 +4,34 @@
 #include "assimp/vector3.h"
 #include "bits/types/struct_timeval.h"
 #include "cglm/types.h"
+#include "include/asset_watcher.h"
+#include "include/import_profile.h"
+#include "include/material.h"
+#include "include/material_textures.h"
+#include "include/mesh_lod.h"
+#include "include/meshlet.h"
+#include "include/model.h"
+#include "include/point_light.h"
+#include "include/program_build.h"
+#include "include/program_cache.h"
+#include "include/scene.h"
+#include "include/scene_cache.h"
 #include "include/shader.h"
+#include "include/stream_loader.h"
+#include "include/stress_scene.h"
+#include "include/texture.h"
+#include "include/texture_loader.h"
+#include "include/vertex_format.h"
 #include <assimp/cimport.h>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <cglm/cglm.h>
 #include <glad/glad.h>
 #include <math.h>
+#include <algorithm>
 #include <stdio.h>
 #include <time.h>
 #include <iostream>
-#include <filesystem>
 
 #include <GLFW/glfw3.h>
 #include <string.h>
@@ -23,68 +40,11 @@
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "include/stb_image.h"
-
-#define KB(x) (x * 1024)
-
 struct ShaderDeclaration {
   const char *name, *vertPath, *fragPath;
   unsigned int program = 0;
 };
 
-typedef struct {
-  aiVector3D *vertices;
-  aiColor4D *albedo;
-  aiVector3D *normals;
-  aiVector2D *uvs;
-  aiVector3D *tangents;
-  aiVector3D *bitangents;
-  unsigned int *indices;
-  std::string normalMapPath;
-  std::string diffuseMapPath;
-
-  unsigned int vertexOffset;
-  unsigned indexOffset;
-} model_t;
-
-typedef struct {
-  vec3 point;    // A point on the plane
-  vec3 normal;   // Plane normal (should point towards the viewer)
-} reflection_plane_t;
-
-/**
- * Checks if the shader compiled properly. Throws an error and terminates the program otherwise.
- * Helpful because Open-GL does not report these errors.
- */
-void check_shader_compiling(unsigned int shader) {
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLint logLength;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
-        char log[logLength];
-        glGetShaderInfoLog(shader, logLength, nullptr, log);
-        throw std::runtime_error("Shader compilation failed!\n" + std::string(log));
-    }
-}
-
-/**
- * Checks if the shader linked properly. Throws an error and terminates the program otherwise.
- */
-void check_shader_linking(unsigned int shader) {
-    GLint success;
-    glGetShaderiv(shader, GL_LINK_STATUS, &success);
-    if (!success) {
-        GLint logLength;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
-        char log[logLength];
-        glGetShaderInfoLog(shader, logLength, nullptr, log);
-        throw std::runtime_error("Shader linking failed!\n" + std::string(log));
-    }
-
-}
-
 /**
  * Allows resizing of the window. Otherwise the window dimension would not match that of the framebuffer.
  */
@@ -92,138 +52,6 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   glViewport(0, 0, width, height);
 }
 
-/**
- * Frees the allocated storage for the model.
- * Since one chunk is allocated, starting at model->indices, it suffices to free that.
- */
-void free_model(model_t &model) {
-  free(model.indices);
-}
-
-
-//TODO: This currently allocates 70 KB flat. Of course, this may be way too much.
-// Instead, a precise amount of memory should be allocated, but this requires aggregating information about the model.
-int allocate_model(model_t *model) {
-  // Allocate one chunk of memory
-  char* data = (char *)malloc(KB(70));
-  if(data == NULL){
-    printf("Failed to allocate memory for Scene.\n");
-    glfwTerminate();
-    return -1;
-  }
-
-
-  // Index into the chunk at 10 KB offsets each.
-  // Therefore, each field gets 10 KB of memory.
-  model->indices = (unsigned int*) data;
-  model->vertices = (aiVector3D*) (data + KB(10));
-  model->albedo = (aiColor4D*) (data + KB(20));
-  model->normals = (aiVector3D*) (data + KB(30));
-  model->uvs = (aiVector2D*) (data + KB(40));
-  model->tangents = (aiVector3D*) (data + KB(50));
-  model->bitangents = (aiVector3D*) (data + KB(60));
-
-  return 0;
-}
-
-
-/*
-** Fetch normal and diffuse maps from the model.
- */
-void extract_textures(model_t *model, const struct aiScene *scene){
-  for(int i = 0; i < scene->mNumMaterials; i++){
-    aiMaterial* mat = scene->mMaterials[i];
-
-    unsigned int normalMapCount = mat->GetTextureCount(aiTextureType_NORMALS);
-
-    for(unsigned int j = 0; j < normalMapCount; j++){
-      aiString path;
-      mat->GetTexture(aiTextureType_NORMALS, 0, &path);
-      // The texture path has to be prefixed with "./",
-      // because the path is relative. Otherwise throws an error.
-      model->normalMapPath = std::string("./") + std::string(path.C_Str());
-    }
-
-    unsigned int textureMapCount = mat->GetTextureCount(aiTextureType_DIFFUSE);
-
-    for(unsigned int j = 0; j < textureMapCount; j++){
-      aiString path;
-      mat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-      model->diffuseMapPath = std::string("./") + std::string(path.C_Str());
-    }
-  }
-}
-
-/**
- * Loads all vertex data & indices from the .gltf file.
- */
-void extract_indices(model_t *model, struct aiNode *node,
-                     const struct aiScene *scene) {
-  // Iterate over every mesh in the model.
-  // What constitutes a mesh depends on how the model was constructed in Blender, for example.
-  for (int meshIndex = 0; meshIndex < node->mNumMeshes; meshIndex++) {
-    unsigned int meshId = node->mMeshes[meshIndex];
-    unsigned int materialId = scene->mMeshes[meshId]->mMaterialIndex;
-    // Faces are the triangles of our mesh.
-    for (int faceIdx = 0; faceIdx < scene->mMeshes[meshId]->mNumFaces;
-         faceIdx++) {
-      struct aiFace face = scene->mMeshes[meshId]->mFaces[faceIdx];
-      // Store only the associated index for now.
-      // A later pass will extract the vertex data.
-      for (int i = 0; i < face.mNumIndices; i++) {
-        model->indices[model->indexOffset + i] =
-            face.mIndices[i] + (model->vertexOffset);
-      }
-      model->indexOffset += face.mNumIndices;
-    }
-
-    aiColor4D albedo;
-    if (AI_SUCCESS == aiGetMaterialColor(scene->mMaterials[materialId],
-                                         AI_MATKEY_COLOR_DIFFUSE, &albedo)) {
-
-    } else {
-      printf("Failed to load albedo color!\n");
-    }
-
-    aiString str;
-    aiGetMaterialTexture(scene->mMaterials[materialId], aiTextureType_NORMALS, 0, &str);
-
-
-    // This pass extracts the concrete vertex data.
-    // This comprises: position, color, normals, uvs, tangents, bitangents.
-    for (int vertexIdx = 0; vertexIdx < scene->mMeshes[meshId]->mNumVertices;
-         vertexIdx++) {
-      model->vertices[model->vertexOffset + vertexIdx] =
-          scene->mMeshes[meshId]->mVertices[vertexIdx];
-      model->albedo[model->vertexOffset + vertexIdx] = albedo;
-      model->normals[model->vertexOffset + vertexIdx] = scene->mMeshes[meshId]->mNormals[vertexIdx];
-      // Does the mesh contain vertex coordinates? I.e. is this mesh textured at all?
-      if(scene->mMeshes[meshId]->mTextureCoords[0]){
-        aiVector2D uv;
-        uv.x = scene->mMeshes[meshId]->mTextureCoords[0][vertexIdx].x;
-        uv.y = scene->mMeshes[meshId]->mTextureCoords[0][vertexIdx].y;
-        model->uvs[model->vertexOffset + vertexIdx] = uv;
-        model->tangents[model->vertexOffset + vertexIdx] = scene->mMeshes[meshId]->mTangents[vertexIdx];
-        model->bitangents[model->vertexOffset + vertexIdx] = scene->mMeshes[meshId]->mBitangents[vertexIdx];
-      }else {
-        // Since we don't separate rendering of un-textured and textured meshes,
-        // we have to provide a designated uv value that our shader can detect.
-        model->uvs[model->vertexOffset + vertexIdx] = (aiVector2D){-1.0f, -1.0f};
-        model->tangents[model->vertexOffset + vertexIdx] = (aiVector3D){0.0f, 0.0f, 0.0f};
-      }
-    }
-
-    model->vertexOffset += scene->mMeshes[meshId]->mNumVertices;
-  }
-
-  // Because assimp's aiScene has a graph structure,
-  // there may be child nodes that describe missing parts of the scene.
-  // Therefore, also recurse into these and extract.
-  for (int childIdx = 0; childIdx < node->mNumChildren; childIdx++) {
-    extract_indices(model, node->mChildren[childIdx], scene);
-  }
-}
-
 //////////////////////////
 // Reflection Functions //
 //////////////////////////
@@ -249,7 +77,8 @@ void reflect_direction_across_plane(vec3 dest, vec3 v, vec3 plane_normal) {
     glm_vec3_sub(v, temp, dest);
 }
 
-void create_reflective_surface_stencil(unsigned int* VAO_stencil, unsigned int* VBO_stencil) {
+// The mirror standing in the Cornell box.
+mirror_t cornell_box_mirror() {
   float center_point[] = {3.440f, 1.650f, 2.714f};
   float scale = 1.0f;
 
@@ -260,18 +89,40 @@ void create_reflective_surface_stencil(unsigned int* VAO_stencil, unsigned int*
     2.650f, 0.000f, 2.959f
   };
 
-  float stencil_vertices[12];
+  mirror_t mirror = {
+    {},
+    {3.440f, 1.650f, 2.714f},
+    {-0.296f, 0.000f, -0.955f}
+  };
   for (int i = 0; i < 4; ++i) {
     int j = i * 3;
-    stencil_vertices[j + 0] = center_point[0] + scale * (original_vertices[j + 0] - center_point[0]);
-    stencil_vertices[j + 1] = center_point[1] + scale * (original_vertices[j + 1] - center_point[1]);
-    stencil_vertices[j + 2] = center_point[2] + scale * (original_vertices[j + 2] - center_point[2]);
+    mirror.corners[i][0] = center_point[0] + scale * (original_vertices[j + 0] - center_point[0]);
+    mirror.corners[i][1] = center_point[1] + scale * (original_vertices[j + 1] - center_point[1]);
+    mirror.corners[i][2] = center_point[2] + scale * (original_vertices[j + 2] - center_point[2]);
   }
+  return mirror;
+}
 
-  unsigned int stencil_indices[] = {
-    0, 1, 2,
-    2, 3, 0
-  };
+/**
+ * Puts the quads of all mirrors into one buffer, four vertices and six indices each, in the order of mirrors.
+ * Mirror i is drawn with glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(i * 6 * sizeof(unsigned int))).
+ */
+void create_reflective_surface_stencil(const std::vector<mirror_t> &mirrors, unsigned int* VAO_stencil,
+                                       unsigned int* VBO_stencil) {
+  std::vector<float> stencil_vertices;
+  std::vector<unsigned int> stencil_indices;
+  for (unsigned int m = 0; m < mirrors.size(); m++) {
+    for (int i = 0; i < 4; ++i) {
+      stencil_vertices.insert(stencil_vertices.end(), mirrors[m].corners[i], mirrors[m].corners[i] + 3);
+    }
+    unsigned int quad_indices[] = {
+      0, 1, 2,
+      2, 3, 0
+    };
+    for (unsigned int index : quad_indices) {
+      stencil_indices.push_back(4 * m + index);
+    }
+  }
 
   glGenVertexArrays(1, VAO_stencil);
   glGenBuffers(1, VBO_stencil);
@@ -281,10 +132,11 @@ void create_reflective_surface_stencil(unsigned int* VAO_stencil, unsigned int*
   glBindVertexArray(*VAO_stencil);
 
   glBindBuffer(GL_ARRAY_BUFFER, *VBO_stencil);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(stencil_vertices), stencil_vertices, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * stencil_vertices.size(), stencil_vertices.data(), GL_STATIC_DRAW);
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_stencil);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(stencil_indices), stencil_indices, GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * stencil_indices.size(), stencil_indices.data(),
+               GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
   glEnableVertexAttribArray(0);
@@ -293,7 +145,72 @@ void create_reflective_surface_stencil(unsigned int* VAO_stencil, unsigned int*
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 900;
 
-int main() {
+int main(int argc, char **argv) {
+
+  ///////////////////
+  // Command line  //
+  ///////////////////
+
+  // --parallel-extract: copy the meshes out of assimp's scene on all cores.
+  // --stream: load the scene in the background and render while it arrives.
+  // --profile <fast|balanced|max>: which assimp post-processing steps to run.
+  // --import-report: time every post-processing step. Bypasses the scene cache, since that skips assimp.
+  // --weld: merge bit-identical vertices, reports the memory saved.
+  // --optimize: reorder triangles and vertices for the vertex cache and overdraw, reports ACMR/ATVR.
+  // --meshlets: split meshes into small clusters that are culled individually, per view and shadow cubemap face.
+  // --lods: simplify every mesh into coarser levels, picked per mesh and view by their error on screen.
+  // --assimp: import .gltf and .obj files through assimp too, instead of the native loaders.
+  // --scene <file>: compose the scene from the assets listed in file, see parse_scene_file(). Defaults to the Cornell box.
+  // --stress <boxes>: generate a scene of that many Cornell boxes instead, see generate_stress_scene().
+  //   --stress-lights <count> adds unshadowed point lights to it, --stress-mirrors <count> mirrors (default 1).
+  // --texture-budget <MB>: VRAM the materials' maps may take, finer mip levels are streamed in as far as it allows.
+  load_options_t loadOptions = {};
+  loadOptions.nativeLoaders = true;
+  const import_profile_t *profile = find_import_profile(DEFAULT_IMPORT_PROFILE);
+  bool streamLoad = false;
+  const char *sceneFile = NULL;
+  stress_options_t stress = {0, 0, 1};
+  size_t textureBudget = TEXTURE_RESIDENCY_BUDGET;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--parallel-extract") == 0) {
+      loadOptions.parallelExtract = true;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      streamLoad = true;
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profile = find_import_profile(argv[++i]);
+      if (profile == NULL) {
+        printf("Unknown profile %s, available are:\n", argv[i]);
+        print_import_profiles();
+        return -1;
+      }
+    } else if (strcmp(argv[i], "--import-report") == 0) {
+      loadOptions.importReport = true;
+    } else if (strcmp(argv[i], "--weld") == 0) {
+      loadOptions.weld = true;
+    } else if (strcmp(argv[i], "--optimize") == 0) {
+      loadOptions.optimize = true;
+    } else if (strcmp(argv[i], "--meshlets") == 0) {
+      loadOptions.meshlets = true;
+    } else if (strcmp(argv[i], "--lods") == 0) {
+      loadOptions.lods = true;
+    } else if (strcmp(argv[i], "--assimp") == 0) {
+      loadOptions.nativeLoaders = false;
+    } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+      sceneFile = argv[++i];
+    } else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+      stress.boxes = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--stress-lights") == 0 && i + 1 < argc) {
+      stress.lights = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--stress-mirrors") == 0 && i + 1 < argc) {
+      stress.mirrors = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+      textureBudget = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+    } else {
+      printf("Unknown option %s\n", argv[i]);
+    }
+  }
+  loadOptions.postProcessFlags = profile->postProcessFlags;
+  printf("Using import profile %s\n", profile->name);
 
   /////////////////////////
   // GLFW Initialization //
@@ -338,37 +255,75 @@ int main() {
   // Scene loading //
   ///////////////////
 
-  const C_STRUCT aiScene *scene = aiImportFile(
-      "assets/cornell_box_v2.gltf", aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_CalcTangentSpace);
-
-  if (scene == NULL) {
-    printf("Failed to load scene\n");
+  // Every asset's geometry goes into one shared model, and from there into one set of buffers behind one VAO.
+  std::vector<scene_asset_t> assets;
+  if (stress.boxes > 0) {
+    // The generated scene is a single asset without a file, so there is nothing to stream, cache or watch.
+    if (sceneFile != NULL || streamLoad) {
+      printf("--stress replaces --scene and --stream\n");
+    }
+    streamLoad = false;
+    scene_asset_t generated = {};
+    const float origin[3] = {0.0f, 0.0f, 0.0f};
+    make_asset_transform(&generated, origin, 1.0f, 0.0f);
+    assets.push_back(generated);
+  } else if (sceneFile == NULL) {
+    scene_asset_t cornellBox = {};
+    cornellBox.path = "assets/cornell_box_v2.gltf";
+    const float origin[3] = {0.0f, 0.0f, 0.0f};
+    make_asset_transform(&cornellBox, origin, 1.0f, 0.0f);
+    assets.push_back(cornellBox);
+  } else if (parse_scene_file(sceneFile, &assets) < 0) {
     glfwTerminate();
     return -1;
   }
-
-  struct aiNode *root = scene->mRootNode;
-
-  model_t cornellBox = {};
-
-  if (allocate_model(&cornellBox) < 0) {
-    return -1;
+  // The stream loader fills a single model, so only single asset scenes can stream.
+  if (streamLoad && assets.size() > 1) {
+    printf("Streaming loads a single asset, loading the %zu assets of %s up front\n", assets.size(), sceneFile);
+    streamLoad = false;
   }
 
-  extract_indices(&cornellBox, root, scene);
-  extract_textures(&cornellBox, scene);
+  // In streaming mode sceneModel stays empty, the loader fills the buffers frame by frame instead.
+  model_t sceneModel = {};
+  stream_loader_t loader = {};
+  // Mirrors and the point lights besides the shadow casting one. Only generated scenes have more than one mirror.
+  std::vector<point_light_t> pointLights;
+  std::vector<mirror_t> mirrors;
+  if (stress.boxes == 0) {
+    mirrors.push_back(cornell_box_mirror());
+  }
 
+  if (streamLoad) {
+    start_stream_loader(&loader, assets[0].path.c_str(), &loadOptions);
+    // Owns whatever meshes the loader delivers.
+    assets[0].meshCount = ~0u;
+  } else {
+    // Warm starts map the baked scene caches, cold starts import through assimp and bake them.
+    // Stress scenes are generated every time, so their load time is the generator's.
+    double loadStart = glfwGetTime();
+    if (stress.boxes > 0) {
+      if (generate_stress_scene(&sceneModel, &stress, &loadOptions, &pointLights, &mirrors) < 0) {
+        glfwTerminate();
+        return -1;
+      }
+      assets[0].meshCount = sceneModel.meshes.size();
+      assets[0].vertexCapacity = sceneModel.vertexCount;
+      assets[0].materialCapacity = sceneModel.materials.size();
+    } else {
+      if (load_scene(&sceneModel, &assets, &loadOptions) < 0) {
+        glfwTerminate();
+        return -1;
+      }
+    }
 
-  unsigned int textures[2] = {0};
-  glGenTextures(2, textures);
-  unsigned int& normalMap = textures[0];
-  unsigned int& diffuseMap = textures[1];
+    printf("Loaded scene (%zu assets): %u vertices, %u indices (%zu bytes) in %.2f ms\n", assets.size(),
+           sceneModel.vertexCount, sceneModel.indexCount, sceneModel.arenaSize, (glfwGetTime() - loadStart) * 1000.0);
+  }
 
-
-  reflection_plane_t mirror_plane = {
-    {3.440f, 1.650f, 2.714f},
-    {-0.296f, 0.000f, -0.955f}
-  };
+  // Draw calls into the element buffer, 16 bit wherever a range fits. Grows frame by frame while streaming.
+  std::vector<draw_range_t> drawRanges;
+  const std::vector<draw_range_t> &sceneRanges = streamLoad ? loader.drawRanges : drawRanges;
+  const std::vector<mesh_range_t> &sceneMeshes = streamLoad ? loader.model.meshes : sceneModel.meshes;
 
   ////////////////////
   // Shader loading //
@@ -390,98 +345,106 @@ int main() {
   const char* SHADER_NAMES[NUM_SHADERS];
   std::cout << "Nr. of shaders: " << NUM_SHADERS << std::endl;
 
-  // This generates the shader for all the ones defined in SHADERS.
+  // Every vertex shader declares its attributes through vertex_format.glsl, set up for this build's vertex format.
+  char *vertexFormatCode = read_shader_from_file("shaders/vertex_format.glsl");
+  std::string vertexPrelude = std::string(VERTEX_FORMAT_DEFINES) +
+                              "#define MAX_MATERIALS " + std::to_string(MAX_MATERIALS) + "\n" + vertexFormatCode;
+  free(vertexFormatCode);
+  std::string fragmentPrelude = "#define MAX_POINT_LIGHTS " + std::to_string(MAX_POINT_LIGHTS) + "\n" +
+                                "#define MAX_TEXTURE_GROUPS " + std::to_string(MAX_TEXTURE_GROUPS) + "\n";
+
+  // Programs linked on an earlier start come out of their binary cache, keyed by their fragment shader's path.
+  // The others are all submitted before any of them is waited for, so drivers that compile on their own threads
+  // work on all of them at once. Frames render with whichever programs are ready, see update_programs below.
+  program_cache_t programCache;
+  open_program_cache(&programCache);
+  bool parallelCompile = enable_parallel_shader_compile((GLADloadproc)glfwGetProcAddress);
+  double shaderLoadStart = glfwGetTime();
+
+  // One build per entry of SHADERS, then the shadow program.
+  std::vector<program_build_t> programBuilds(NUM_SHADERS + 1);
   for(int i = 0; i < NUM_SHADERS; i++){
-    unsigned int vertexShader, fragShader, shaderProgram;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    char *vertShaderCode = read_shader_from_file(SHADERS[i].vertPath);
-    glShaderSource(vertexShader, 1, (const char *const *)&vertShaderCode, NULL);
-    glCompileShader(vertexShader);
-
-    check_shader_compiling(vertexShader);
-
-    fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-    char *fragShaderCode = read_shader_from_file(SHADERS[i].fragPath);
-    glShaderSource(fragShader, 1, (const char *const *)&fragShaderCode, NULL);
-    glCompileShader(fragShader);
-
-    check_shader_compiling(fragShader);
-
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragShader);
-    glLinkProgram(shaderProgram);
-
-    check_shader_linking(shaderProgram);
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragShader);
-
-    SHADERS[i].program = shaderProgram;
+    char *vertShaderCode = read_shader_with_prelude(SHADERS[i].vertPath, vertexPrelude.c_str());
+    char *fragShaderCode = read_shader_with_prelude(SHADERS[i].fragPath, fragmentPrelude.c_str());
+    const char *sources[] = {vertShaderCode, fragShaderCode};
+    const unsigned int stages[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    submit_program(&programBuilds[i], &programCache, SHADERS[i].fragPath, sources, stages, 2);
+    // The GL copied the sources.
+    free(vertShaderCode);
+    free(fragShaderCode);
     SHADER_NAMES[i] = SHADERS[i].name;
   }
 
   ////////////////////////////
   // Shadow mapping shaders //
   ////////////////////////////
-  
-  unsigned int shadowMapShader;
-  unsigned int vertexShader, geomShader, fragShader;
-  
-  // SHADOW MAPPING: Shadow depth vertex shader
-  vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  char *shadowVertShaderCode = read_shader_from_file("shaders/depth_shader.vert");
-  glShaderSource(vertexShader, 1, (const char *const *)&shadowVertShaderCode, NULL);
-  glCompileShader(vertexShader);
-  // Check for compilation errors
-  int success;
-  char infoLog[512];
-  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-  if(!success) {
-    glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n%s\n", infoLog);
-  }
-  
-  // SHADOW MAPPING: Shadow depth geometry shader
-  geomShader = glCreateShader(GL_GEOMETRY_SHADER);
+
+  // SHADOW MAPPING: Shadow depth vertex, geometry and fragment shader
+  unsigned int shadowMapShader = 0;
+  char *shadowVertShaderCode = read_shader_with_prelude("shaders/depth_shader.vert", vertexPrelude.c_str());
   char *shadowGeomShaderCode = read_shader_from_file("shaders/depth_shader.geom");
-  glShaderSource(geomShader, 1, (const char *const *)&shadowGeomShaderCode, NULL);
-  glCompileShader(geomShader);
-  // Check for compilation errors
-  glGetShaderiv(geomShader, GL_COMPILE_STATUS, &success);
-  if(!success) {
-    glGetShaderInfoLog(geomShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n%s\n", infoLog);
-  }
-  
-  // SHADOW MAPPING: Shadow depth fragment shader
-  fragShader = glCreateShader(GL_FRAGMENT_SHADER);
   char *shadowFragShaderCode = read_shader_from_file("shaders/depth_shader.frag");
-  glShaderSource(fragShader, 1, (const char *const *)&shadowFragShaderCode, NULL);
-  glCompileShader(fragShader);
-  // Check for compilation errors
-  glGetShaderiv(fragShader, GL_COMPILE_STATUS, &success);
-  if(!success) {
-    glGetShaderInfoLog(fragShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n%s\n", infoLog);
+  const char *shadowSources[] = {shadowVertShaderCode, shadowGeomShaderCode, shadowFragShaderCode};
+  const unsigned int shadowStages[] = {GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER};
+  submit_program(&programBuilds[NUM_SHADERS], &programCache, "shaders/depth_shader.frag", shadowSources, shadowStages, 3);
+  free(shadowVertShaderCode);
+  free(shadowGeomShaderCode);
+  free(shadowFragShaderCode);
+  double shaderSubmitTime = glfwGetTime() - shaderLoadStart;
+
+  // Sets up the programs that finished since the last call. A selectable program that fails ends the program like
+  // before, a failed shadow program leaves shadows off. Returns how many programs are still compiling.
+  auto update_programs = [&]() {
+    unsigned int compiling = 0;
+    for (size_t i = 0; i < programBuilds.size(); i++) {
+      unsigned int &program = i < NUM_SHADERS ? SHADERS[i].program : shadowMapShader;
+      if (program != 0 || programBuilds[i].status == PROGRAM_FAILED) {
+        continue;
+      }
+      int status = poll_program(&programBuilds[i], &programCache, parallelCompile);
+      if (status == PROGRAM_COMPILING) {
+        compiling++;
+        continue;
+      }
+      if (status == PROGRAM_FAILED) {
+        if (i < NUM_SHADERS) {
+          throw std::runtime_error(std::string("Shader program ") + SHADERS[i].name + " failed to build");
+        }
+        continue;
+      }
+      // Block bindings are not part of a cached binary, so they are set either way.
+      bind_material_block(programBuilds[i].program);
+      bind_material_maps_block(programBuilds[i].program);
+      if (i < NUM_SHADERS) {
+        bind_point_light_block(programBuilds[i].program);
+      }
+      program = programBuilds[i].program;
+    }
+    return compiling;
+  };
+
+  // Cold starts compile every program, warm ones load them all from the cache.
+  auto report_shader_startup = [&]() {
+    unsigned int cachedPrograms = 0;
+    for (const program_build_t &build : programBuilds) {
+      cachedPrograms += build.cached;
+    }
+    unsigned int programCount = programBuilds.size();
+    printf("%s shader startup: %.2f ms until all %u programs were ready (%.2f ms to submit), %u from the program "
+           "cache\n",
+           cachedPrograms == programCount ? "Warm" : cachedPrograms == 0 ? "Cold" : "Partly cached",
+           (glfwGetTime() - shaderLoadStart) * 1000.0, programCount, shaderSubmitTime * 1000.0, cachedPrograms);
+  };
+
+  // The first frame needs at least one program to draw the scene with, the rest may follow later.
+  unsigned int programsCompiling = update_programs();
+  while (programsCompiling > 0 && std::none_of(SHADERS, SHADERS + NUM_SHADERS,
+                                               [](const ShaderDeclaration &shader) { return shader.program != 0; })) {
+    programsCompiling = update_programs();
   }
-  
-  // SHADOW MAPPING: Link shadow mapping shader program
-  shadowMapShader = glCreateProgram();
-  glAttachShader(shadowMapShader, vertexShader);
-  glAttachShader(shadowMapShader, geomShader);
-  glAttachShader(shadowMapShader, fragShader);
-  glLinkProgram(shadowMapShader);
-  // Check for linking errors
-  glGetProgramiv(shadowMapShader, GL_LINK_STATUS, &success);
-  if(!success) {
-    glGetProgramInfoLog(shadowMapShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+  if (programsCompiling == 0) {
+    report_shader_startup();
   }
-  
-  glDeleteShader(vertexShader);
-  glDeleteShader(geomShader);
-  glDeleteShader(fragShader);
 
 
   ///////////////////////////////////////
@@ -493,124 +456,63 @@ int main() {
 
   glGenVertexArrays(1, &VAO);
 
-  // Generate 7 VBOs and create references to them.
+  // Generate 7 VBOs, ordered like the model's streams.
   glGenBuffers(7, vertexBuffers);
-  unsigned int &EBO = vertexBuffers[0];
-  unsigned int &positions = vertexBuffers[1];
-  unsigned int &albedo = vertexBuffers[2];
-  unsigned int &normals = vertexBuffers[3];
-  unsigned int &uvs = vertexBuffers[4];
-  unsigned int &tangents = vertexBuffers[5];
-  unsigned int &bitangents = vertexBuffers[6];
 
+  // While streaming the model is still empty, so this only sets up the attributes.
   glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-               sizeof(unsigned int) * cornellBox.indexOffset,
-               cornellBox.indices, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ARRAY_BUFFER, positions);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * cornellBox.vertexOffset,
-               cornellBox.vertices, GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-
-  glBindBuffer(GL_ARRAY_BUFFER, albedo);
-  glBufferData(GL_ARRAY_BUFFER,
-               sizeof(aiColor4D) * cornellBox.vertexOffset,
-               cornellBox.albedo, GL_STATIC_DRAW);
-  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(aiColor4D),
-                        (void *)0);
-  glEnableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, normals);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(aiVector3D) * cornellBox.vertexOffset,
-              cornellBox.normals, GL_STATIC_DRAW);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
-  glEnableVertexAttribArray(2);
-
-  glBindBuffer(GL_ARRAY_BUFFER, uvs);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(aiVector2D) * cornellBox.vertexOffset,
-              cornellBox.uvs, GL_STATIC_DRAW);
-  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(aiVector2D), (void *)0);
-  glEnableVertexAttribArray(3);
-
-  glBindBuffer(GL_ARRAY_BUFFER, tangents);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(aiVector3D) * cornellBox.vertexOffset,
-               cornellBox.tangents, GL_STATIC_DRAW);
-  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
-  glEnableVertexAttribArray(4);
-
-  glBindBuffer(GL_ARRAY_BUFFER, bitangents);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(aiVector3D) * cornellBox.vertexOffset,
-               cornellBox.bitangents, GL_STATIC_DRAW);
-  glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
-  glEnableVertexAttribArray(5);
-
-  ////////////////////////////
-  // Setup diffuse texture  //
-  ////////////////////////////
-
-  glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-  int width, height, nrComponents;
-  unsigned char *textureData = stbi_load(cornellBox.diffuseMapPath.c_str(),&width, &height, &nrComponents, 0);
-  if(textureData == NULL){
-    std::cout << "Current working dir: " << std::filesystem::current_path() << std::endl;
-    std::cout << stbi_failure_reason() << std::endl;
-    throw std::runtime_error("Failed to load diffuse map.");
+  size_t indexBytes = upload_model_buffers(vertexBuffers, &sceneModel, &drawRanges);
+  if (!streamLoad) {
+    assign_index_spans(&assets, drawRanges, indexBytes);
   }
-  else{
-    std::cout << "Found texture, now generate in GL." << std::endl;
-    GLenum format;
-    if(nrComponents == 3)
-      format = GL_RGB;
-    else if(nrComponents == 4)
-      format = GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, textureData);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // Setup sampling. I.e. wrapping and filtering.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  }
-  free(textureData);
-
-  //////////////////////////
-  // Setup normal texture //
-  //////////////////////////
 
-  glBindTexture(GL_TEXTURE_2D, normalMap);
-
-  textureData = stbi_load(cornellBox.normalMapPath.c_str(), &width, &height, &nrComponents, 0);
-  if(textureData == NULL){
-    std::cout << "Current working dir: " << std::filesystem::current_path() << std::endl;
-    std::cout << stbi_failure_reason() << std::endl;
-    throw std::runtime_error("Failed to load normal map.");
-  }
-  else{
-    std::cout << "Found texture, now generate in GL." << std::endl;
-    GLenum format;
-    if(nrComponents == 3)
-      format = GL_RGB;
-    else if(nrComponents == 4)
-      format = GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, textureData);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Colours are looked up per material, the vertices only carry the material's index.
+  unsigned int materialBuffer;
+  glGenBuffers(1, &materialBuffer);
+  upload_materials(materialBuffer, sceneModel.materials);
+
+  unsigned int pointLightBuffer;
+  glGenBuffers(1, &pointLightBuffer);
+  upload_point_lights(pointLightBuffer, pointLights);
+  int pointLightCount = pointLights.size() < MAX_POINT_LIGHTS ? pointLights.size() : MAX_POINT_LIGHTS;
+
+  if (stress.boxes > 0) {
+    size_t streamSizes[MODEL_STREAM_COUNT];
+    gpu_stream_sizes(&sceneModel, streamSizes);
+    size_t bufferBytes = indexBytes;
+    for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+      bufferBytes += streamSizes[stream];
+    }
+    printf("Stress scene buffers: %zu bytes\n", bufferBytes);
   }
 
-  free(textureData);
+  // The GPU now owns the geometry, so drop the CPU copy.
+  free_model(sceneModel);
+
+  //////////////////////////////////
+  // Setup diffuse & normal maps  //
+  //////////////////////////////////
+
+  // Every material starts out with placeholders, its maps are decoded in the background and swapped in as they arrive.
+  // While streaming the paths are still unknown, they are queued once the stream loader is done.
+  texture_loader_t textureLoader = {};
+  start_texture_loader(&textureLoader);
+  material_textures_t materialTextures = {};
+  create_material_textures(&materialTextures);
+  double textureLoadStart = glfwGetTime();
+  set_material_maps(&materialTextures, &textureLoader, 0, sceneModel.diffuseMapPaths, sceneModel.normalMapPaths);
+  bool texturesReported = false;
+
+  // Re-exported assets and textures are reloaded while the scene keeps rendering.
+  asset_watcher_t watcher = {-1};
+  if (streamLoad) {
+    printf("Hot reloading is off while streaming\n");
+  } else if (stress.boxes == 0) {
+    start_asset_watcher(&watcher, assets, material_map_paths(&materialTextures));
+  }
 
   unsigned int VAO_stencil, VBO_stencil;
-  create_reflective_surface_stencil(&VAO_stencil, &VBO_stencil);
+  create_reflective_surface_stencil(mirrors, &VAO_stencil, &VBO_stencil);
 
   ////////////////////////////////////////
   // Shadow mapping Cube map generation //
@@ -674,14 +576,48 @@ int main() {
 
   bool enable_reflection = 0;
   bool enable_shadows = 1;
+  bool enable_culling = 1;
+  bool enable_lods = 1;
 
   float xPos = 3.0f;
   float yPos = 3.0f;
   float zPos = -8.0f;
 
+  // Stress scenes log their average frame time every few seconds, so runs of different sizes can be compared.
+  double frameReportStart = glfwGetTime();
+  unsigned int frameReportFrames = 0;
+
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
 
+    // Upload whatever the background loader extracted since the last frame.
+    if (streamLoad && !loader.finished &&
+        stream_loader_update(&loader, vertexBuffers, materialBuffer, STREAM_UPLOAD_BUDGET)) {
+      set_material_maps(&materialTextures, &textureLoader, 0, loader.model.diffuseMapPaths, loader.model.normalMapPaths);
+    }
+
+    // Swap in the maps decoded since the last frame.
+    if (update_material_textures(&materialTextures, &textureLoader, TEXTURE_UPLOAD_BUDGET) == 0 && !texturesReported) {
+      printf("Textures ready after %.2f ms\n", (glfwGetTime() - textureLoadStart) * 1000.0);
+      texturesReported = true;
+    }
+    // Finer mip levels for the maps the last frame needed them for.
+    stream_material_levels(&materialTextures, &textureLoader, TEXTURE_UPLOAD_BUDGET, textureBudget);
+
+    std::vector<std::string> changedFiles;
+    poll_asset_watcher(&watcher, &changedFiles);
+    if (!changedFiles.empty()) {
+      double reloadStart = glfwGetTime();
+      glBindVertexArray(VAO);
+      reload_changed_assets(changedFiles, &assets, &sceneModel, &drawRanges, &loadOptions, vertexBuffers, materialBuffer,
+                            &materialTextures, &textureLoader);
+      printf("Reloaded changed files in %.2f ms\n", (glfwGetTime() - reloadStart) * 1000.0);
+    }
+
+    // Culling and detail level results of this frame, shown in the UI.
+    cull_stats_t cameraCullStats = {};
+    cull_stats_t shadowCullStats = {};
+
     struct timespec time;
     clock_gettime(CLOCK_MONOTONIC, &time);
     double currentTime = time.tv_sec + time.tv_nsec / 1000000000.0f;
@@ -711,11 +647,22 @@ int main() {
     glm_perspective(glm_rad(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f,
                     100.0f, projection);
 
-    unsigned int &shaderProgram = SHADERS[selected_shader].program;
-
+    // Programs still compiling join once they are ready. Until the selected one is, the scene is drawn with the
+    // first that is, and shadows wait for their program.
+    if (programsCompiling > 0) {
+      programsCompiling = update_programs();
+      if (programsCompiling == 0) {
+        report_shader_startup();
+      }
+    }
+    unsigned int shaderProgram = SHADERS[selected_shader].program;
+    for (int i = 0; shaderProgram == 0 && i < NUM_SHADERS; i++) {
+      shaderProgram = SHADERS[i].program;
+    }
+    bool shadowsReady = enable_shadows && shadowMapShader != 0;
 
     // SHADOW MAPPING: Conditional shadow pass - only render to shadow map if shadows are enabled
-    if (enable_shadows) {
+    if (shadowsReady) {
       // render to depth cubemap
       // ------------------------------
       // Configure view port to the size of the point shadow texture
@@ -792,7 +739,29 @@ int main() {
       glUniform1f(farPlaneLoc, far_plane);
 
       glBindVertexArray(VAO);
-      glDrawElements(GL_TRIANGLES, cornellBox.indexOffset, GL_UNSIGNED_INT, 0);
+      unsigned int shadowFaceLoc = glGetUniformLocation(shadowMapShader, "shadowFace");
+      // Every face has a 90 degree field of view.
+      float shadowLodScale = enable_lods ? SHADOW_HEIGHT / 2.0f : 0.0f;
+      if (enable_culling) {
+        // One pass per cubemap face, each with only the ranges inside that face's frustum.
+        for (int face = 0; face < 6; face++) {
+          cull_view_t faceView;
+          make_cull_view(&faceView, shadowMatrices[face], lightPos);
+          faceView.lodScale = shadowLodScale;
+          faceView.lodPixelError = LOD_SHADOW_PIXEL_ERROR;
+          glUniform1i(shadowFaceLoc, face);
+          draw_scene(shadowMapShader, assets, sceneMeshes, sceneRanges, &faceView, &shadowCullStats);
+        }
+      } else {
+        // Levels only depend on the light's position, so any face will do.
+        cull_view_t lightView;
+        make_cull_view(&lightView, shadowMatrices[0], lightPos);
+        lightView.cull = false;
+        lightView.lodScale = shadowLodScale;
+        lightView.lodPixelError = LOD_SHADOW_PIXEL_ERROR;
+        glUniform1i(shadowFaceLoc, -1);
+        draw_scene(shadowMapShader, assets, sceneMeshes, sceneRanges, &lightView, &shadowCullStats);
+      }
       glBindFramebuffer(GL_FRAMEBUFFER, 0);
       // Reset viewport to screen dimensions
       glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
@@ -824,9 +793,10 @@ int main() {
     glUniform1f(lightCutoffAngleLoc, lightCutoffAngle);
     unsigned int lightOuterCutoffAngleLoc = glGetUniformLocation(shaderProgram, "lightOuterCutoffAngle");
     glUniform1f(lightOuterCutoffAngleLoc, lightOuterCutoffAngle);
+    glUniform1i(glGetUniformLocation(shaderProgram, "pointLightCount"), pointLightCount);
 
     // SHADOW MAPPING: Set shadow-related uniforms conditionally
-    if (enable_shadows) {
+    if (shadowsReady) {
       unsigned int farPlaneLoc = glGetUniformLocation(shaderProgram, "far_plane");
       glUniform1f(farPlaneLoc, far_plane);
       unsigned int shadowBiasLoc = glGetUniformLocation(shaderProgram, "shadowBias");
@@ -849,25 +819,36 @@ int main() {
     glBindVertexArray(VAO);
 
     // Due to GLSL version 330, have to set uniform bind slots here.
-    glUniform1i(glGetUniformLocation(shaderProgram, "diffuseMap"), 0);
-    glUniform1i(glGetUniformLocation(shaderProgram, "normalMap"), 1);
-    if (enable_shadows) {
+    set_material_texture_units(shaderProgram);
+    if (shadowsReady) {
       glUniform1i(glGetUniformLocation(shaderProgram, "shadowMap"), 2);
     }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
+    // Every material's diffuse and normal maps, bound once for all draws.
+    bind_material_textures(&materialTextures);
 
     // set shadow cubemap texture
-    if (enable_shadows) {
+    if (shadowsReady) {
       glActiveTexture(GL_TEXTURE2);
       glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubeMap);
     }
 
-    glDrawElements(GL_TRIANGLES, cornellBox.indexOffset, GL_UNSIGNED_INT, 0);
+    mat4 viewProjection;
+    glm_mat4_mul(projection, view, viewProjection);
+    // Pixels per world unit at distance one, for the 45 degree field of view.
+    float cameraPixelScale = SCR_HEIGHT / (2.0f * tanf(glm_rad(22.5f)));
+    float cameraLodScale = enable_lods ? cameraPixelScale : 0.0f;
+    cull_view_t cameraView;
+    make_cull_view(&cameraView, viewProjection, eye);
+    cameraView.cull = enable_culling;
+    cameraView.lodScale = cameraLodScale;
+    cameraView.lodPixelError = LOD_PIXEL_ERROR;
+    draw_scene(shaderProgram, assets, sceneMeshes, sceneRanges, &cameraView, &cameraCullStats);
+    // While a scene streams in, its worker still writes the mesh list, and its maps are only set once it finished.
+    bool requestLevels = !streamLoad || loader.finished;
+    if (requestLevels) {
+      request_scene_levels(&materialTextures, assets, sceneMeshes, &cameraView, cameraPixelScale);
+    }
 
 
 
@@ -875,71 +856,94 @@ int main() {
     // Reflection Pass, if enabled //
     /////////////////////////////////
 
-    if (enable_reflection) {
-      // Step 1: Mark stencil buffer where mirror surface is visible
-      glStencilFunc(GL_ALWAYS, 1, 0xFF);      
+    if (enable_reflection && !mirrors.empty()) {
+      // Step 1: Mark stencil buffer where each mirror surface is visible, mirror i with the value i + 1
       glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE); 
       glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); 
 
-      // Draw mirror quad (writes to stencil only)
+      // Draw mirror quads (writes to stencil only), they are in world space already
+      reset_mesh_uniforms(shaderProgram);
+      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
       glBindVertexArray(VAO_stencil);
-      glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);   
+      for (unsigned int m = 0; m < mirrors.size(); m++) {
+        glStencilFunc(GL_ALWAYS, m + 1, 0xFF);      
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(m * 6 * sizeof(unsigned int)));   
+      }
 
       // Restore write masks
       glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);   
 
-      // Compute reflected view and light
-      vec3 reflected_eye, reflected_dir, reflected_up;
-      mat4 reflected_view;
-
-      reflect_point_across_plane(reflected_eye, eye, mirror_plane.point, mirror_plane.normal);
-      reflect_direction_across_plane(reflected_dir, dir, mirror_plane.normal);
-      reflect_direction_across_plane(reflected_up, up, mirror_plane.normal);
-      
-
-      // VERSION 1. FLIP
-      glm_look(reflected_eye, reflected_dir, reflected_up, reflected_view);
-
-      mat4 flip_matrix;
-      glm_mat4_identity(flip_matrix);
-      flip_matrix[0][0] = -1.0f;
-      glm_mat4_mul(flip_matrix, reflected_view, reflected_view);
-
-      vec3 reflected_light_pos;
-      reflect_point_across_plane(reflected_light_pos, lightPos, mirror_plane.point, mirror_plane.normal);
-
       // Set up clip plane
       glEnable(GL_CLIP_DISTANCE0);
       glUniform1i(useClippingLoc, 1);
 
-      // Clipping plane must be 4d vector [a, b, c, d] such that (ax + by + cz + d = 0)
-      vec4 world_clip_plane;
-      world_clip_plane[0] = mirror_plane.normal[0];  
-      world_clip_plane[1] = mirror_plane.normal[1];  
-      world_clip_plane[2] = mirror_plane.normal[2];  
-      world_clip_plane[3] = -(mirror_plane.normal[0] * mirror_plane.point[0] + 
-                              mirror_plane.normal[1] * mirror_plane.point[1] + 
-                              mirror_plane.normal[2] * mirror_plane.point[2]);
-
-      unsigned int world_clip_plane_loc = glGetUniformLocation(shaderProgram, "clipPlane");
-      glUniform4fv(world_clip_plane_loc, 1, world_clip_plane);
-
-      // Set reflection uniforms
-      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &reflected_view[0][0]);
-      glUniform3fv(viewPosLoc, 1, reflected_eye);
-      // glUniform3fv(lightPosLoc, 1, reflected_light_pos);
-
       // Adjust face culling for mirrored geometry
       glFrontFace(GL_CW);
       glEnable(GL_CULL_FACE);
-
-      // Draw reflected scene inside stencil
-      glClear(GL_DEPTH_BUFFER_BIT);
-      glStencilFunc(GL_EQUAL, 1, 0xFF);
       glStencilMask(0x00);
 
-      glBindVertexArray(VAO);
-      glDrawElements(GL_TRIANGLES, cornellBox.indexOffset, GL_UNSIGNED_INT, 0);
+      // Step 2: Draw the scene as seen in each mirror, inside that mirror's stencil
+      for (unsigned int m = 0; m < mirrors.size(); m++) {
+        vec3 mirror_point, mirror_normal;
+        glm_vec3_copy((float *)mirrors[m].point, mirror_point);
+        glm_vec3_copy((float *)mirrors[m].normal, mirror_normal);
+
+        // Compute reflected view and light
+        vec3 reflected_eye, reflected_dir, reflected_up;
+        mat4 reflected_view;
+
+        reflect_point_across_plane(reflected_eye, eye, mirror_point, mirror_normal);
+        reflect_direction_across_plane(reflected_dir, dir, mirror_normal);
+        reflect_direction_across_plane(reflected_up, up, mirror_normal);
+        
+
+        // VERSION 1. FLIP
+        glm_look(reflected_eye, reflected_dir, reflected_up, reflected_view);
+
+        mat4 flip_matrix;
+        glm_mat4_identity(flip_matrix);
+        flip_matrix[0][0] = -1.0f;
+        glm_mat4_mul(flip_matrix, reflected_view, reflected_view);
+
+        vec3 reflected_light_pos;
+        reflect_point_across_plane(reflected_light_pos, lightPos, mirror_point, mirror_normal);
+
+        // Clipping plane must be 4d vector [a, b, c, d] such that (ax + by + cz + d = 0)
+        vec4 world_clip_plane;
+        world_clip_plane[0] = mirror_normal[0];  
+        world_clip_plane[1] = mirror_normal[1];  
+        world_clip_plane[2] = mirror_normal[2];  
+        world_clip_plane[3] = -(mirror_normal[0] * mirror_point[0] + 
+                                mirror_normal[1] * mirror_point[1] + 
+                                mirror_normal[2] * mirror_point[2]);
+
+        unsigned int world_clip_plane_loc = glGetUniformLocation(shaderProgram, "clipPlane");
+        glUniform4fv(world_clip_plane_loc, 1, world_clip_plane);
+
+        // Set reflection uniforms
+        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &reflected_view[0][0]);
+        glUniform3fv(viewPosLoc, 1, reflected_eye);
+        // glUniform3fv(lightPosLoc, 1, reflected_light_pos);
+
+        // Draw reflected scene inside stencil
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glStencilFunc(GL_EQUAL, m + 1, 0xFF);
+
+        // The mirrored image is the scene seen from the reflected eye.
+        mat4 reflectedViewProjection;
+        glm_mat4_mul(projection, reflected_view, reflectedViewProjection);
+        cull_view_t reflectedView;
+        make_cull_view(&reflectedView, reflectedViewProjection, reflected_eye);
+        reflectedView.cull = enable_culling;
+        reflectedView.lodScale = cameraLodScale;
+        reflectedView.lodPixelError = LOD_PIXEL_ERROR;
+
+        glBindVertexArray(VAO);
+        draw_scene(shaderProgram, assets, sceneMeshes, sceneRanges, &reflectedView, &cameraCullStats);
+        if (requestLevels) {
+          request_scene_levels(&materialTextures, assets, sceneMeshes, &reflectedView, cameraPixelScale);
+        }
+      }
 
       // Restore OpenGL state
       glDisable(GL_CLIP_DISTANCE0);
@@ -959,12 +963,31 @@ int main() {
 
     ImGui::Begin("Demo window");
     ImGui::Combo("Select a shader!", &selected_shader, SHADER_NAMES, IM_ARRAYSIZE(SHADER_NAMES));
+    ImGui::Text("Frame time: %.2f ms", 1000.0f / io.Framerate);
     ImGui::SliderFloat("Light Position", &lightPos[1], 0.0f, 10.0f);
     ImGui::SliderFloat("X Position", &xPos, 0.0f, 5.0f);
     ImGui::SliderFloat("Y Position", &yPos, 0.0f, 5.0f);
     ImGui::SliderFloat("Z Position", &zPos, -8.0f, 5.0f);
     ImGui::Checkbox("Enable Reflection", &enable_reflection);
     ImGui::Checkbox("Enable Shadows", &enable_shadows);
+    ImGui::Checkbox("Enable Culling", &enable_culling);
+    if (enable_culling) {
+      ImGui::Text("Draw ranges: %zu/%zu camera, %zu/%zu shadow", cameraCullStats.drawn, cameraCullStats.tested,
+                  shadowCullStats.drawn, shadowCullStats.tested);
+    }
+    ImGui::Checkbox("Enable LODs", &enable_lods);
+    if (enable_lods) {
+      ImGui::Text("Camera meshes per level: %zu / %zu / %zu / %zu", cameraCullStats.levels[0], cameraCullStats.levels[1],
+                  cameraCullStats.levels[2], cameraCullStats.levels[3]);
+    }
+    ImGui::Text("Texture memory: %.1f / %.1f MB", materialTextures.residentBytes / (1024.0 * 1024.0),
+                textureBudget / (1024.0 * 1024.0));
+    if (programsCompiling > 0) {
+      ImGui::Text("Compiling shaders: %u left", programsCompiling);
+    }
+    if (streamLoad && !loader.finished) {
+      ImGui::ProgressBar(stream_loader_progress(&loader), ImVec2(-1, 0), "Loading scene");
+    }
     if (enable_shadows) {
       ImGui::SliderFloat("Shadow Bias", &shadowBias, 0.0f, 0.3f);
     }
@@ -974,14 +997,30 @@ int main() {
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
     glfwSwapBuffers(window);
+
+    frameReportFrames++;
+    double frameReportTime = glfwGetTime() - frameReportStart;
+    if (stress.boxes > 0 && frameReportTime >= STRESS_REPORT_SECONDS) {
+      printf("Frame time: %.3f ms (average of %u frames)\n", frameReportTime * 1000.0 / frameReportFrames,
+             frameReportFrames);
+      frameReportStart += frameReportTime;
+      frameReportFrames = 0;
+    }
   }
 
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
 
+  stop_asset_watcher(&watcher);
+  stop_texture_loader(&textureLoader);
+
+  // The window may be closed before the loader is done.
+  if (loader.worker.joinable()) {
+    loader.worker.join();
+  }
+
   glfwTerminate();
-  free_model(cornellBox);
 
   return 0;
 }
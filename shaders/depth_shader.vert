@@ -1,8 +1,8 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// Attributes come from vertex_format.glsl
 
 uniform mat4 model;
 
 void main() {
-    gl_Position = model * vec4(aPos, 1.0);
+    gl_Position = model * vec4(vertexPosition(), 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 vPos;
-layout (location = 1) in vec4 vAlbedo;
+// Attributes come from vertex_format.glsl
 
 out vec4 albedo;
 out vec3 FragPos;
@@ -11,7 +10,8 @@ uniform mat4 projection;
 
 void main()
 {
-    albedo = vAlbedo;
+    vec3 vPos = vertexPosition();
+    albedo = vertexAlbedo();
 
     FragPos = vec3(model * vec4(vPos, 1.0));
 
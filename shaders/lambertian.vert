@@ -1,7 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 vPos;
-layout (location = 1) in vec4 vAlbedo;
-layout (location = 2) in vec3 aNormal;
+// Attributes come from vertex_format.glsl
 
 out vec4 albedo;
 out vec3 FragPos;
@@ -16,7 +14,9 @@ uniform bool useClipping;
 
 void main()
 {
-    albedo = vAlbedo;
+    vec3 vPos = vertexPosition();
+    vec3 aNormal = vertexNormal();
+    albedo = vertexAlbedo();
 
     FragPos = vec3(model * vec4(vPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
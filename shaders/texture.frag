@@ -5,21 +5,51 @@ in vec3 Normal;
 in vec3 FragPos;
 in vec2 Uv;
 in mat3 TBN;
+flat in ivec4 MaterialLayers; // xy: group and layer of the diffuse map, zw: of the normal map
 
 uniform vec3 lightPos; 
 uniform vec3 viewPos; 
 uniform vec3 lightColor;
 
-uniform sampler2D diffuseMap;
-uniform sampler2D normalMap;
+// Every material's maps, in array textures grouped by size and format, see include/material_textures.h.
+// MAX_TEXTURE_GROUPS is inserted by main.cpp.
+uniform sampler2DArray textureGroups[MAX_TEXTURE_GROUPS];
 
 uniform bool enable_shadows;
 uniform float far_plane;
 uniform samplerCube shadowMap;
 uniform float shadowBias;
 
+// Unshadowed point lights on top of the one at lightPos, see include/point_light.h.
+// MAX_POINT_LIGHTS is inserted by main.cpp.
+struct PointLight {
+    vec4 position; // w: distance at which the light has faded out
+    vec4 color;
+};
+layout (std140) uniform PointLights {
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
+uniform int pointLightCount;
+
 out vec4 FragColor;
 
+// GLSL 330 only indexes sampler arrays with constants, hence a case per group.
+// The group can change within a quad, so the uv derivatives are taken up front, outside of the branches.
+vec4 sampleGroup(int group, int layer, vec2 uvDx, vec2 uvDy) {
+    vec3 uvLayer = vec3(Uv, layer);
+    switch(group){
+        case 0: return textureGrad(textureGroups[0], uvLayer, uvDx, uvDy);
+        case 1: return textureGrad(textureGroups[1], uvLayer, uvDx, uvDy);
+        case 2: return textureGrad(textureGroups[2], uvLayer, uvDx, uvDy);
+        case 3: return textureGrad(textureGroups[3], uvLayer, uvDx, uvDy);
+        case 4: return textureGrad(textureGroups[4], uvLayer, uvDx, uvDy);
+        case 5: return textureGrad(textureGroups[5], uvLayer, uvDx, uvDy);
+        case 6: return textureGrad(textureGroups[6], uvLayer, uvDx, uvDy);
+        case 7: return textureGrad(textureGroups[7], uvLayer, uvDx, uvDy);
+    }
+    return vec4(1.0);
+}
+
 // Function to calculate shadow factor from cubemap
 float ShadowCalculation(vec3 fragPos) {
     // Get vector between fragment position and light position
@@ -42,14 +72,14 @@ float ShadowCalculation(vec3 fragPos) {
 
 void main()
 {
-    // Normal mapping, if applicable
-    vec3 text = vec3(1.0, 1.0, 1.0);
-    vec3 normal = Normal;
-    if(Uv.x != -1.0 || Uv.y != -1.0){
-        text = texture(diffuseMap, Uv).rgb;
-        vec3 modelNormal = texture(normalMap, Uv).rgb * 2.0 - 1.0;
-        normal = TBN * modelNormal;
-    }
+    // Normal mapping. Materials without maps sample a white diffuse and a flat normal placeholder.
+    vec2 uvDx = dFdx(Uv);
+    vec2 uvDy = dFdy(Uv);
+    vec3 text = sampleGroup(MaterialLayers.x, MaterialLayers.y, uvDx, uvDy).rgb;
+    // Normal maps may be BC5 compressed, which only keeps x and y. z is always positive in tangent space.
+    vec2 normalXY = sampleGroup(MaterialLayers.z, MaterialLayers.w, uvDx, uvDy).rg * 2.0 - 1.0;
+    vec3 modelNormal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+    vec3 normal = TBN * modelNormal;
 
     // Calculate shadow
     float shadow = 0;
@@ -74,6 +104,22 @@ void main()
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(norm, halfwayDir), 0.0), 16);
     vec3 specular = specularStrength * spec * lightColor;
-    vec3 result = text * (ambient + (diffuse + specular) * (1.0 - shadow)) * albedo.rgb;
+
+    // The other point lights, fading out quadratically towards their radius
+    vec3 pointLighting = vec3(0.0);
+    for(int i = 0; i < pointLightCount; i++){
+        vec3 toLight = pointLights[i].position.xyz - FragPos;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / pointLights[i].position.w, 0.0, 1.0);
+        if(falloff == 0.0){
+            continue;
+        }
+        vec3 pointDir = toLight / distance;
+        float pointDiff = max(dot(norm, pointDir), 0.0);
+        float pointSpec = pow(max(dot(norm, normalize(pointDir + viewDir)), 0.0), 16);
+        pointLighting += (pointDiff + specularStrength * pointSpec) * falloff * falloff * pointLights[i].color.rgb;
+    }
+
+    vec3 result = text * (ambient + (diffuse + specular) * (1.0 - shadow) + pointLighting) * albedo.rgb;
     FragColor = vec4(result, 1.0);
 }
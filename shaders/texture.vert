@@ -1,16 +1,12 @@
 #version 330 core
-layout (location = 0) in vec3 vPos;
-layout (location = 1) in vec4 vAlbedo;
-layout (location = 2) in vec3 aNormal;
-layout (location = 3) in vec2 vUv;
-layout (location = 4) in vec3 vTangent;
-layout (location = 5) in vec3 vBitangent;
+// Attributes come from vertex_format.glsl
 
 out vec4 albedo;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 Uv;
 out mat3 TBN;
+flat out ivec4 MaterialLayers;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -22,18 +18,22 @@ uniform bool useClipping;
 
 void main()
 {
-    albedo = vAlbedo;
+    vec3 vPos = vertexPosition();
+    vec3 aNormal = vertexNormal();
+    albedo = vertexAlbedo();
+    MaterialLayers = vertexMaterialMaps();
 
     FragPos = vec3(model * vec4(vPos, 1.0));
-    Normal = aNormal;
-    TBN = mat3(vTangent, vBitangent, aNormal);
+    mat3 normalMatrix = mat3(transpose(inverse(model)));
+    Normal = normalMatrix * aNormal;
+    TBN = normalMatrix * mat3(vertexTangent(), vertexBitangent(), aNormal);
 
     if (useClipping)
         gl_ClipDistance[0] = dot(model * vec4(vPos, 1.0), clipPlane);
     else
         gl_ClipDistance[0] = 1.0; // Always keep it (positive means inside)
 
-    Uv = vUv;
+    Uv = vertexUv();
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
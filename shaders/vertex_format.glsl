@@ -0,0 +1,61 @@
+// Vertex attributes shared by all vertex shaders. Inserted right after their #version line.
+// Shaders only use the vertex*() functions, so they work with either vertex format.
+
+// Diffuse colour per material, vertices only carry an index into it. MAX_MATERIALS comes from include/material.h.
+layout (std140) uniform Materials {
+    vec4 materialAlbedo[MAX_MATERIALS];
+};
+// Array texture group and layer of every material's maps, see include/material_textures.h.
+// xy: diffuse map, zw: normal map.
+layout (std140) uniform MaterialMaps {
+    ivec4 materialMaps[MAX_MATERIALS];
+};
+
+#ifdef COMPACT_VERTICES
+
+// xyz: position quantised to the mesh's bounds, w: sign of the bitangent
+layout (location = 0) in vec4 vPackedPosition;
+layout (location = 1) in uint vMaterial;
+// Octahedral encoded unit vectors
+layout (location = 2) in vec2 vPackedNormal;
+layout (location = 3) in vec2 vUv;
+layout (location = 4) in vec2 vPackedTangent;
+
+// Bounds of the mesh currently drawn
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+vec3 vertexPosition() { return positionOffset + positionScale * vPackedPosition.xyz; }
+vec4 vertexAlbedo() { return materialAlbedo[vMaterial]; }
+vec3 vertexNormal() { return octDecode(vPackedNormal); }
+vec2 vertexUv() { return vUv; }
+vec3 vertexTangent() { return octDecode(vPackedTangent); }
+vec3 vertexBitangent() { return (vPackedPosition.w * 2.0 - 1.0) * cross(vertexNormal(), vertexTangent()); }
+
+#else
+
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in uint vMaterial;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec2 vUv;
+layout (location = 4) in vec3 vTangent;
+layout (location = 5) in vec3 vBitangent;
+
+vec3 vertexPosition() { return vPos; }
+vec4 vertexAlbedo() { return materialAlbedo[vMaterial]; }
+vec3 vertexNormal() { return aNormal; }
+vec2 vertexUv() { return vUv; }
+vec3 vertexTangent() { return vTangent; }
+vec3 vertexBitangent() { return vBitangent; }
+
+#endif
+
+ivec4 vertexMaterialMaps() { return materialMaps[vMaterial]; }
@@ -0,0 +1,110 @@
+#include <asset_watcher.h>
+#include <scene_cache.h>
+#include <algorithm>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/**
+ * Absolute path without symlinks, . or .., so paths from the scene and from inotify compare equal.
+ * Returns the path unchanged if it doesn't exist.
+ */
+std::string canonical_path(const std::string &path) {
+  char resolved[PATH_MAX];
+  if (realpath(path.c_str(), resolved) == NULL) {
+    return path;
+  }
+  return resolved;
+}
+
+static std::string directory_of(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+/**
+ * Watches the directories that hold the assets' files and the textures their materials use. Exporters either rewrite a file in place
+ * or write a temporary and rename it over the old one, so both finished writes and renames are reported.
+ * Returns -1 if inotify is unavailable.
+ */
+int start_asset_watcher(asset_watcher_t *watcher, const std::vector<scene_asset_t> &assets,
+                        const std::vector<std::string> &textures) {
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd < 0) {
+    perror("inotify_init1");
+    return -1;
+  }
+
+  std::vector<std::string> files = textures;
+  for (const scene_asset_t &asset : assets) {
+    for (const std::string &file : scene_source_files(asset.path.c_str())) {
+      files.push_back(file);
+    }
+  }
+
+  for (const std::string &file : files) {
+    if (file.empty()) {
+      continue;
+    }
+    std::string directory = canonical_path(directory_of(canonical_path(file)));
+    if (std::find(watcher->directories.begin(), watcher->directories.end(), directory) != watcher->directories.end()) {
+      continue;
+    }
+    int watch = inotify_add_watch(watcher->fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) {
+      printf("Failed to watch %s for changes\n", directory.c_str());
+      continue;
+    }
+    watcher->watches.push_back(watch);
+    watcher->directories.push_back(directory);
+    printf("Watching %s for changes\n", directory.c_str());
+  }
+  return 0;
+}
+
+/**
+ * Appends the canonical path of every file written since the last poll to changed, each once.
+ */
+void poll_asset_watcher(asset_watcher_t *watcher, std::vector<std::string> *changed) {
+  if (watcher->fd < 0) {
+    return;
+  }
+
+  // Large enough for many events, and aligned for the event struct.
+  alignas(struct inotify_event) char buffer[16 * 1024];
+  while (true) {
+    ssize_t length = read(watcher->fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break; // EAGAIN once drained
+    }
+
+    for (char *cursor = buffer; cursor < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)cursor;
+      cursor += sizeof(struct inotify_event) + event->len;
+      if (event->len == 0) {
+        continue;
+      }
+
+      for (size_t w = 0; w < watcher->watches.size(); w++) {
+        if (watcher->watches[w] != event->wd) {
+          continue;
+        }
+        std::string path = watcher->directories[w] + "/" + event->name;
+        if (std::find(changed->begin(), changed->end(), path) == changed->end()) {
+          changed->push_back(path);
+        }
+      }
+    }
+  }
+}
+
+void stop_asset_watcher(asset_watcher_t *watcher) {
+  if (watcher->fd >= 0) {
+    close(watcher->fd); // drops the watches with it
+  }
+  watcher->fd = -1;
+  watcher->watches.clear();
+  watcher->directories.clear();
+}
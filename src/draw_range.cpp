@@ -0,0 +1,214 @@
+#include <draw_range.h>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Upper bound of the packed indices, for reserving the element buffer before any mesh is packed:
+ * every index at 32 bit, plus up to 3 bytes of alignment padding per run of a mesh.
+ */
+size_t max_packed_index_size(const model_t *model) {
+  return sizeof(unsigned int) * (size_t)model->indexCount + 4 * MESH_MAX_LODS * model->meshes.size();
+}
+
+// Appends count zero bytes to packed.
+static void pad(std::vector<char> *packed, size_t count) {
+  packed->insert(packed->end(), count, 0);
+}
+
+// Culling data that covers the whole mesh: its bounding sphere, and no cone.
+static void mesh_cull_bounds(const mesh_range_t &range, draw_range_t *draw) {
+  aiVector3D center = (range.boundsMin + range.boundsMax) * 0.5f;
+  draw->center[0] = center.x;
+  draw->center[1] = center.y;
+  draw->center[2] = center.z;
+  draw->radius = (range.boundsMax - center).Length();
+  draw->coneAxis[0] = draw->coneAxis[1] = draw->coneAxis[2] = 0.0f;
+  draw->coneCutoff = 1.0f;
+}
+
+static void meshlet_cull_bounds(const meshlet_t &meshlet, draw_range_t *draw) {
+  memcpy(draw->center, meshlet.center, sizeof(draw->center));
+  draw->radius = meshlet.radius;
+  memcpy(draw->coneAxis, meshlet.coneAxis, sizeof(draw->coneAxis));
+  draw->coneCutoff = meshlet.coneCutoff;
+}
+
+/**
+ * Packs one run of a mesh's indices, its full resolution triangles or one of its coarser levels,
+ * where the packed bytes will start at byteOffset. firstIndex is the absolute position of indices in the index stream.
+ * The run is cut into consecutive ranges that each span fewer than DRAW_RANGE_MAX_SPAN vertices.
+ * Those become 16 bit ranges rebased onto their lowest vertex. Usually a run is a single range,
+ * after optimize_mesh() even large meshes split into few ranges, since its vertex order follows the triangles.
+ * If the ranges would get too small, the run is kept as one 32 bit range.
+ * If meshlets are given, cuts only fall between them and every meshlet becomes a draw range of its own,
+ * so it can be culled individually.
+ */
+static void pack_index_run(const model_t *model, unsigned int mesh, unsigned int lod, const unsigned int *indices,
+                           unsigned int indexCount, unsigned int firstIndex, const meshlet_t *meshlets,
+                           unsigned int meshletCount, size_t byteOffset, std::vector<char> *packed,
+                           std::vector<draw_range_t> *ranges) {
+  const mesh_range_t &range = model->meshes[mesh];
+  size_t start = packed->size();
+
+  if (indexCount == 0) {
+    return;
+  }
+
+  // The units that must not be cut: meshlets, or else triangles. Each one ends at unitEnds[u].
+  std::vector<unsigned int> unitEnds;
+  if (meshlets) {
+    for (unsigned int m = 0; m < meshletCount; m++) {
+      unitEnds.push_back(meshlets[m].indexOffset - firstIndex + meshlets[m].indexCount);
+    }
+  } else {
+    for (unsigned int i = 3; i <= indexCount; i += 3) {
+      unitEnds.push_back(i);
+    }
+  }
+
+  // Cut wherever the vertex span would no longer fit 16 bits.
+  // A single unit that spans too far, or faces that are not triangles, leave the run at 32 bit.
+  std::vector<unsigned int> cuts; // first unit of every split range, plus the end
+  std::vector<unsigned int> bases;
+  bool fits = indexCount % 3 == 0;
+  unsigned int lowest = indices[0], highest = indices[0];
+  unsigned int unitBegin = 0;
+  cuts.push_back(0);
+  for (unsigned int u = 0; fits && u < unitEnds.size(); u++) {
+    unsigned int unitLow = indices[unitBegin], unitHigh = indices[unitBegin];
+    for (unsigned int i = unitBegin + 1; i < unitEnds[u]; i++) {
+      unitLow = indices[i] < unitLow ? indices[i] : unitLow;
+      unitHigh = indices[i] > unitHigh ? indices[i] : unitHigh;
+    }
+    unitBegin = unitEnds[u];
+    if (unitHigh - unitLow >= DRAW_RANGE_MAX_SPAN) {
+      fits = false;
+      break;
+    }
+
+    unsigned int low = unitLow < lowest ? unitLow : lowest;
+    unsigned int high = unitHigh > highest ? unitHigh : highest;
+    if (high - low >= DRAW_RANGE_MAX_SPAN) {
+      bases.push_back(lowest);
+      cuts.push_back(u);
+      low = unitLow;
+      high = unitHigh;
+    }
+    lowest = low;
+    highest = high;
+  }
+  bases.push_back(lowest);
+  cuts.push_back(unitEnds.size());
+
+  unsigned int splitCount = bases.size();
+  if (!fits || (splitCount > 1 && indexCount / splitCount < DRAW_RANGE_MIN_INDICES)) {
+    // Indices stay absolute, 32 bit.
+    pad(packed, (4 - byteOffset % 4) % 4);
+    size_t rangeStart = packed->size();
+    packed->resize(rangeStart + sizeof(unsigned int) * indexCount);
+    memcpy(packed->data() + rangeStart, indices, sizeof(unsigned int) * indexCount);
+
+    draw_range_t draw = {};
+    draw.mesh = mesh;
+    draw.indexType = GL_UNSIGNED_INT;
+    draw.byteOffset = byteOffset + rangeStart - start;
+    draw.indexCount = indexCount;
+    draw.lod = lod;
+    if (!meshlets) {
+      mesh_cull_bounds(range, &draw);
+      ranges->push_back(draw);
+    }
+    for (unsigned int m = 0; meshlets && m < meshletCount; m++) {
+      draw.byteOffset = byteOffset + rangeStart - start + sizeof(unsigned int) * (meshlets[m].indexOffset - firstIndex);
+      draw.indexCount = meshlets[m].indexCount;
+      meshlet_cull_bounds(meshlets[m], &draw);
+      ranges->push_back(draw);
+    }
+    return;
+  }
+
+  pad(packed, byteOffset % 2);
+  for (unsigned int split = 0; split < splitCount; split++) {
+    unsigned int begin = cuts[split] == 0 ? 0 : unitEnds[cuts[split] - 1];
+    unsigned int end = unitEnds[cuts[split + 1] - 1];
+    size_t rangeStart = packed->size();
+    packed->resize(rangeStart + sizeof(uint16_t) * (end - begin));
+    uint16_t *out = (uint16_t *)(packed->data() + rangeStart);
+    for (unsigned int i = begin; i < end; i++) {
+      out[i - begin] = (uint16_t)(indices[i] - bases[split]);
+    }
+
+    draw_range_t draw = {};
+    draw.mesh = mesh;
+    draw.indexType = GL_UNSIGNED_SHORT;
+    draw.byteOffset = byteOffset + rangeStart - start;
+    draw.indexCount = end - begin;
+    draw.baseVertex = (int)bases[split];
+    draw.lod = lod;
+    if (!meshlets) {
+      mesh_cull_bounds(range, &draw);
+      ranges->push_back(draw);
+    }
+    for (unsigned int m = cuts[split]; meshlets && m < cuts[split + 1]; m++) {
+      unsigned int meshletBegin = meshlets[m].indexOffset - firstIndex;
+      draw.byteOffset = byteOffset + rangeStart - start + sizeof(uint16_t) * (meshletBegin - begin);
+      draw.indexCount = meshlets[m].indexCount;
+      meshlet_cull_bounds(meshlets[m], &draw);
+      ranges->push_back(draw);
+    }
+  }
+}
+
+/**
+ * Packs the indices of one mesh for the element buffer, where the packed bytes will start at byteOffset:
+ * its full resolution triangles, followed by each of its coarser levels. See pack_index_run().
+ * If meshlets are given, the mesh's meshletCount of them, the full resolution is drawn meshlet by meshlet.
+ * The coarser levels are drawn whole, culled with the mesh's bounds.
+ * Appends the bytes to packed and the draw calls to ranges, and returns the number of bytes appended.
+ */
+size_t pack_mesh_indices(const model_t *model, unsigned int mesh, const meshlet_t *meshlets, size_t byteOffset,
+                         std::vector<char> *packed, std::vector<draw_range_t> *ranges) {
+  const mesh_range_t &range = model->meshes[mesh];
+  if (range.meshletCount == 0) {
+    meshlets = NULL;
+  }
+  size_t start = packed->size();
+
+  pack_index_run(model, mesh, 0, model->indices + range.indexOffset, range.indexCount, range.indexOffset,
+                 meshlets, range.meshletCount, byteOffset, packed, ranges);
+  for (unsigned int l = 0; l < range.lodCount; l++) {
+    const mesh_lod_t &lod = range.lods[l];
+    pack_index_run(model, mesh, l + 1, model->indices + lod.indexOffset, lod.indexCount, lod.indexOffset,
+                   NULL, 0, byteOffset + packed->size() - start, packed, ranges);
+  }
+  return packed->size() - start;
+}
+
+/**
+ * Packs the indices of all meshes, back to back, as they go into the element buffer.
+ * Returns the packed size in bytes.
+ */
+size_t pack_model_indices(const model_t *model, std::vector<char> *packed, std::vector<draw_range_t> *ranges) {
+  size_t byteOffset = 0;
+  for (unsigned int mesh = 0; mesh < model->meshes.size(); mesh++) {
+    const mesh_range_t &range = model->meshes[mesh];
+    const meshlet_t *meshlets = range.meshletCount > 0 ? &model->meshlets[range.meshletOffset] : NULL;
+    byteOffset += pack_mesh_indices(model, mesh, meshlets, byteOffset, packed, ranges);
+  }
+  return byteOffset;
+}
+
+void print_draw_range_stats(const model_t *model, const std::vector<draw_range_t> &ranges, size_t packedSize) {
+  unsigned int shortRanges = 0;
+  unsigned int lodRanges = 0;
+  for (const draw_range_t &range : ranges) {
+    shortRanges += range.indexType == GL_UNSIGNED_SHORT;
+    lodRanges += range.lod > 0;
+  }
+  size_t fullSize = sizeof(unsigned int) * (size_t)model->indexCount;
+  printf("Index buffer: %zu draw ranges (%u at 16 bit, %u of coarser levels) for %zu meshes, %.2f MB instead of %.2f MB\n",
+         ranges.size(), shortRanges, lodRanges, model->meshes.size(), packedSize / 1e6, fullSize / 1e6);
+}
@@ -0,0 +1,544 @@
+#include <gltf_loader.h>
+#include <json.h>
+#include <thread_pool.h>
+#include <atomic>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Component types and primitive modes of the glTF 2.0 specification.
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+// Deepest node hierarchy followed, which also stops cyclic graphs.
+#define GLTF_MAX_NODE_DEPTH 64
+
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float) && sizeof(aiVector2D) == 2 * sizeof(float),
+              "the fast paths copy float accessors straight into the model's streams");
+
+// One of the file's buffers, mapped read only.
+typedef struct {
+  const char *data;
+  size_t size;
+  void *mapping;
+  size_t mappingSize;
+} gltf_buffer_t;
+
+// An accessor resolved down to its first element in a mapped buffer.
+typedef struct {
+  const char *data;
+  size_t count;
+  size_t stride;
+  int componentType;
+  int components;
+  bool normalized;
+} gltf_accessor_t;
+
+// The accessors of one triangle primitive. Absent attributes have no data.
+typedef struct {
+  gltf_accessor_t positions;
+  gltf_accessor_t normals;
+  gltf_accessor_t uvs;
+  gltf_accessor_t tangents;
+  gltf_accessor_t indices;
+} gltf_primitive_t;
+
+typedef struct {
+  const json_value_t *root;
+  std::vector<gltf_buffer_t> buffers;
+  // Parallel to the model's meshes.
+  std::vector<gltf_primitive_t> primitives;
+  // First aiMesh index of every glTF mesh, assimp numbers the primitives of all meshes consecutively.
+  std::vector<unsigned int> primitiveBase;
+  bool defaultMaterial;
+} gltf_file_t;
+
+static size_t component_size(int componentType) {
+  switch (componentType) {
+  case GLTF_BYTE:
+  case GLTF_UNSIGNED_BYTE:
+    return 1;
+  case GLTF_SHORT:
+  case GLTF_UNSIGNED_SHORT:
+    return 2;
+  case GLTF_UNSIGNED_INT:
+  case GLTF_FLOAT:
+    return 4;
+  }
+  return 0;
+}
+
+static int component_count(const char *type) {
+  if (type == NULL) {
+    return 0;
+  }
+  static const char *TYPES[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+  for (int i = 0; i < 4; i++) {
+    if (strcmp(type, TYPES[i]) == 0) {
+      return i + 1;
+    }
+  }
+  return 0; // matrices are never vertex attributes we use
+}
+
+// The directory of path including its trailing slash, empty for the working directory.
+static std::string directory_prefix(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash == NULL ? std::string() : std::string(path, slash + 1 - path);
+}
+
+// URIs in glTF are percent encoded, e.g. spaces in file names become %20.
+static std::string decode_uri(const char *uri) {
+  std::string decoded;
+  for (const char *c = uri; *c != '\0'; c++) {
+    unsigned int byte;
+    if (c[0] == '%' && c[1] != '\0' && c[2] != '\0' && sscanf(c + 1, "%2x", &byte) == 1) {
+      decoded += (char)byte;
+      c += 2;
+    } else {
+      decoded += *c;
+    }
+  }
+  return decoded;
+}
+
+static int map_buffer(gltf_buffer_t *buffer, const std::string &path, size_t byteLength) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("Failed to open glTF buffer %s\n", path.c_str());
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 || (size_t)info.st_size < byteLength) {
+    printf("glTF buffer %s is shorter than the %zu bytes it should have\n", path.c_str(), byteLength);
+    close(fd);
+    return -1;
+  }
+  if (byteLength > 0) {
+    void *mapping = mmap(NULL, byteLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      perror("mmap");
+      close(fd);
+      return -1;
+    }
+    // Every byte is read once, front to back.
+    madvise(mapping, byteLength, MADV_SEQUENTIAL);
+    madvise(mapping, byteLength, MADV_WILLNEED);
+    buffer->mapping = mapping;
+    buffer->mappingSize = byteLength;
+    buffer->data = (const char *)mapping;
+  }
+  buffer->size = byteLength;
+  close(fd);
+  return 0;
+}
+
+static void unmap_buffers(gltf_file_t *file) {
+  for (gltf_buffer_t &buffer : file->buffers) {
+    if (buffer.mapping != NULL) {
+      munmap(buffer.mapping, buffer.mappingSize);
+    }
+  }
+  file->buffers.clear();
+}
+
+/**
+ * Resolves accessor index through its buffer view, checking that every element lies inside the buffer.
+ * Returns false for what this loader leaves to assimp: sparse accessors, accessors without a view, unusual types.
+ */
+static bool resolve_accessor(const gltf_file_t *file, const json_value_t *index, int components,
+                             gltf_accessor_t *accessor) {
+  const json_value_t *json = json_item(json_member(file->root, "accessors"), json_index(index, SIZE_MAX));
+  const json_value_t *view = json_item(json_member(file->root, "bufferViews"),
+                                       json_index(json_member(json, "bufferView"), SIZE_MAX));
+  if (json == NULL || view == NULL || json_member(json, "sparse") != NULL) {
+    return false;
+  }
+  accessor->componentType = (int)json_index(json_member(json, "componentType"), 0);
+  accessor->components = component_count(json_string(json_member(json, "type")));
+  accessor->count = json_index(json_member(json, "count"), 0);
+  accessor->normalized = json_number(json_member(json, "normalized"), 0) != 0;
+  size_t elementSize = component_size(accessor->componentType) * accessor->components;
+  if (elementSize == 0 || accessor->components != components) {
+    return false;
+  }
+
+  size_t bufferIndex = json_index(json_member(view, "buffer"), SIZE_MAX);
+  if (bufferIndex >= file->buffers.size()) {
+    return false;
+  }
+  const gltf_buffer_t &buffer = file->buffers[bufferIndex];
+  size_t viewOffset = json_index(json_member(view, "byteOffset"), 0);
+  size_t viewLength = json_index(json_member(view, "byteLength"), 0);
+  size_t offset = json_index(json_member(json, "byteOffset"), 0);
+  accessor->stride = json_index(json_member(view, "byteStride"), elementSize);
+  // Offsets and counts come straight from the file, so the checks are written so that they can't overflow.
+  if (accessor->stride < elementSize || viewOffset > buffer.size || viewLength > buffer.size - viewOffset ||
+      (accessor->count > 0 && (offset > viewLength || elementSize > viewLength - offset ||
+                               accessor->count - 1 > (viewLength - offset - elementSize) / accessor->stride))) {
+    return false;
+  }
+  accessor->data = buffer.data + viewOffset + offset;
+  return true;
+}
+
+// Component i of element, converted to float. Normalized integers map to [0, 1] or [-1, 1].
+static float read_component(const gltf_accessor_t &accessor, size_t element, int i) {
+  const char *data = accessor.data + accessor.stride * element + component_size(accessor.componentType) * i;
+  switch (accessor.componentType) {
+  case GLTF_FLOAT: {
+    float value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  case GLTF_BYTE:
+    return accessor.normalized ? fmaxf(*(const int8_t *)data / 127.0f, -1.0f) : *(const int8_t *)data;
+  case GLTF_UNSIGNED_BYTE:
+    return accessor.normalized ? *(const uint8_t *)data / 255.0f : *(const uint8_t *)data;
+  case GLTF_SHORT: {
+    int16_t value;
+    memcpy(&value, data, sizeof(value));
+    return accessor.normalized ? fmaxf(value / 32767.0f, -1.0f) : value;
+  }
+  case GLTF_UNSIGNED_SHORT: {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return accessor.normalized ? value / 65535.0f : value;
+  }
+  case GLTF_UNSIGNED_INT: {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  }
+  return 0.0f;
+}
+
+static unsigned int read_index(const gltf_accessor_t &accessor, size_t element) {
+  const char *data = accessor.data + accessor.stride * element;
+  switch (accessor.componentType) {
+  case GLTF_UNSIGNED_BYTE:
+    return *(const uint8_t *)data;
+  case GLTF_UNSIGNED_SHORT: {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  default: {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  }
+}
+
+/**
+ * Copies the accessor's elements to destination as tightly packed floats.
+ * Exporters write float attributes tightly packed, which makes the whole accessor one memcpy out of the mapped pages.
+ */
+static void copy_floats(const gltf_accessor_t &accessor, float *destination) {
+  if (accessor.componentType == GLTF_FLOAT && accessor.stride == sizeof(float) * accessor.components) {
+    memcpy(destination, accessor.data, accessor.stride * accessor.count);
+    return;
+  }
+  for (size_t e = 0; e < accessor.count; e++) {
+    for (int i = 0; i < accessor.components; i++) {
+      *destination++ = read_component(accessor, e, i);
+    }
+  }
+}
+
+
+/**
+ * Copies one primitive to where its mesh range points. Positions and normals go over with one memcpy each,
+ * everything else needs converting: indices are rebased, uvs flipped like assimp does, bitangents derived.
+ * Returns false if an index points past the primitive's vertices.
+ */
+static bool extract_primitive(model_t *model, const mesh_range_t &range, const gltf_primitive_t &primitive) {
+  unsigned int base = range.vertexOffset;
+  copy_floats(primitive.positions, &model->vertices[base].x);
+  for (unsigned int v = base; v < base + range.vertexCount; v++) {
+    model->materialIds[v] = range.materialIndex;
+  }
+
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    unsigned int index = primitive.indices.data != NULL ? read_index(primitive.indices, i) : i;
+    if (index >= range.vertexCount) {
+      return false;
+    }
+    model->indices[range.indexOffset + i] = index + base;
+  }
+
+  if (primitive.normals.data != NULL) {
+    copy_floats(primitive.normals, &model->normals[base].x);
+  } else {
+    compute_mesh_normals(model, range);
+  }
+
+  if (primitive.uvs.data == NULL) {
+    // Like extract_vertices(), untextured meshes sample the first texel of their material's maps.
+    for (unsigned int v = base; v < base + range.vertexCount; v++) {
+      model->uvs[v] = aiVector2D(0.0f, 0.0f);
+      model->tangents[v] = model->bitangents[v] = aiVector3D(0.0f, 0.0f, 0.0f);
+    }
+    return true;
+  }
+  // glTF puts the uv origin top left, assimp flips it to bottom left and the shaders expect that.
+  copy_floats(primitive.uvs, &model->uvs[base].x);
+  for (unsigned int v = base; v < base + range.vertexCount; v++) {
+    model->uvs[v].y = 1.0f - model->uvs[v].y;
+  }
+
+  if (primitive.tangents.data == NULL) {
+    compute_mesh_tangents(model, range);
+    return true;
+  }
+  // The fourth component is the handedness of the tangent frame.
+  for (unsigned int v = 0; v < range.vertexCount; v++) {
+    aiVector3D tangent(read_component(primitive.tangents, v, 0), read_component(primitive.tangents, v, 1),
+                       read_component(primitive.tangents, v, 2));
+    float handedness = read_component(primitive.tangents, v, 3);
+    model->tangents[base + v] = tangent;
+    model->bitangents[base + v] = (model->normals[base + v] ^ tangent) * handedness;
+  }
+  return true;
+}
+
+/**
+ * Adds the primitives of mesh to the model's mesh list and counts their vertices and indices.
+ * Returns false for primitives assimp has to handle: other modes than triangles, missing or mismatched attributes.
+ */
+static bool count_mesh(model_t *model, gltf_file_t *file, size_t meshIndex) {
+  const json_value_t *mesh = json_item(json_member(file->root, "meshes"), meshIndex);
+  if (mesh == NULL) {
+    return false;
+  }
+  const json_value_t *primitives = json_member(mesh, "primitives");
+  size_t materialCount = json_size(json_member(file->root, "materials"));
+
+  for (size_t p = 0; p < json_size(primitives); p++) {
+    const json_value_t *json = json_item(primitives, p);
+    const json_value_t *attributes = json_member(json, "attributes");
+    if (json_number(json_member(json, "mode"), GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+      return false;
+    }
+
+    gltf_primitive_t primitive = {};
+    if (!resolve_accessor(file, json_member(attributes, "POSITION"), 3, &primitive.positions)) {
+      return false;
+    }
+    const struct {
+      const char *name;
+      int components;
+      gltf_accessor_t *accessor;
+    } optional[] = {
+      {"NORMAL", 3, &primitive.normals},
+      {"TEXCOORD_0", 2, &primitive.uvs},
+      {"TANGENT", 4, &primitive.tangents},
+    };
+    for (const auto &attribute : optional) {
+      const json_value_t *index = json_member(attributes, attribute.name);
+      if (index != NULL && (!resolve_accessor(file, index, attribute.components, attribute.accessor) ||
+                            attribute.accessor->count != primitive.positions.count)) {
+        return false;
+      }
+    }
+    const json_value_t *indices = json_member(json, "indices");
+    if (indices != NULL && (!resolve_accessor(file, indices, 1, &primitive.indices) ||
+                            primitive.indices.componentType == GLTF_FLOAT)) {
+      return false;
+    }
+
+    mesh_range_t range = {};
+    range.meshId = file->primitiveBase[meshIndex] + p;
+    const json_value_t *material = json_member(json, "material");
+    size_t materialIndex = material != NULL ? json_index(material, SIZE_MAX) : materialCount;
+    file->defaultMaterial = file->defaultMaterial || material == NULL;
+    range.vertexOffset = model->vertexCount;
+    range.vertexCount = primitive.positions.count;
+    range.indexOffset = model->indexCount;
+    range.indexCount = indices != NULL ? primitive.indices.count : primitive.positions.count;
+    if (range.indexCount % 3 != 0 || (material != NULL && materialIndex >= materialCount)) {
+      return false;
+    }
+    range.materialIndex = materialIndex;
+    model->meshes.push_back(range);
+    file->primitives.push_back(primitive);
+    model->vertexCount += range.vertexCount;
+    model->indexCount += range.indexCount;
+  }
+  return true;
+}
+
+// Walks the node hierarchy like count_model(): a node's own mesh first, then its children.
+static bool count_node(model_t *model, gltf_file_t *file, size_t nodeIndex, int depth) {
+  const json_value_t *node = json_item(json_member(file->root, "nodes"), nodeIndex);
+  if (node == NULL || depth > GLTF_MAX_NODE_DEPTH) {
+    return false;
+  }
+  const json_value_t *mesh = json_member(node, "mesh");
+  if (mesh != NULL && !count_mesh(model, file, json_index(mesh, SIZE_MAX))) {
+    return false;
+  }
+  const json_value_t *children = json_member(node, "children");
+  for (size_t c = 0; c < json_size(children); c++) {
+    if (!count_node(model, file, json_index(json_item(children, c), SIZE_MAX), depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// "./" + the image's uri, like extract_textures() reports assimp's paths. Empty for embedded images.
+static std::string texture_path(const gltf_file_t *file, const json_value_t *textureInfo) {
+  const json_value_t *texture = json_item(json_member(file->root, "textures"),
+                                          json_index(json_member(textureInfo, "index"), SIZE_MAX));
+  const json_value_t *image = json_item(json_member(file->root, "images"),
+                                        json_index(json_member(texture, "source"), SIZE_MAX));
+  const char *uri = json_string(json_member(image, "uri"));
+  if (uri == NULL || strncmp(uri, "data:", 5) == 0) {
+    return std::string();
+  }
+  return std::string("./") + decode_uri(uri);
+}
+
+// Base colours into the material table and every material's maps next to it, like extract_textures().
+static void read_materials(model_t *model, const gltf_file_t *file) {
+  const json_value_t *materials = json_member(file->root, "materials");
+  size_t materialCount = json_size(materials) + (file->defaultMaterial ? 1 : 0);
+  model->materials.assign(materialCount, aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+  model->diffuseMapPaths.assign(materialCount, std::string());
+  model->normalMapPaths.assign(materialCount, std::string());
+  for (size_t m = 0; m < json_size(materials); m++) {
+    const json_value_t *material = json_item(materials, m);
+    const json_value_t *pbr = json_member(material, "pbrMetallicRoughness");
+    const json_value_t *factor = json_member(pbr, "baseColorFactor");
+    if (json_size(factor) == 4) {
+      model->materials[m] = aiColor4D(json_number(json_item(factor, 0), 1), json_number(json_item(factor, 1), 1),
+                                      json_number(json_item(factor, 2), 1), json_number(json_item(factor, 3), 1));
+    }
+
+    model->normalMapPaths[m] = texture_path(file, json_member(material, "normalTexture"));
+    model->diffuseMapPaths[m] = texture_path(file, json_member(pbr, "baseColorTexture"));
+  }
+}
+
+// Counts, allocates and extracts the model from the parsed file with its buffers mapped.
+static int load_gltf_mapped(model_t *model, gltf_file_t *file, const load_options_t *options) {
+  const json_value_t *meshes = json_member(file->root, "meshes");
+  unsigned int primitiveCount = 0;
+  for (size_t m = 0; m < json_size(meshes); m++) {
+    file->primitiveBase.push_back(primitiveCount);
+    primitiveCount += json_size(json_member(json_item(meshes, m), "primitives"));
+  }
+
+  const json_value_t *scene = json_item(json_member(file->root, "scenes"),
+                                        json_index(json_member(file->root, "scene"), 0));
+  const json_value_t *nodes = json_member(scene, "nodes");
+  if (scene == NULL) {
+    return 1;
+  }
+  for (size_t n = 0; n < json_size(nodes); n++) {
+    if (!count_node(model, file, json_index(json_item(nodes, n), SIZE_MAX), 0)) {
+      return 1;
+    }
+  }
+  read_materials(model, file);
+
+  if (allocate_model(model) < 0) {
+    return -1;
+  }
+  std::atomic<bool> valid(true);
+  auto extract = [&](size_t r) {
+    if (!extract_primitive(model, model->meshes[r], file->primitives[r])) {
+      valid = false;
+    }
+    compute_mesh_bounds(model, &model->meshes[r]);
+  };
+  if (options->parallelExtract) {
+    parallel_for(model->meshes.size(), extract);
+  } else {
+    for (size_t r = 0; r < model->meshes.size(); r++) {
+      extract(r);
+    }
+  }
+  if (!valid) {
+    printf("A glTF primitive indexes past its vertices\n");
+    return 1;
+  }
+  model->vertexOffset = model->vertexCount;
+  model->indexOffset = model->indexCount;
+  return 0;
+}
+
+/**
+ * Loads a .gltf file without assimp. The JSON is parsed once and the .bin buffers are mapped,
+ * so tightly packed float attributes are copied straight from the mapped pages into the model's arena.
+ * Nodes are flattened like import_model() does, with their transforms ignored, and the model passes of options run after.
+ * Returns 1 without touching model if the file isn't a .gltf or uses something left to assimp
+ * (embedded buffers, required extensions, sparse accessors, non-triangle primitives), -1 if the passes fail.
+ */
+int load_gltf(model_t *model, const char *path, const load_options_t *options) {
+  size_t length = strlen(path);
+  if (length < 5 || strcmp(path + length - 5, ".gltf") != 0) {
+    return 1;
+  }
+
+  FILE *jsonFile = fopen(path, "rb");
+  if (jsonFile == NULL) {
+    return 1;
+  }
+  std::string text;
+  char chunk[64 * 1024];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), jsonFile)) > 0) {
+    text.append(chunk, read);
+  }
+  fclose(jsonFile);
+
+  json_value_t root;
+  if (parse_json(text.c_str(), text.size(), &root) < 0) {
+    return 1;
+  }
+  const char *version = json_string(json_member(json_member(&root, "asset"), "version"));
+  if (version == NULL || version[0] != '2' || json_size(json_member(&root, "extensionsRequired")) > 0) {
+    return 1;
+  }
+
+  gltf_file_t file = {};
+  file.root = &root;
+  std::string directory = directory_prefix(path);
+  const json_value_t *buffers = json_member(&root, "buffers");
+  for (size_t b = 0; b < json_size(buffers); b++) {
+    const json_value_t *buffer = json_item(buffers, b);
+    const char *uri = json_string(json_member(buffer, "uri"));
+    gltf_buffer_t mapped = {};
+    if (uri == NULL || strncmp(uri, "data:", 5) == 0 ||
+        map_buffer(&mapped, directory + decode_uri(uri), json_index(json_member(buffer, "byteLength"), 0)) < 0) {
+      unmap_buffers(&file);
+      return 1;
+    }
+    file.buffers.push_back(mapped);
+  }
+
+  model_t loaded = {};
+  int result = load_gltf_mapped(&loaded, &file, options);
+  unmap_buffers(&file);
+  if (result != 0) {
+    free_model(loaded);
+    return result;
+  }
+
+  *model = loaded;
+  return run_model_passes(model, options);
+}
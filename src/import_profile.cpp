@@ -0,0 +1,129 @@
+#include <import_profile.h>
+#include <assimp/cimport.h>
+#include <assimp/postprocess.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Every profile has to produce triangles and tangents, since texture.frag builds its TBN from them.
+// Normals come from GenNormals or GenSmoothNormals, assimp rejects having both.
+#define REQUIRED_STEPS (aiProcess_Triangulate | aiProcess_CalcTangentSpace)
+
+static const import_profile_t IMPORT_PROFILES[] = {
+  // Only what the renderer needs. Meant for assets that are already clean, indexed and triangulated.
+  {"fast", REQUIRED_STEPS | aiProcess_GenNormals},
+  // Assimp's realtime fast preset, which additionally welds vertices and splits by primitive type.
+  {"balanced", aiProcessPreset_TargetRealtime_Fast | REQUIRED_STEPS},
+  // What the renderer always used: validation, degenerate removal, cache locality optimisation, ...
+  {"max", aiProcessPreset_TargetRealtime_MaxQuality | REQUIRED_STEPS},
+};
+
+#define IMPORT_PROFILE_COUNT (sizeof(IMPORT_PROFILES) / sizeof(IMPORT_PROFILES[0]))
+
+const import_profile_t *find_import_profile(const char *name) {
+  for (unsigned int i = 0; i < IMPORT_PROFILE_COUNT; i++) {
+    if (strcmp(IMPORT_PROFILES[i].name, name) == 0) {
+      return &IMPORT_PROFILES[i];
+    }
+  }
+  return NULL;
+}
+
+void print_import_profiles() {
+  for (unsigned int i = 0; i < IMPORT_PROFILE_COUNT; i++) {
+    printf("  %-10s flags 0x%08x\n", IMPORT_PROFILES[i].name, IMPORT_PROFILES[i].postProcessFlags);
+  }
+}
+
+static double now_seconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1000000000.0;
+}
+
+typedef struct {
+  unsigned int flag;
+  const char *name;
+} post_process_step_t;
+
+// The steps in the order assimp itself runs them (see its PostStepRegistry).
+// Validation is special cased by assimp and always runs first.
+static const post_process_step_t POST_PROCESS_STEPS[] = {
+  {aiProcess_ValidateDataStructure, "ValidateDataStructure"},
+  {aiProcess_DropNormals, "DropNormals"},
+  {aiProcess_RemoveComponent, "RemoveComponent"},
+  {aiProcess_RemoveRedundantMaterials, "RemoveRedundantMaterials"},
+  {aiProcess_EmbedTextures, "EmbedTextures"},
+  {aiProcess_FindInstances, "FindInstances"},
+  {aiProcess_OptimizeGraph, "OptimizeGraph"},
+  {aiProcess_OptimizeMeshes, "OptimizeMeshes"},
+  {aiProcess_FindDegenerates, "FindDegenerates"},
+  {aiProcess_GenUVCoords, "GenUVCoords"},
+  {aiProcess_TransformUVCoords, "TransformUVCoords"},
+  {aiProcess_GlobalScale, "GlobalScale"},
+  {aiProcess_PreTransformVertices, "PreTransformVertices"},
+  {aiProcess_Triangulate, "Triangulate"},
+  {aiProcess_SortByPType, "SortByPType"},
+  {aiProcess_FindInvalidData, "FindInvalidData"},
+  {aiProcess_PopulateArmatureData, "PopulateArmatureData"},
+  {aiProcess_FixInfacingNormals, "FixInfacingNormals"},
+  {aiProcess_SplitByBoneCount, "SplitByBoneCount"},
+  {aiProcess_SplitLargeMeshes, "SplitLargeMeshes"},
+  {aiProcess_GenNormals, "GenNormals"},
+  {aiProcess_GenSmoothNormals, "GenSmoothNormals"},
+  {aiProcess_CalcTangentSpace, "CalcTangentSpace"},
+  {aiProcess_JoinIdenticalVertices, "JoinIdenticalVertices"},
+  {aiProcess_MakeLeftHanded, "MakeLeftHanded"},
+  {aiProcess_FlipUVs, "FlipUVs"},
+  {aiProcess_FlipWindingOrder, "FlipWindingOrder"},
+  {aiProcess_Debone, "Debone"},
+  {aiProcess_LimitBoneWeights, "LimitBoneWeights"},
+  {aiProcess_ImproveCacheLocality, "ImproveCacheLocality"},
+  {aiProcess_GenBoundingBoxes, "GenBoundingBoxes"},
+};
+
+#define POST_PROCESS_STEP_COUNT (sizeof(POST_PROCESS_STEPS) / sizeof(POST_PROCESS_STEPS[0]))
+
+/**
+ * Imports path with the given post-processing.
+ * If report is set, the file is read without post-processing first and every step is then applied on its own,
+ * timed, and printed as a table. The steps run in assimp's own order, so the result matches a regular import.
+ * Steps that assimp normally shares a spatial sort between (normals, tangents, welding) each build their own here,
+ * so they are reported slightly more expensive than they really are.
+ */
+const struct aiScene *import_scene(const char *path, unsigned int postProcessFlags, bool report) {
+  if (!report) {
+    return aiImportFile(path, postProcessFlags);
+  }
+
+  double start = now_seconds();
+  const struct aiScene *scene = aiImportFile(path, 0);
+  if (scene == NULL) {
+    return NULL;
+  }
+  double readTime = now_seconds() - start;
+
+  double stepTimes[POST_PROCESS_STEP_COUNT] = {0};
+  for (unsigned int i = 0; i < POST_PROCESS_STEP_COUNT && scene != NULL; i++) {
+    if (postProcessFlags & POST_PROCESS_STEPS[i].flag) {
+      double stepStart = now_seconds();
+      scene = aiApplyPostProcessing(scene, POST_PROCESS_STEPS[i].flag);
+      stepTimes[i] = now_seconds() - stepStart;
+    }
+  }
+  if (scene == NULL) {
+    printf("Post-processing failed: %s\n", aiGetErrorString());
+    return NULL;
+  }
+
+  double total = now_seconds() - start;
+  printf("Import of %s (flags 0x%08x): %.2f ms\n", path, postProcessFlags, total * 1000.0);
+  printf("  %-26s %9.2f ms %5.1f %%\n", "Read", readTime * 1000.0, 100.0 * readTime / total);
+  for (unsigned int i = 0; i < POST_PROCESS_STEP_COUNT; i++) {
+    if (postProcessFlags & POST_PROCESS_STEPS[i].flag) {
+      printf("  %-26s %9.2f ms %5.1f %%\n", POST_PROCESS_STEPS[i].name,
+             stepTimes[i] * 1000.0, 100.0 * stepTimes[i] / total);
+    }
+  }
+  return scene;
+}
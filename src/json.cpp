@@ -0,0 +1,256 @@
+#include <json.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Deepest nesting accepted, so hostile files can't overflow the stack.
+#define JSON_MAX_DEPTH 128
+
+typedef struct {
+  const char *cursor;
+  const char *end;
+} json_parser_t;
+
+static void skip_whitespace(json_parser_t *parser) {
+  while (parser->cursor < parser->end &&
+         (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == '\n' || *parser->cursor == '\r')) {
+    parser->cursor++;
+  }
+}
+
+static bool consume(json_parser_t *parser, const char *literal) {
+  size_t length = strlen(literal);
+  if ((size_t)(parser->end - parser->cursor) < length || memcmp(parser->cursor, literal, length) != 0) {
+    return false;
+  }
+  parser->cursor += length;
+  return true;
+}
+
+static void append_utf8(std::string *string, unsigned int codepoint) {
+  if (codepoint < 0x80) {
+    *string += (char)codepoint;
+  } else if (codepoint < 0x800) {
+    *string += (char)(0xc0 | (codepoint >> 6));
+    *string += (char)(0x80 | (codepoint & 0x3f));
+  } else if (codepoint < 0x10000) {
+    *string += (char)(0xe0 | (codepoint >> 12));
+    *string += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+    *string += (char)(0x80 | (codepoint & 0x3f));
+  } else {
+    *string += (char)(0xf0 | (codepoint >> 18));
+    *string += (char)(0x80 | ((codepoint >> 12) & 0x3f));
+    *string += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+    *string += (char)(0x80 | (codepoint & 0x3f));
+  }
+}
+
+static bool parse_hex4(json_parser_t *parser, unsigned int *value) {
+  if (parser->end - parser->cursor < 4) {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = *parser->cursor++;
+    unsigned int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    *value = (*value << 4) | digit;
+  }
+  return true;
+}
+
+// Parses the string starting after its opening quote.
+static bool parse_string(json_parser_t *parser, std::string *string) {
+  while (parser->cursor < parser->end) {
+    char c = *parser->cursor++;
+    if (c == '"') {
+      return true;
+    }
+    if (c != '\\') {
+      *string += c;
+      continue;
+    }
+    if (parser->cursor == parser->end) {
+      return false;
+    }
+    char escape = *parser->cursor++;
+    switch (escape) {
+    case '"': *string += '"'; break;
+    case '\\': *string += '\\'; break;
+    case '/': *string += '/'; break;
+    case 'b': *string += '\b'; break;
+    case 'f': *string += '\f'; break;
+    case 'n': *string += '\n'; break;
+    case 'r': *string += '\r'; break;
+    case 't': *string += '\t'; break;
+    case 'u': {
+      unsigned int codepoint;
+      if (!parse_hex4(parser, &codepoint)) {
+        return false;
+      }
+      // Characters outside the basic plane come as a surrogate pair.
+      unsigned int low;
+      if (codepoint >= 0xd800 && codepoint < 0xdc00 && consume(parser, "\\u") && parse_hex4(parser, &low)) {
+        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+      }
+      append_utf8(string, codepoint);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
+static bool parse_value(json_parser_t *parser, json_value_t *value, int depth) {
+  skip_whitespace(parser);
+  if (parser->cursor == parser->end || depth > JSON_MAX_DEPTH) {
+    return false;
+  }
+
+  char c = *parser->cursor;
+  if (c == '{' || c == '[') {
+    bool object = c == '{';
+    char close = object ? '}' : ']';
+    value->type = object ? JSON_OBJECT : JSON_ARRAY;
+    parser->cursor++;
+    skip_whitespace(parser);
+    if (parser->cursor < parser->end && *parser->cursor == close) {
+      parser->cursor++;
+      return true;
+    }
+    while (true) {
+      if (object) {
+        skip_whitespace(parser);
+        std::string key;
+        if (!consume(parser, "\"") || !parse_string(parser, &key)) {
+          return false;
+        }
+        skip_whitespace(parser);
+        if (!consume(parser, ":")) {
+          return false;
+        }
+        value->keys.push_back(key);
+      }
+      value->items.push_back(json_value_t{});
+      if (!parse_value(parser, &value->items.back(), depth + 1)) {
+        return false;
+      }
+      skip_whitespace(parser);
+      if (consume(parser, ",")) {
+        continue;
+      }
+      return consume(parser, object ? "}" : "]");
+    }
+  }
+  if (c == '"') {
+    value->type = JSON_STRING;
+    parser->cursor++;
+    return parse_string(parser, &value->string);
+  }
+  if (consume(parser, "true")) {
+    value->type = JSON_BOOL;
+    value->number = 1.0;
+    return true;
+  }
+  if (consume(parser, "false")) {
+    value->type = JSON_BOOL;
+    value->number = 0.0;
+    return true;
+  }
+  if (consume(parser, "null")) {
+    value->type = JSON_NULL;
+    return true;
+  }
+
+  // The text is terminated after its end (see parse_json()), so strtod can't run past it.
+  char *numberEnd;
+  value->type = JSON_NUMBER;
+  value->number = strtod(parser->cursor, &numberEnd);
+  if (numberEnd == parser->cursor || numberEnd > parser->end) {
+    return false;
+  }
+  parser->cursor = numberEnd;
+  return true;
+}
+
+/**
+ * Parses the document text[0, length) into root. text[length] has to be readable and not part of a number,
+ * e.g. the terminator of a std::string. Returns -1 on malformed input.
+ */
+int parse_json(const char *text, size_t length, json_value_t *root) {
+  json_parser_t parser = {text, text + length};
+  *root = json_value_t{};
+  if (!parse_value(&parser, root, 0)) {
+    printf("Malformed JSON at byte %zu\n", (size_t)(parser.cursor - text));
+    return -1;
+  }
+  skip_whitespace(&parser);
+  if (parser.cursor != parser.end) {
+    printf("Trailing characters after JSON at byte %zu\n", (size_t)(parser.cursor - text));
+    return -1;
+  }
+  return 0;
+}
+
+// The member named key, NULL if object is not an object or has no such member.
+const json_value_t *json_member(const json_value_t *object, const char *key) {
+  if (object == NULL || object->type != JSON_OBJECT) {
+    return NULL;
+  }
+  for (size_t i = 0; i < object->keys.size(); i++) {
+    if (object->keys[i] == key) {
+      return &object->items[i];
+    }
+  }
+  return NULL;
+}
+
+// The element at index, NULL if array is not an array or too short.
+const json_value_t *json_item(const json_value_t *array, size_t index) {
+  if (array == NULL || array->type != JSON_ARRAY || index >= array->items.size()) {
+    return NULL;
+  }
+  return &array->items[index];
+}
+
+// Number of elements, 0 for anything but an array.
+size_t json_size(const json_value_t *array) {
+  return array != NULL && array->type == JSON_ARRAY ? array->items.size() : 0;
+}
+
+double json_number(const json_value_t *value, double fallback) {
+  return value != NULL && (value->type == JSON_NUMBER || value->type == JSON_BOOL) ? value->number : fallback;
+}
+
+/**
+ * The number as an index, count or byte offset, fallback if value is missing. Numbers that are negative, fractional
+ * or too large to be exact are SIZE_MAX, which no array or buffer is long enough for, since casting them to size_t
+ * would be undefined.
+ */
+size_t json_index(const json_value_t *value, size_t fallback) {
+  if (value == NULL) {
+    return fallback;
+  }
+  double number = json_number(value, -1.0);
+  if (!(number >= 0.0 && number <= 9007199254740992.0) || floor(number) != number) {
+    return SIZE_MAX;
+  }
+  return (size_t)number;
+}
+
+// The string's contents, NULL for anything but a string.
+const char *json_string(const json_value_t *value) {
+  return value != NULL && value->type == JSON_STRING ? value->string.c_str() : NULL;
+}
@@ -0,0 +1,49 @@
+#include <material.h>
+#include <glad/glad.h>
+#include <stdio.h>
+
+/**
+ * Uploads the material table into buffer and binds it to MATERIAL_BLOCK_BINDING.
+ * The buffer always has room for MAX_MATERIALS, so this can be called again whenever a material changes,
+ * without touching the geometry.
+ */
+void upload_materials(unsigned int buffer, const std::vector<aiColor4D> &materials) {
+  size_t count = materials.size();
+  if (count > MAX_MATERIALS) {
+    printf("Scene has %zu materials, only the first %d are used!\n", count, MAX_MATERIALS);
+    count = MAX_MATERIALS;
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(aiColor4D) * MAX_MATERIALS, NULL, GL_DYNAMIC_DRAW);
+  if (count > 0) {
+    // std140 lays out a vec4 array tightly, exactly like aiColor4D.
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(aiColor4D) * count, materials.data());
+  }
+  glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * Overwrites the table's entries from offset on with materials, e.g. those of one reloaded asset.
+ * Entries past MAX_MATERIALS are dropped, like upload_materials() does.
+ */
+void update_materials(unsigned int buffer, unsigned int offset, const aiColor4D *materials, size_t count) {
+  if (offset >= MAX_MATERIALS) {
+    return;
+  }
+  if (count > MAX_MATERIALS - offset) {
+    count = MAX_MATERIALS - offset;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, sizeof(aiColor4D) * offset, sizeof(aiColor4D) * count, materials);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Connects the program's Materials block to the table. Programs that do not use it are left alone.
+void bind_material_block(unsigned int program) {
+  unsigned int block = glGetUniformBlockIndex(program, "Materials");
+  if (block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, block, MATERIAL_BLOCK_BINDING);
+  }
+}
@@ -0,0 +1,371 @@
+#include <material_textures.h>
+#include <material.h>
+#include <texture_compress.h>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The first level of shape no larger than TEXTURE_RESIDENT_SIZE on either side, or its last one.
+static uint32_t coarse_level(const texture_levels_t *shape) {
+  uint32_t level = 0;
+  while (level + 1 < shape->levelCount &&
+         (shape->levels[level].width > TEXTURE_RESIDENT_SIZE || shape->levels[level].height > TEXTURE_RESIDENT_SIZE)) {
+    level++;
+  }
+  return level;
+}
+
+// VRAM taken by level of group's array, for all layers it has room for.
+static size_t level_bytes(const texture_group_t *group, uint32_t level) {
+  return group->shape.levels[level].size * group->layerCapacity;
+}
+
+// VRAM taken by all of group's allocated levels, including one that is being streamed in.
+static size_t group_bytes(const texture_group_t *group) {
+  size_t bytes = 0;
+  uint32_t first = group->streamingLevel >= 0 ? group->streamingLevel : group->residentLevel;
+  for (uint32_t l = first; l < group->shape.levelCount; l++) {
+    bytes += level_bytes(group, l);
+  }
+  return bytes;
+}
+
+/**
+ * Reallocates group's array with room for capacity layers, keeping the layers it has at their resident levels.
+ * A level that was being streamed in is dropped, stream_material_levels() starts it over.
+ */
+static void grow_texture_group(material_textures_t *textures, texture_group_t *group, unsigned int capacity) {
+  textures->residentBytes -= group_bytes(group);
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  allocate_texture_array(texture, &group->shape, group->residentLevel, capacity);
+  if (group->layerCapacity > 0) {
+    copy_texture_array(group->texture, texture, &group->shape, group->residentLevel, group->layerCapacity);
+    glDeleteTextures(1, &group->texture);
+  }
+  group->texture = texture;
+  group->layerCapacity = capacity;
+  group->layers.resize(capacity);
+  group->streamingLevel = -1;
+  textures->residentBytes += group_bytes(group);
+}
+
+// Index of the group levels fit into, -1 if there is none yet.
+static int find_texture_group(const material_textures_t *textures, const texture_levels_t *levels) {
+  for (size_t g = 0; g < textures->groups.size(); g++) {
+    const texture_levels_t &shape = textures->groups[g].shape;
+    if (shape.internalFormat == levels->internalFormat && shape.format == levels->format &&
+        shape.type == levels->type && shape.levelCount == levels->levelCount &&
+        shape.levels[0].width == levels->levels[0].width && shape.levels[0].height == levels->levels[0].height) {
+      return (int)g;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Uploads the levels of the map at path into a layer of the group they fit, creating the group if needed.
+ * Only the group's resident levels are uploaded, the layer keeps levels to stream the finer ones from later.
+ * A reloaded map keeps its layer as long as its size and format stay the same, otherwise its old layer is left unused.
+ * Returns -1, leaving the map's placeholder in place and levels with the caller, if it needs a group beyond
+ * MAX_TEXTURE_GROUPS.
+ */
+static int place_material_map(material_textures_t *textures, material_map_t *map, const std::string &path,
+                              const texture_levels_t *levels, unsigned int pixelBuffer) {
+  int group = find_texture_group(textures, levels);
+  if (group < 0) {
+    if (textures->groups.size() >= MAX_TEXTURE_GROUPS) {
+      printf("Texture %s fits none of the %d texture groups, keeping its placeholder\n", path.c_str(),
+             MAX_TEXTURE_GROUPS);
+      return -1;
+    }
+    texture_group_t created = {};
+    created.shape = *levels;
+    created.shape.data = NULL;
+    created.shape.dataSize = 0;
+    created.shape.mapping = NULL;
+    created.shape.mappingSize = 0;
+    created.residentLevel = coarse_level(levels);
+    created.neededLevel = levels->levelCount - 1;
+    created.streamingLevel = -1;
+    textures->groups.push_back(created);
+    group = textures->groups.size() - 1;
+  }
+
+  texture_group_t &target = textures->groups[group];
+  int layer = map->group == group ? map->layer : (int)target.layerCount++;
+  if (target.layerCount > target.layerCapacity) {
+    grow_texture_group(textures, &target, target.layerCapacity > 0 ? 2 * target.layerCapacity : 1);
+  }
+  if (map->group >= 0 && map->group != group) {
+    free_texture_levels(&textures->groups[map->group].layers[map->layer]);
+    textures->groups[map->group].layers[map->layer] = {};
+  }
+  // A level being streamed in may already be past this layer.
+  uint32_t first = target.streamingLevel >= 0 ? target.streamingLevel : target.residentLevel;
+  upload_texture_layer(target.texture, layer, levels, first, levels->levelCount - 1, pixelBuffer);
+  free_texture_levels(&target.layers[layer]);
+  target.layers[layer] = *levels;
+  map->group = group;
+  map->layer = layer;
+  return 0;
+}
+
+// Group and layer the shaders sample for path, the placeholder layer if it has no map (yet).
+static void write_map_entry(const material_textures_t *textures, const std::string &path, int placeholder,
+                            int32_t entry[2]) {
+  entry[0] = 0;
+  entry[1] = placeholder;
+  auto map = textures->maps.find(path);
+  if (!path.empty() && map != textures->maps.end() && map->second.group >= 0) {
+    entry[0] = map->second.group;
+    entry[1] = map->second.layer;
+  }
+}
+
+/**
+ * Writes every material's diffuse group and layer followed by its normal group and layer into the MaterialMaps
+ * buffer. It is only 16 KB, so it is rewritten whole whenever maps arrive.
+ */
+static void upload_material_map_table(material_textures_t *textures) {
+  size_t count = textures->diffuseMapPaths.size() < MAX_MATERIALS ? textures->diffuseMapPaths.size() : MAX_MATERIALS;
+  std::vector<int32_t> &table = textures->table;
+  table.resize(4 * count);
+  for (size_t m = 0; m < count; m++) {
+    write_map_entry(textures, textures->diffuseMapPaths[m], PLACEHOLDER_DIFFUSE, &table[4 * m]);
+    write_map_entry(textures, textures->normalMapPaths[m], PLACEHOLDER_NORMAL, &table[4 * m + 2]);
+  }
+  if (table.empty()) {
+    return;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, textures->buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int32_t) * table.size(), table.data());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * Creates the MaterialMaps buffer, bound to MATERIAL_MAPS_BLOCK_BINDING, and group 0 with the placeholders.
+ * Until set_material_maps() is called, every material samples the placeholders.
+ */
+void create_material_textures(material_textures_t *textures) {
+  textures->frame = 1;
+  // std140 pads every element of an int array to 16 bytes, so the entries are ivec4s.
+  glGenBuffers(1, &textures->buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, textures->buffer);
+  glBufferData(GL_UNIFORM_BUFFER, 4 * sizeof(int32_t) * MAX_MATERIALS, NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_MAPS_BLOCK_BINDING, textures->buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  unsigned char texels[2][4] = {{255, 255, 255, 255}, {128, 128, 255, 255}};
+  for (int layer : {PLACEHOLDER_DIFFUSE, PLACEHOLDER_NORMAL}) {
+    // The group keeps its layers' levels, so each gets its own copy.
+    texture_levels_t texel = {};
+    texel.internalFormat = GL_RGBA8;
+    texel.format = GL_RGBA;
+    texel.type = GL_UNSIGNED_BYTE;
+    texel.levelCount = 1;
+    texel.levels[0] = {1, 1, 0, sizeof(texels[0])};
+    texel.dataSize = sizeof(texels[0]);
+    texel.data = (unsigned char *)malloc(texel.dataSize);
+    memcpy(texel.data, texels[layer], texel.dataSize);
+    material_map_t placeholder = {-1, -1, TEXTURE_COLOR};
+    place_material_map(textures, &placeholder, "placeholder", &texel, 0);
+  }
+  upload_material_map_table(textures);
+}
+
+/**
+ * Assigns maps to the materials from offset on, e.g. those of one (re)loaded asset, and updates the table.
+ * Files no material used before are queued on loader, their materials sample the placeholders until they arrive.
+ */
+void set_material_maps(material_textures_t *textures, texture_loader_t *loader, unsigned int offset,
+                       const std::vector<std::string> &diffuseMapPaths, const std::vector<std::string> &normalMapPaths) {
+  size_t end = offset + diffuseMapPaths.size();
+  if (end > textures->diffuseMapPaths.size()) {
+    textures->diffuseMapPaths.resize(end);
+    textures->normalMapPaths.resize(end);
+  }
+  for (size_t m = 0; m < diffuseMapPaths.size(); m++) {
+    textures->diffuseMapPaths[offset + m] = diffuseMapPaths[m];
+    textures->normalMapPaths[offset + m] = normalMapPaths[m];
+    for (int kind : {TEXTURE_COLOR, TEXTURE_NORMAL}) {
+      const std::string &path = kind == TEXTURE_COLOR ? diffuseMapPaths[m] : normalMapPaths[m];
+      if (!path.empty() && textures->maps.find(path) == textures->maps.end()) {
+        textures->maps[path] = {-1, -1, kind};
+        queue_texture(loader, path, kind);
+      }
+    }
+  }
+  upload_material_map_table(textures);
+}
+
+/**
+ * Loads the map at path again, e.g. after it changed on disk. Its materials keep sampling the old one until then.
+ * Returns false if no material uses path.
+ */
+bool reload_material_map(material_textures_t *textures, texture_loader_t *loader, const std::string &path) {
+  auto map = textures->maps.find(path);
+  if (map == textures->maps.end()) {
+    return false;
+  }
+  queue_texture(loader, path, map->second.kind);
+  return true;
+}
+
+/**
+ * Places the maps the loader has ready into their groups, within budget bytes. Call once per frame.
+ * Returns how many maps are still to come, like texture_loader_update().
+ */
+unsigned int update_material_textures(material_textures_t *textures, texture_loader_t *loader, size_t budget) {
+  std::vector<texture_job_t> loaded;
+  unsigned int pending = texture_loader_update(loader, budget, &loaded);
+  for (texture_job_t &job : loaded) {
+    material_map_t &map = textures->maps[job.path];
+    if (place_material_map(textures, &map, job.path, &job.levels, next_pixel_buffer(loader)) < 0) {
+      free_texture_levels(&job.levels);
+    }
+  }
+  if (!loaded.empty()) {
+    upload_material_map_table(textures);
+  }
+  return pending;
+}
+
+/**
+ * Notes that material is drawn with one pixel covering uvPerPixel uv units, so its maps' groups need the level
+ * at which a texel covers about a pixel. Call for every visible mesh between calls to stream_material_levels().
+ */
+void request_material_level(material_textures_t *textures, unsigned int material, float uvPerPixel) {
+  if (4 * (size_t)material + 3 >= textures->table.size()) {
+    return;
+  }
+  for (int entry : {0, 2}) {
+    texture_group_t &group = textures->groups[textures->table[4 * material + entry]];
+    const texture_level_t &base = group.shape.levels[0];
+    float texelsPerPixel = uvPerPixel * (base.width > base.height ? base.width : base.height);
+    uint32_t level = texelsPerPixel > 1.0f ? (uint32_t)log2f(texelsPerPixel) : 0;
+    if (level >= group.shape.levelCount) {
+      level = group.shape.levelCount - 1;
+    }
+    if (level < group.neededLevel) {
+      group.neededLevel = level;
+    }
+    for (uint32_t l = level; l < group.shape.levelCount; l++) {
+      group.lastNeeded[l] = textures->frame;
+    }
+  }
+}
+
+/**
+ * Frees the finest resident level of the group, other than except, whose finest level was requested the longest
+ * time ago. Levels requested since the last stream and those kept by TEXTURE_RESIDENT_SIZE are never evicted.
+ * Returns false if there was nothing to evict.
+ */
+static bool evict_least_recently_used(material_textures_t *textures, const texture_group_t *except) {
+  texture_group_t *oldest = NULL;
+  for (texture_group_t &group : textures->groups) {
+    if (&group == except || group.streamingLevel >= 0 || group.residentLevel >= coarse_level(&group.shape) ||
+        group.lastNeeded[group.residentLevel] == textures->frame) {
+      continue;
+    }
+    if (oldest == NULL || group.lastNeeded[group.residentLevel] < oldest->lastNeeded[oldest->residentLevel]) {
+      oldest = &group;
+    }
+  }
+  if (oldest == NULL) {
+    return false;
+  }
+  uint32_t level = oldest->residentLevel++;
+  set_texture_array_base_level(oldest->texture, oldest->residentLevel);
+  allocate_texture_array_level(oldest->texture, &oldest->shape, level, 0);
+  textures->residentBytes -= level_bytes(oldest, level);
+  return true;
+}
+
+/**
+ * Streams the groups one level finer at a time towards the levels requested since the last call, uploading at
+ * most budget bytes of layers. A level is only sampled once all of its group's layers are in, which may take
+ * several frames. To make room, the least recently requested fine levels are evicted, so the groups' levels
+ * stay within residencyBudget bytes of VRAM as far as the levels in use allow. Call once per frame.
+ */
+void stream_material_levels(material_textures_t *textures, texture_loader_t *loader, size_t budget,
+                            size_t residencyBudget) {
+  // Growing groups may have pushed the levels past the budget.
+  while (textures->residentBytes > residencyBudget && evict_least_recently_used(textures, NULL)) {
+  }
+  for (texture_group_t &group : textures->groups) {
+    if (group.streamingLevel < 0 && group.neededLevel < group.residentLevel && group.layerCount > 0) {
+      uint32_t level = group.residentLevel - 1;
+      size_t bytes = level_bytes(&group, level);
+      while (textures->residentBytes + bytes > residencyBudget && evict_least_recently_used(textures, &group)) {
+      }
+      if (textures->residentBytes + bytes <= residencyBudget) {
+        allocate_texture_array_level(group.texture, &group.shape, level, group.layerCapacity);
+        textures->residentBytes += bytes;
+        group.streamingLevel = level;
+        group.streamedLayers = 0;
+      }
+    }
+    if (group.streamingLevel < 0) {
+      continue;
+    }
+
+    uint32_t level = group.streamingLevel;
+    while (group.streamedLayers < group.layerCount && budget > 0) {
+      const texture_levels_t &layer = group.layers[group.streamedLayers];
+      if (layer.data != NULL) {
+        upload_texture_layer(group.texture, group.streamedLayers, &layer, level, level, next_pixel_buffer(loader));
+        budget = layer.levels[level].size < budget ? budget - layer.levels[level].size : 0;
+      }
+      group.streamedLayers++;
+    }
+    if (group.streamedLayers == group.layerCount) {
+      set_texture_array_base_level(group.texture, level);
+      group.residentLevel = level;
+      group.streamingLevel = -1;
+    }
+  }
+
+  for (texture_group_t &group : textures->groups) {
+    group.neededLevel = group.shape.levelCount - 1;
+  }
+  textures->frame++;
+}
+
+// Every map file the materials use, e.g. to watch them for changes.
+std::vector<std::string> material_map_paths(const material_textures_t *textures) {
+  std::vector<std::string> paths;
+  for (const auto &map : textures->maps) {
+    paths.push_back(map.first);
+  }
+  return paths;
+}
+
+// Binds every group to its texture unit, from MATERIAL_TEXTURE_UNIT on. Once per frame covers all draws.
+void bind_material_textures(const material_textures_t *textures) {
+  for (size_t g = 0; g < textures->groups.size(); g++) {
+    glActiveTexture(GL_TEXTURE0 + MATERIAL_TEXTURE_UNIT + g);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textures->groups[g].texture);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
+
+// Points the program's textureGroups samplers at the groups' units. The program has to be in use.
+void set_material_texture_units(unsigned int program) {
+  int units[MAX_TEXTURE_GROUPS];
+  for (int g = 0; g < MAX_TEXTURE_GROUPS; g++) {
+    units[g] = MATERIAL_TEXTURE_UNIT + g;
+  }
+  glUniform1iv(glGetUniformLocation(program, "textureGroups"), MAX_TEXTURE_GROUPS, units);
+}
+
+// Connects the program's MaterialMaps block to the table. Programs that do not use it are left alone.
+void bind_material_maps_block(unsigned int program) {
+  unsigned int block = glGetUniformBlockIndex(program, "MaterialMaps");
+  if (block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, block, MATERIAL_MAPS_BLOCK_BINDING);
+  }
+}
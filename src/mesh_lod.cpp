@@ -0,0 +1,402 @@
+#include <mesh_lod.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+// Sum of squared distances to a set of planes, each weighted by the area of its triangle (Garland & Heckbert).
+typedef struct {
+  float xx, xy, xz, yy, yz, zz; // A = n n^T
+  float x, y, z;                // b = d n
+  float w;                      // c = d^2
+  float area;                   // sum of the weights
+} quadric_t;
+
+// Moving vertex from onto vertex to, at the given quadric error.
+typedef struct {
+  float cost;
+  unsigned int from;
+  unsigned int to;
+} collapse_t;
+
+static void add_plane(quadric_t *q, const aiVector3D &n, float d, float weight) {
+  q->xx += weight * n.x * n.x;
+  q->xy += weight * n.x * n.y;
+  q->xz += weight * n.x * n.z;
+  q->yy += weight * n.y * n.y;
+  q->yz += weight * n.y * n.z;
+  q->zz += weight * n.z * n.z;
+  q->x += weight * d * n.x;
+  q->y += weight * d * n.y;
+  q->z += weight * d * n.z;
+  q->w += weight * d * d;
+  q->area += weight;
+}
+
+static void add_quadric(quadric_t *q, const quadric_t &other) {
+  q->xx += other.xx;
+  q->xy += other.xy;
+  q->xz += other.xz;
+  q->yy += other.yy;
+  q->yz += other.yz;
+  q->zz += other.zz;
+  q->x += other.x;
+  q->y += other.y;
+  q->z += other.z;
+  q->w += other.w;
+  q->area += other.area;
+}
+
+// Mean squared distance of p to the quadric's planes.
+static float quadric_error(const quadric_t &q, const aiVector3D &p) {
+  if (q.area <= 0.0f) {
+    return 0.0f;
+  }
+  float e = q.xx * p.x * p.x + q.yy * p.y * p.y + q.zz * p.z * p.z +
+            2.0f * (q.xy * p.x * p.y + q.xz * p.x * p.z + q.yz * p.y * p.z) +
+            2.0f * (q.x * p.x + q.y * p.y + q.z * p.z) + q.w;
+  // Rounding can take it slightly below zero.
+  return fmaxf(e, 0.0f) / q.area;
+}
+
+static aiVector3D cross(const aiVector3D &a, const aiVector3D &b) {
+  return aiVector3D(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// FNV-1a over the bits of the position.
+static uint64_t hash_position(const aiVector3D &p) {
+  const unsigned char *data = (const unsigned char *)&p;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < sizeof(aiVector3D); i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// True if moving from onto to would turn one of the triangles around from over, or squash it to a line,
+// rather than just remove it. Triangles are the ones adjacent[0, count), local vertex ids.
+static bool collapse_flips(const aiVector3D *positions, const unsigned int *triangles, const unsigned int *adjacent,
+                           unsigned int count, unsigned int from, unsigned int to) {
+  for (unsigned int a = 0; a < count; a++) {
+    const unsigned int *triangle = triangles + 3 * adjacent[a];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue; // collapses away
+    }
+    aiVector3D before[3], after[3];
+    for (int corner = 0; corner < 3; corner++) {
+      before[corner] = positions[triangle[corner]];
+      after[corner] = triangle[corner] == from ? positions[to] : before[corner];
+    }
+    aiVector3D oldNormal = cross(before[1] - before[0], before[2] - before[0]);
+    aiVector3D newNormal = cross(after[1] - after[0], after[2] - after[0]);
+    float oldLength = oldNormal.Length();
+    // Already degenerate, nothing to flip.
+    if (oldLength == 0.0f) {
+      continue;
+    }
+    // More than about 75 degrees of rotation.
+    if (oldNormal * newNormal <= 0.25f * oldLength * newNormal.Length()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Simplifies the triangles of one mesh by repeatedly collapsing a vertex onto a neighbour, until at most
+ * targetIndexCount indices are left, no collapse within maxError remains, or nothing can be collapsed anymore.
+ * Vertices only ever move onto existing ones, so the result indexes the mesh's vertices like the input
+ * (absolute, into the model's streams) and needs no vertex data of its own.
+ * Vertices on borders and attribute seams never move, so the silhouette and the texture layout survive.
+ * Every pass collapses the cheapest vertices that don't share a triangle, by their quadric error.
+ * Writes up to indexCount indices to destination and the largest error it accepted, in world units, to error.
+ * Returns the number of indices written.
+ */
+size_t simplify_mesh(const model_t *model, const mesh_range_t &range, const unsigned int *indices, size_t indexCount,
+                     size_t targetIndexCount, float maxError, unsigned int *destination, float *error) {
+  unsigned int base = range.vertexOffset;
+  unsigned int count = range.vertexCount;
+  const aiVector3D *positions = model->vertices + base;
+
+  std::vector<unsigned int> triangles(indexCount);
+  for (size_t i = 0; i < indexCount; i++) {
+    triangles[i] = indices[i] - base;
+  }
+
+  // Vertices that share a position, group[v] is the first of them. Open addressing, at most half full.
+  size_t tableSize = 1;
+  while (tableSize < 2 * (size_t)count) {
+    tableSize <<= 1;
+  }
+  std::vector<unsigned int> table(tableSize, ~0u);
+  std::vector<unsigned int> group(count);
+  std::vector<unsigned int> groupSize(count, 0);
+  for (unsigned int v = 0; v < count; v++) {
+    size_t slot = hash_position(positions[v]) & (tableSize - 1);
+    while (table[slot] != ~0u && memcmp(&positions[table[slot]], &positions[v], sizeof(aiVector3D)) != 0) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (table[slot] == ~0u) {
+      table[slot] = v;
+    }
+    group[v] = table[slot];
+    groupSize[group[v]]++;
+  }
+
+  // Edges without exactly two triangles are borders (or non-manifold), and their vertices are locked.
+  // So are seams, i.e. positions shared by several vertices, which would tear open if only one of them moved.
+  std::unordered_map<uint64_t, unsigned int> edgeUses;
+  for (size_t i = 0; i < indexCount; i += 3) {
+    for (int corner = 0; corner < 3; corner++) {
+      unsigned int a = group[triangles[i + corner]];
+      unsigned int b = group[triangles[i + (corner + 1) % 3]];
+      edgeUses[a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a]++;
+    }
+  }
+  std::vector<bool> border(count, false);
+  for (const auto &edge : edgeUses) {
+    if (edge.second != 2) {
+      border[edge.first >> 32] = true;
+      border[edge.first & 0xffffffffu] = true;
+    }
+  }
+  std::vector<bool> locked(count);
+  for (unsigned int v = 0; v < count; v++) {
+    locked[v] = groupSize[group[v]] > 1 || border[group[v]];
+  }
+
+  std::vector<quadric_t> quadrics(count, quadric_t{});
+  for (size_t i = 0; i < indexCount; i += 3) {
+    const aiVector3D &a = positions[triangles[i]];
+    aiVector3D normal = cross(positions[triangles[i + 1]] - a, positions[triangles[i + 2]] - a);
+    float length = normal.Length();
+    if (length == 0.0f) {
+      continue;
+    }
+    normal /= length;
+    for (int corner = 0; corner < 3; corner++) {
+      add_plane(&quadrics[triangles[i + corner]], normal, -(normal * a), 0.5f * length);
+    }
+  }
+
+  float maxCost = 0.0f;
+  size_t targetTriangles = targetIndexCount / 3;
+  std::vector<unsigned int> adjacencyOffsets;
+  std::vector<unsigned int> adjacency;
+  std::vector<unsigned int> fill;
+  std::vector<collapse_t> candidates;
+  std::vector<unsigned int> collapse(count);
+  std::vector<bool> touched(count);
+  while (triangles.size() / 3 > targetTriangles) {
+    // Triangles around every vertex, as offsets into one array.
+    adjacencyOffsets.assign(count + 1, 0);
+    for (unsigned int vertex : triangles) {
+      adjacencyOffsets[vertex + 1]++;
+    }
+    for (unsigned int v = 0; v < count; v++) {
+      adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    adjacency.resize(triangles.size());
+    fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangles.size(); i++) {
+      adjacency[fill[triangles[i]]++] = i / 3;
+    }
+
+    // The cheapest way to move every free vertex onto a neighbour. Seam vertices are no target,
+    // since it would be ambiguous which of the vertices at that position the moved triangles should use.
+    candidates.clear();
+    for (unsigned int v = 0; v < count; v++) {
+      if (locked[v]) {
+        continue;
+      }
+      collapse_t best = {INFINITY, v, v};
+      for (unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++) {
+        for (int corner = 0; corner < 3; corner++) {
+          unsigned int u = triangles[3 * adjacency[a] + corner];
+          if (u == v || groupSize[group[u]] > 1) {
+            continue;
+          }
+          float cost = quadric_error(quadrics[v], positions[u]);
+          if (cost < best.cost) {
+            best.cost = cost;
+            best.to = u;
+          }
+        }
+      }
+      if (best.cost <= maxError * maxError) {
+        candidates.push_back(best);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const collapse_t &a, const collapse_t &b) { return a.cost < b.cost || (a.cost == b.cost && a.from < b.from); });
+
+    // Collapses within one pass must not share a triangle, so each is checked against the triangles it actually changes.
+    for (unsigned int v = 0; v < count; v++) {
+      collapse[v] = v;
+    }
+    touched.assign(count, false);
+    size_t remaining = triangles.size() / 3;
+    size_t collapses = 0;
+    for (const collapse_t &candidate : candidates) {
+      if (remaining <= targetTriangles) {
+        break;
+      }
+      unsigned int begin = adjacencyOffsets[candidate.from];
+      unsigned int around = adjacencyOffsets[candidate.from + 1] - begin;
+      if (touched[candidate.from] || touched[candidate.to] ||
+          collapse_flips(positions, triangles.data(), &adjacency[begin], around, candidate.from, candidate.to)) {
+        continue;
+      }
+
+      for (unsigned int a = begin; a < begin + around; a++) {
+        const unsigned int *triangle = &triangles[3 * adjacency[a]];
+        remaining -= triangle[0] == candidate.to || triangle[1] == candidate.to || triangle[2] == candidate.to;
+        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+      }
+      collapse[candidate.from] = candidate.to;
+      add_quadric(&quadrics[candidate.to], quadrics[candidate.from]);
+      maxCost = fmaxf(maxCost, candidate.cost);
+      collapses++;
+    }
+    if (collapses == 0) {
+      break;
+    }
+
+    // Drop the triangles that collapsed to a line.
+    size_t kept = 0;
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      unsigned int a = collapse[triangles[i]];
+      unsigned int b = collapse[triangles[i + 1]];
+      unsigned int c = collapse[triangles[i + 2]];
+      if (a != b && b != c && c != a) {
+        triangles[kept++] = a;
+        triangles[kept++] = b;
+        triangles[kept++] = c;
+      }
+    }
+    triangles.resize(kept);
+  }
+
+  for (size_t i = 0; i < triangles.size(); i++) {
+    destination[i] = triangles[i] + base;
+  }
+  *error = sqrtf(maxCost);
+  return triangles.size();
+}
+
+/**
+ * Builds up to MESH_MAX_LODS - 1 coarser levels of the mesh, each simplified from the previous one to about
+ * LOD_REDUCTION of its triangles, and appends their indices to lodIndices. The levels' indexOffsets are relative
+ * to lodIndices until build_lods() places them. The errors add up from level to level, so they only grow.
+ * Meshes that are not pure triangle lists get no levels.
+ */
+void build_mesh_lods(const model_t *model, mesh_range_t *range, std::vector<unsigned int> *lodIndices) {
+  range->lodCount = 0;
+  if (range->indexCount == 0 || range->indexCount % 3 != 0) {
+    return;
+  }
+
+  float maxError = LOD_MAX_ERROR * 0.5f * (range->boundsMax - range->boundsMin).Length();
+  const unsigned int *indices = model->indices + range->indexOffset;
+  std::vector<unsigned int> source(indices, indices + range->indexCount);
+  std::vector<unsigned int> simplified(range->indexCount);
+  float error = 0.0f;
+  while (range->lodCount < MESH_MAX_LODS - 1) {
+    size_t target = (size_t)(source.size() / 3 * LOD_REDUCTION) * 3;
+    float levelError = 0.0f;
+    size_t count = simplify_mesh(model, *range, source.data(), source.size(), target, maxError - error,
+                                 simplified.data(), &levelError);
+    if (count == 0 || count > source.size() * LOD_MIN_REDUCTION) {
+      break;
+    }
+
+    error += levelError;
+    mesh_lod_t &lod = range->lods[range->lodCount++];
+    lod.indexOffset = lodIndices->size();
+    lod.indexCount = count;
+    lod.error = error;
+    lodIndices->insert(lodIndices->end(), simplified.begin(), simplified.begin() + count);
+    source.assign(simplified.begin(), simplified.begin() + count);
+  }
+}
+
+/**
+ * Builds the levels of all meshes in parallel and appends their indices to the index stream, mesh by mesh,
+ * behind all full resolution indices. The arena is reallocated to make room. Returns -1 if that fails.
+ */
+int build_lods(model_t *model, lod_stats_t *stats) {
+  std::vector<std::vector<unsigned int>> meshLods(model->meshes.size());
+  parallel_for(model->meshes.size(), [&](size_t m) {
+    build_mesh_lods(model, &model->meshes[m], &meshLods[m]);
+  });
+
+  size_t added = 0;
+  for (const std::vector<unsigned int> &lodIndices : meshLods) {
+    added += lodIndices.size();
+  }
+  unsigned int cursor = model->indexCount;
+  if (added > 0 && grow_model_indices(model, model->indexCount + added) < 0) {
+    for (mesh_range_t &range : model->meshes) {
+      range.lodCount = 0;
+    }
+    return -1;
+  }
+
+  for (size_t m = 0; m < model->meshes.size(); m++) {
+    mesh_range_t &range = model->meshes[m];
+    std::copy(meshLods[m].begin(), meshLods[m].end(), model->indices + cursor);
+    for (unsigned int l = 0; l < range.lodCount; l++) {
+      range.lods[l].indexOffset += cursor;
+    }
+    cursor += meshLods[m].size();
+  }
+  model->indexOffset = model->indexCount;
+
+  for (const mesh_range_t &range : model->meshes) {
+    stats->meshes++;
+    stats->simplifiedMeshes += range.lodCount > 0;
+    for (unsigned int level = 0; level < MESH_MAX_LODS; level++) {
+      unsigned int finest = level < range.lodCount ? level : range.lodCount;
+      stats->triangles[level] += (finest == 0 ? range.indexCount : range.lods[finest - 1].indexCount) / 3;
+    }
+  }
+  stats->indices += added;
+  return 0;
+}
+
+void print_lod_stats(const lod_stats_t *stats) {
+  printf("LODs: %zu/%zu meshes simplified, triangles per level", stats->simplifiedMeshes, stats->meshes);
+  for (unsigned int level = 0; level < MESH_MAX_LODS; level++) {
+    printf("%s%zu", level == 0 ? " " : " / ", stats->triangles[level]);
+  }
+  printf(", %.2f MB of extra indices\n", sizeof(unsigned int) * stats->indices / 1e6);
+}
+
+/**
+ * Picks the coarsest level of the mesh whose error still projects to at most pixelError pixels,
+ * measured at the point of the mesh's bounding sphere that is closest to the eye.
+ * lodScale is the size in pixels of one world unit at distance one, i.e. viewport height / (2 tan(fovy / 2)).
+ * Returns 0 (full resolution) for meshes without levels, a lodScale of 0, or an eye within the bounds.
+ */
+unsigned int select_mesh_lod(const mesh_range_t &range, const float eye[3], float lodScale, float pixelError) {
+  if (range.lodCount == 0 || lodScale <= 0.0f) {
+    return 0;
+  }
+
+  aiVector3D center = (range.boundsMin + range.boundsMax) * 0.5f;
+  float radius = (range.boundsMax - center).Length();
+  float distance = (center - aiVector3D(eye[0], eye[1], eye[2])).Length() - radius;
+  if (distance <= 0.0f) {
+    return 0;
+  }
+
+  unsigned int lod = 0;
+  while (lod < range.lodCount && range.lods[lod].error * lodScale <= pixelError * distance) {
+    lod++;
+  }
+  return lod;
+}
@@ -0,0 +1,386 @@
+#include <mesh_optimize.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Size of the LRU cache the triangle order is optimised for (Forsyth's recommendation).
+#define FORSYTH_CACHE_SIZE 32
+
+// How much worse than the cache optimised order a cluster may get while being split for overdraw.
+#define OVERDRAW_THRESHOLD 1.05f
+
+/**
+ * Simulates a FIFO post-transform cache of cacheSize entries over the triangle list and counts the misses,
+ * i.e. the number of vertex shader invocations. Indices are local to the mesh, i.e. in [0, vertexCount).
+ */
+size_t count_cache_misses(const unsigned int *indices, size_t indexCount, unsigned int vertexCount, unsigned int cacheSize) {
+  // A vertex is cached if it entered the FIFO less than cacheSize misses ago.
+  std::vector<size_t> timestamps(vertexCount, 0);
+  size_t time = cacheSize + 1;
+  size_t misses = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    unsigned int vertex = indices[i];
+    if (time - timestamps[vertex] > cacheSize) {
+      timestamps[vertex] = time++;
+      misses++;
+    }
+  }
+  return misses;
+}
+
+static float forsyth_vertex_score(int cachePosition, unsigned int activeTriangles) {
+  if (activeTriangles == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // The last triangle's vertices get a fixed score, so the next triangle does not simply reuse its edge.
+      score = 0.75f;
+    } else {
+      float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = powf(1.0f - (cachePosition - 3) * scaler, 1.5f);
+    }
+  }
+
+  // Vertices with few remaining triangles are boosted, to get rid of them before they leave the cache.
+  score += 2.0f * powf((float)activeTriangles, -0.5f);
+  return score;
+}
+
+/**
+ * Reorders the triangles for the post-transform vertex cache.
+ * This is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emit the triangle with the best score,
+ * where vertices score high if they are in the simulated LRU cache or have few triangles left.
+ */
+static void optimize_vertex_cache(unsigned int *destination, const unsigned int *indices, size_t indexCount, unsigned int vertexCount) {
+  size_t triangleCount = indexCount / 3;
+
+  // Triangles adjacent to each vertex, as a compressed list.
+  std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < indexCount; i++) {
+    adjacencyOffsets[indices[i] + 1]++;
+  }
+  for (unsigned int v = 0; v < vertexCount; v++) {
+    adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+  }
+  std::vector<unsigned int> activeTriangles(vertexCount, 0);
+  std::vector<unsigned int> adjacency(indexCount);
+  for (size_t i = 0; i < indexCount; i++) {
+    unsigned int vertex = indices[i];
+    adjacency[adjacencyOffsets[vertex] + activeTriangles[vertex]++] = i / 3;
+  }
+
+  std::vector<int> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (unsigned int v = 0; v < vertexCount; v++) {
+    vertexScores[v] = forsyth_vertex_score(-1, activeTriangles[v]);
+  }
+
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  for (size_t t = 0; t < triangleCount; t++) {
+    triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+  }
+
+  // Three extra slots hold the vertices that are pushed out by the newest triangle.
+  unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+  unsigned int cacheCount = 0;
+  size_t scanCursor = 0;
+  long bestTriangle = -1;
+
+  for (size_t output = 0; output < triangleCount; output++) {
+    // If the cache offers no candidate, continue with the next triangle not emitted yet.
+    if (bestTriangle < 0) {
+      while (emitted[scanCursor]) {
+        scanCursor++;
+      }
+      bestTriangle = scanCursor;
+    }
+
+    emitted[bestTriangle] = true;
+    const unsigned int *triangle = &indices[3 * bestTriangle];
+    memcpy(&destination[3 * output], triangle, 3 * sizeof(unsigned int));
+
+    // Move the triangle's vertices to the front of the cache.
+    unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+    unsigned int newCount = 0;
+    for (int i = 0; i < 3; i++) {
+      newCache[newCount++] = triangle[i];
+    }
+    for (unsigned int i = 0; i < cacheCount; i++) {
+      unsigned int vertex = cache[i];
+      if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+        newCache[newCount++] = vertex;
+      }
+    }
+
+    for (int i = 0; i < 3; i++) {
+      unsigned int vertex = triangle[i];
+      unsigned int *begin = &adjacency[adjacencyOffsets[vertex]];
+      unsigned int *end = begin + activeTriangles[vertex];
+      unsigned int *found = std::find(begin, end, (unsigned int)bestTriangle);
+      *found = *(end - 1);
+      activeTriangles[vertex]--;
+    }
+
+    // Rescore every vertex that was touched, including the ones falling out of the cache.
+    for (unsigned int i = 0; i < newCount; i++) {
+      unsigned int vertex = newCache[i];
+      int position = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+      cachePositions[vertex] = position;
+      float score = forsyth_vertex_score(position, activeTriangles[vertex]);
+      float delta = score - vertexScores[vertex];
+      vertexScores[vertex] = score;
+      for (unsigned int a = 0; a < activeTriangles[vertex]; a++) {
+        triangleScores[adjacency[adjacencyOffsets[vertex] + a]] += delta;
+      }
+    }
+
+    cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+    memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+
+    // The next triangle is the best one around the cached vertices.
+    bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (unsigned int i = 0; i < cacheCount; i++) {
+      unsigned int vertex = cache[i];
+      for (unsigned int a = 0; a < activeTriangles[vertex]; a++) {
+        unsigned int candidate = adjacency[adjacencyOffsets[vertex] + a];
+        if (triangleScores[candidate] > bestScore) {
+          bestScore = triangleScores[candidate];
+          bestTriangle = candidate;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Reorders clusters of the cache optimised triangle list to reduce overdraw, following Sander et al.'s
+ * "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+ * The list is cut wherever the cache would start from scratch anyway (all three vertices miss),
+ * and further wherever the running ACMR stays within OVERDRAW_THRESHOLD of the cluster's own.
+ * Clusters that face away from the mesh centre are then drawn first, since they tend to occlude the rest.
+ */
+static void optimize_overdraw(unsigned int *indices, size_t indexCount, unsigned int vertexCount,
+                              const aiVector3D *positions) {
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Hard boundaries: triangles where every vertex misses the cache.
+  std::vector<size_t> hardBoundaries;
+  {
+    std::vector<size_t> timestamps(vertexCount, 0);
+    size_t time = VERTEX_CACHE_MEASURE_SIZE + 1;
+    for (size_t t = 0; t < triangleCount; t++) {
+      int misses = 0;
+      for (int i = 0; i < 3; i++) {
+        unsigned int vertex = indices[3 * t + i];
+        if (time - timestamps[vertex] > VERTEX_CACHE_MEASURE_SIZE) {
+          timestamps[vertex] = time++;
+          misses++;
+        }
+      }
+      if (t == 0 || misses == 3) {
+        hardBoundaries.push_back(t);
+      }
+    }
+    hardBoundaries.push_back(triangleCount);
+  }
+
+  // Soft boundaries: split each hard cluster while it keeps (almost) its cache efficiency.
+  std::vector<size_t> clusters;
+  for (size_t c = 0; c + 1 < hardBoundaries.size(); c++) {
+    size_t start = hardBoundaries[c];
+    size_t end = hardBoundaries[c + 1];
+    float clusterAcmr = (float)count_cache_misses(&indices[3 * start], 3 * (end - start), vertexCount,
+                                                  VERTEX_CACHE_MEASURE_SIZE) / (end - start);
+    float threshold = clusterAcmr * OVERDRAW_THRESHOLD;
+
+    std::vector<size_t> timestamps(vertexCount, 0);
+    size_t time = VERTEX_CACHE_MEASURE_SIZE + 1;
+    size_t misses = 0;
+    size_t clusterStart = start;
+    clusters.push_back(start);
+    for (size_t t = start; t < end; t++) {
+      for (int i = 0; i < 3; i++) {
+        unsigned int vertex = indices[3 * t + i];
+        if (time - timestamps[vertex] > VERTEX_CACHE_MEASURE_SIZE) {
+          timestamps[vertex] = time++;
+          misses++;
+        }
+      }
+      if (t + 1 < end && (float)misses / (t + 1 - clusterStart) <= threshold) {
+        clusters.push_back(t + 1);
+        clusterStart = t + 1;
+        misses = 0;
+        // Start the next cluster with a cold cache, like it will be after sorting.
+        time += VERTEX_CACHE_MEASURE_SIZE + 1;
+      }
+    }
+  }
+  clusters.push_back(triangleCount);
+
+  // Area weighted centroid and normal of every cluster, and of the whole mesh.
+  size_t clusterCount = clusters.size() - 1;
+  std::vector<aiVector3D> centroids(clusterCount), normals(clusterCount);
+  std::vector<float> areas(clusterCount, 0.0f);
+  aiVector3D meshCentroid(0.0f, 0.0f, 0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusterCount; c++) {
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const aiVector3D &a = positions[indices[3 * t]];
+      const aiVector3D &b = positions[indices[3 * t + 1]];
+      const aiVector3D &p = positions[indices[3 * t + 2]];
+      aiVector3D e1 = b - a, e2 = p - a;
+      aiVector3D cross(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+      float area = sqrtf(cross.x * cross.x + cross.y * cross.y + cross.z * cross.z);
+      aiVector3D center = (a + b + p) * (1.0f / 3.0f);
+      centroids[c] = centroids[c] + center * area;
+      normals[c] = normals[c] + cross;
+      areas[c] += area;
+    }
+    meshCentroid = meshCentroid + centroids[c];
+    meshArea += areas[c];
+    if (areas[c] > 0.0f) {
+      centroids[c] = centroids[c] * (1.0f / areas[c]);
+    }
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid = meshCentroid * (1.0f / meshArea);
+  }
+
+  std::vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++) {
+    aiVector3D n = normals[c];
+    float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+    aiVector3D d = centroids[c] - meshCentroid;
+    sortKeys[c] = length > 0.0f ? (d.x * n.x + d.y * n.y + d.z * n.z) / length : 0.0f;
+  }
+
+  std::vector<size_t> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<unsigned int> sorted;
+  sorted.reserve(indexCount);
+  for (size_t c : order) {
+    sorted.insert(sorted.end(), &indices[3 * clusters[c]], &indices[3 * clusters[c + 1]]);
+  }
+  memcpy(indices, sorted.data(), indexCount * sizeof(unsigned int));
+}
+
+/**
+ * Renumbers the vertices in order of first use, so the vertex fetch walks the buffers front to back.
+ * Vertices that are never referenced move to the end. All streams are permuted alike.
+ */
+static void optimize_vertex_fetch(model_t *model, const mesh_range_t &range, unsigned int *indices) {
+  std::vector<unsigned int> remap(range.vertexCount, ~0u);
+  unsigned int next = 0;
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    unsigned int &vertex = indices[i];
+    if (remap[vertex] == ~0u) {
+      remap[vertex] = next++;
+    }
+    vertex = remap[vertex];
+  }
+  for (unsigned int v = 0; v < range.vertexCount; v++) {
+    if (remap[v] == ~0u) {
+      remap[v] = next++;
+    }
+  }
+
+  // Stream 0 are the indices, the others are the vertex attributes.
+  std::vector<char> scratch;
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    char *data = (char *)model_stream(model, stream) + stride * range.vertexOffset;
+    scratch.assign(data, data + stride * range.vertexCount);
+    for (unsigned int v = 0; v < range.vertexCount; v++) {
+      memcpy(data + stride * remap[v], &scratch[stride * v], stride);
+    }
+  }
+}
+
+/**
+ * Optimises one mesh in place: triangles for the vertex cache, then clusters of them for overdraw,
+ * then the vertices for fetch locality. The mesh keeps its range, so draw calls are unaffected.
+ * Adds the mesh's before/after cache misses to stats.
+ */
+void optimize_mesh(model_t *model, const mesh_range_t &range, optimize_stats_t *stats) {
+  // Everything is drawn as GL_TRIANGLES, anything else cannot be reordered meaningfully.
+  if (range.indexCount < 3 || range.indexCount % 3 != 0) {
+    return;
+  }
+
+  // Work on mesh local indices.
+  unsigned int *meshIndices = model->indices + range.indexOffset;
+  std::vector<unsigned int> local(range.indexCount);
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    local[i] = meshIndices[i] - range.vertexOffset;
+  }
+
+  std::vector<bool> used(range.vertexCount, false);
+  size_t usedVertices = 0;
+  for (unsigned int index : local) {
+    if (!used[index]) {
+      used[index] = true;
+      usedVertices++;
+    }
+  }
+
+  stats->triangles += range.indexCount / 3;
+  stats->vertices += usedVertices;
+  stats->missesBefore += count_cache_misses(local.data(), local.size(), range.vertexCount, VERTEX_CACHE_MEASURE_SIZE);
+
+  std::vector<unsigned int> optimized(range.indexCount);
+  optimize_vertex_cache(optimized.data(), local.data(), local.size(), range.vertexCount);
+  optimize_overdraw(optimized.data(), optimized.size(), range.vertexCount, model->vertices + range.vertexOffset);
+  optimize_vertex_fetch(model, range, optimized.data());
+
+  stats->missesAfter += count_cache_misses(optimized.data(), optimized.size(), range.vertexCount, VERTEX_CACHE_MEASURE_SIZE);
+
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    meshIndices[i] = optimized[i] + range.vertexOffset;
+  }
+}
+
+/**
+ * Optimises all meshes of the model, in parallel since their ranges do not overlap.
+ */
+void optimize_model(model_t *model, optimize_stats_t *stats) {
+  std::vector<optimize_stats_t> meshStats(model->meshes.size(), optimize_stats_t{});
+  parallel_for(model->meshes.size(), [&](size_t m) {
+    optimize_mesh(model, model->meshes[m], &meshStats[m]);
+  });
+
+  for (const optimize_stats_t &meshStat : meshStats) {
+    stats->triangles += meshStat.triangles;
+    stats->vertices += meshStat.vertices;
+    stats->missesBefore += meshStat.missesBefore;
+    stats->missesAfter += meshStat.missesAfter;
+  }
+}
+
+/**
+ * Prints ACMR (misses per triangle, 0.5 is ideal for large meshes) and ATVR (misses per vertex, 1.0 is ideal).
+ */
+void print_optimize_stats(const optimize_stats_t *stats) {
+  if (stats->triangles == 0 || stats->vertices == 0) {
+    return;
+  }
+  printf("Vertex cache (FIFO %d): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f over %zu triangles\n",
+         VERTEX_CACHE_MEASURE_SIZE,
+         (double)stats->missesBefore / stats->triangles, (double)stats->missesAfter / stats->triangles,
+         (double)stats->missesBefore / stats->vertices, (double)stats->missesAfter / stats->vertices,
+         stats->triangles);
+}
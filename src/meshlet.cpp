@@ -0,0 +1,283 @@
+#include <meshlet.h>
+#include <thread_pool.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Bounding sphere and normal cone of the meshlet's triangles, which start at indices.
+static void compute_meshlet_bounds(const model_t *model, const unsigned int *indices, meshlet_t *meshlet) {
+  // Sphere around the centre of the bounding box, good enough for clusters this small.
+  aiVector3D lower = model->vertices[indices[0]];
+  aiVector3D upper = lower;
+  for (unsigned int i = 1; i < meshlet->indexCount; i++) {
+    const aiVector3D &p = model->vertices[indices[i]];
+    lower = aiVector3D(fminf(lower.x, p.x), fminf(lower.y, p.y), fminf(lower.z, p.z));
+    upper = aiVector3D(fmaxf(upper.x, p.x), fmaxf(upper.y, p.y), fmaxf(upper.z, p.z));
+  }
+  aiVector3D center = (lower + upper) * 0.5f;
+  float radius = 0.0f;
+  for (unsigned int i = 0; i < meshlet->indexCount; i++) {
+    radius = fmaxf(radius, (model->vertices[indices[i]] - center).Length());
+  }
+
+  // The cone's axis is the average facing, its angle the largest deviation from it.
+  std::vector<aiVector3D> normals;
+  aiVector3D axis(0.0f, 0.0f, 0.0f);
+  for (unsigned int i = 0; i + 3 <= meshlet->indexCount; i += 3) {
+    const aiVector3D &a = model->vertices[indices[i]];
+    aiVector3D ab = model->vertices[indices[i + 1]] - a;
+    aiVector3D ac = model->vertices[indices[i + 2]] - a;
+    aiVector3D normal(ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x);
+    float length = normal.Length();
+    // Degenerate triangles are never rasterised, so they don't widen the cone.
+    if (length > 0.0f) {
+      normal /= length;
+      normals.push_back(normal);
+      axis += normal;
+    }
+  }
+
+  float cutoff = 1.0f;
+  float axisLength = axis.Length();
+  if (axisLength > 0.0f) {
+    axis /= axisLength;
+    float minDot = 1.0f;
+    for (const aiVector3D &normal : normals) {
+      minDot = fminf(minDot, normal * axis);
+    }
+    // Cones of 90 degrees and more always contain a front face.
+    if (minDot > 0.0f) {
+      cutoff = sqrtf(1.0f - minDot * minDot);
+    }
+  }
+
+  meshlet->center[0] = center.x;
+  meshlet->center[1] = center.y;
+  meshlet->center[2] = center.z;
+  meshlet->radius = radius;
+  meshlet->coneAxis[0] = axis.x;
+  meshlet->coneAxis[1] = axis.y;
+  meshlet->coneAxis[2] = axis.z;
+  meshlet->coneCutoff = cutoff;
+}
+
+/**
+ * Splits the mesh into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles,
+ * and reorders its triangles so that every meshlet is a contiguous index range. Appends the meshlets to meshlets.
+ * Meshlets are grown greedily: starting from the first unused triangle, the neighbouring triangle that adds the fewest
+ * new vertices is added next, which keeps clusters compact and their normal cones narrow.
+ * Meshes that are not pure triangle lists are left alone and get no meshlets.
+ */
+void build_mesh_meshlets(model_t *model, const mesh_range_t &range, std::vector<meshlet_t> *meshlets) {
+  if (range.indexCount == 0 || range.indexCount % 3 != 0) {
+    return;
+  }
+
+  unsigned int *indices = model->indices + range.indexOffset;
+  unsigned int triangleCount = range.indexCount / 3;
+  unsigned int vertexCount = range.vertexCount;
+
+  // Triangles around every vertex, as offsets into one array.
+  std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    adjacencyOffsets[indices[i] - range.vertexOffset + 1]++;
+  }
+  for (unsigned int v = 0; v < vertexCount; v++) {
+    adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+  }
+  std::vector<unsigned int> adjacency(range.indexCount);
+  std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+  for (unsigned int i = 0; i < range.indexCount; i++) {
+    adjacency[fill[indices[i] - range.vertexOffset]++] = i / 3;
+  }
+
+  std::vector<bool> used(triangleCount, false);
+  // Meshlet (plus one) that last took the vertex, so membership needs no clearing between meshlets.
+  std::vector<unsigned int> owner(vertexCount, 0);
+  std::vector<unsigned int> reordered;
+  reordered.reserve(range.indexCount);
+
+  std::vector<unsigned int> meshletVertices;
+  unsigned int meshletId = 0;
+  unsigned int seed = 0;
+  while (true) {
+    while (seed < triangleCount && used[seed]) {
+      seed++;
+    }
+    if (seed == triangleCount) {
+      break;
+    }
+
+    meshletId++;
+    meshletVertices.clear();
+    meshlet_t meshlet = {};
+    meshlet.indexOffset = range.indexOffset + reordered.size();
+
+    unsigned int triangle = seed;
+    while (true) {
+      used[triangle] = true;
+      for (int corner = 0; corner < 3; corner++) {
+        unsigned int vertex = indices[3 * triangle + corner] - range.vertexOffset;
+        if (owner[vertex] != meshletId) {
+          owner[vertex] = meshletId;
+          meshletVertices.push_back(vertex);
+        }
+        reordered.push_back(indices[3 * triangle + corner]);
+      }
+      meshlet.indexCount += 3;
+      if (meshlet.indexCount / 3 == MESHLET_MAX_TRIANGLES) {
+        break;
+      }
+
+      // The unused neighbour that adds the fewest vertices, ties go to the earlier triangle.
+      unsigned int best = triangleCount;
+      int bestNewVertices = 3;
+      for (unsigned int vertex : meshletVertices) {
+        for (unsigned int a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+          unsigned int candidate = adjacency[a];
+          if (used[candidate]) {
+            continue;
+          }
+          int newVertices = 0;
+          for (int corner = 0; corner < 3; corner++) {
+            newVertices += owner[indices[3 * candidate + corner] - range.vertexOffset] != meshletId;
+          }
+          if (newVertices < bestNewVertices || (newVertices == bestNewVertices && candidate < best)) {
+            best = candidate;
+            bestNewVertices = newVertices;
+          }
+        }
+      }
+      if (best == triangleCount || meshletVertices.size() + bestNewVertices > MESHLET_MAX_VERTICES) {
+        break;
+      }
+      triangle = best;
+    }
+
+    meshlet.vertexCount = meshletVertices.size();
+    meshlets->push_back(meshlet);
+  }
+
+  memcpy(indices, reordered.data(), sizeof(unsigned int) * range.indexCount);
+  for (size_t m = meshlets->size() - meshletId; m < meshlets->size(); m++) {
+    meshlet_t &meshlet = (*meshlets)[m];
+    compute_meshlet_bounds(model, model->indices + meshlet.indexOffset, &meshlet);
+  }
+}
+
+/**
+ * Concatenates the meshlets built per mesh into model->meshlets, and points every mesh at its share.
+ */
+void gather_meshlets(model_t *model, const std::vector<std::vector<meshlet_t>> &meshMeshlets, meshlet_stats_t *stats) {
+  model->meshlets.clear();
+  for (size_t m = 0; m < model->meshes.size(); m++) {
+    mesh_range_t &range = model->meshes[m];
+    range.meshletOffset = model->meshlets.size();
+    // Usually already set, e.g. by the streaming loader whose render thread may be reading it.
+    if (range.meshletCount != meshMeshlets[m].size()) {
+      range.meshletCount = meshMeshlets[m].size();
+    }
+    model->meshlets.insert(model->meshlets.end(), meshMeshlets[m].begin(), meshMeshlets[m].end());
+  }
+
+  for (const meshlet_t &meshlet : model->meshlets) {
+    stats->meshlets++;
+    stats->triangles += meshlet.indexCount / 3;
+    stats->vertices += meshlet.vertexCount;
+  }
+}
+
+/**
+ * Builds the meshlets of all meshes in parallel and gathers them in model->meshlets, mesh by mesh.
+ */
+void build_meshlets(model_t *model, meshlet_stats_t *stats) {
+  std::vector<std::vector<meshlet_t>> meshMeshlets(model->meshes.size());
+  parallel_for(model->meshes.size(), [&](size_t m) {
+    build_mesh_meshlets(model, model->meshes[m], &meshMeshlets[m]);
+  });
+  gather_meshlets(model, meshMeshlets, stats);
+}
+
+void print_meshlet_stats(const meshlet_stats_t *stats) {
+  if (stats->meshlets == 0) {
+    return;
+  }
+  printf("Meshlets: %zu, on average %.1f/%d vertices and %.1f/%d triangles\n", stats->meshlets,
+         (double)stats->vertices / stats->meshlets, MESHLET_MAX_VERTICES,
+         (double)stats->triangles / stats->meshlets, MESHLET_MAX_TRIANGLES);
+}
+
+/**
+ * Extracts the frustum planes from a column major view projection matrix (Gribb & Hartmann).
+ * The view culls, but keeps every mesh at full resolution until lodScale is set.
+ */
+void make_cull_view(cull_view_t *view, const float viewProjection[4][4], const float eye[3]) {
+  for (int axis = 0; axis < 3; axis++) {
+    for (int side = 0; side < 2; side++) {
+      float *plane = view->planes[2 * axis + side];
+      float sign = side == 0 ? 1.0f : -1.0f;
+      for (int c = 0; c < 4; c++) {
+        plane[c] = viewProjection[c][3] + sign * viewProjection[c][axis];
+      }
+      float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+      for (int c = 0; c < 4; c++) {
+        plane[c] /= length;
+      }
+    }
+  }
+  memcpy(view->eye, eye, sizeof(view->eye));
+  view->cull = true;
+  view->lodScale = 0.0f;
+  view->lodPixelError = 0.0f;
+}
+
+/**
+ * Moves a world space view into the space of the model matrix, so ranges can be tested with their own bounds.
+ * The planes are renormalised and the levels compare errors and distances in the same units,
+ * which keeps both exact for rotations and uniform scales.
+ */
+void transform_cull_view(cull_view_t *local, const cull_view_t *world, const float model[4][4],
+                         const float inverseModel[4][4]) {
+  *local = *world;
+  for (int p = 0; p < 6; p++) {
+    // A point x in model space lies at model * x in world space, so the plane becomes transpose(model) * plane.
+    float *plane = local->planes[p];
+    for (int c = 0; c < 4; c++) {
+      plane[c] = 0.0f;
+      for (int r = 0; r < 4; r++) {
+        plane[c] += model[c][r] * world->planes[p][r];
+      }
+    }
+    float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    for (int c = 0; c < 4; c++) {
+      plane[c] /= length;
+    }
+  }
+  for (int r = 0; r < 3; r++) {
+    local->eye[r] = inverseModel[3][r];
+    for (int c = 0; c < 3; c++) {
+      local->eye[r] += inverseModel[c][r] * world->eye[c];
+    }
+  }
+}
+
+bool sphere_visible(const cull_view_t *view, const float center[3], float radius) {
+  for (int p = 0; p < 6; p++) {
+    const float *plane = view->planes[p];
+    if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * True if every triangle within the sphere whose normal lies in the cone faces away from the eye.
+ */
+bool cone_backfacing(const cull_view_t *view, const float center[3], float radius, const float axis[3], float cutoff) {
+  float toCenter[3] = {center[0] - view->eye[0], center[1] - view->eye[1], center[2] - view->eye[2]};
+  float distance = sqrtf(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+  float facing = toCenter[0] * axis[0] + toCenter[1] * axis[1] + toCenter[2] * axis[2];
+  return facing >= cutoff * distance + radius;
+}
@@ -0,0 +1,532 @@
+#include <model.h>
+#include <import_profile.h>
+#include <mesh_lod.h>
+#include <mesh_optimize.h>
+#include <meshlet.h>
+#include <thread_pool.h>
+#include <vertex_weld.h>
+#include <assimp/cimport.h>
+#include <assimp/material.h>
+#include <assimp/mesh.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Frees the CPU-side copy of the model.
+ * Since all streams live in one arena, it suffices to free (or unmap) that.
+ * The counts are kept, because the draw calls still need them once the data lives on the GPU.
+ */
+void free_model(model_t &model) {
+  if (model.mapping) {
+    munmap(model.mapping, model.mappingSize);
+  } else {
+    free(model.arena);
+  }
+  model.arena = NULL;
+  model.arenaSize = 0;
+  model.mapping = NULL;
+  model.mappingSize = 0;
+  model.indices = NULL;
+  model.vertices = NULL;
+  model.materialIds = NULL;
+  model.normals = NULL;
+  model.uvs = NULL;
+  model.tangents = NULL;
+  model.bitangents = NULL;
+}
+
+/**
+ * Counts the vertices and indices of the node graph, so the model can be allocated exactly.
+ * Walks the graph the same way extract_indices() does, i.e. a mesh referenced by several nodes is counted once per reference.
+ * Along the way, the graph is flattened into model->meshes, which records where each mesh lands in the arena.
+ */
+void count_model(model_t *model, struct aiNode *node, const struct aiScene *scene) {
+  for (int meshIndex = 0; meshIndex < node->mNumMeshes; meshIndex++) {
+    unsigned int meshId = node->mMeshes[meshIndex];
+    struct aiMesh *mesh = scene->mMeshes[meshId];
+
+    mesh_range_t range = {};
+    range.meshId = meshId;
+    range.materialIndex = mesh->mMaterialIndex;
+    range.vertexOffset = model->vertexCount;
+    range.vertexCount = mesh->mNumVertices;
+    range.indexOffset = model->indexCount;
+    for (int faceIdx = 0; faceIdx < mesh->mNumFaces; faceIdx++) {
+      range.indexCount += mesh->mFaces[faceIdx].mNumIndices;
+    }
+    model->meshes.push_back(range);
+
+    model->indexCount += range.indexCount;
+    model->vertexCount += mesh->mNumVertices;
+  }
+
+  for (int childIdx = 0; childIdx < node->mNumChildren; childIdx++) {
+    count_model(model, node->mChildren[childIdx], scene);
+  }
+}
+
+// Keeps every stream in the arena 16 byte aligned.
+static size_t align_stream(size_t size) {
+  return (size + 15) & ~(size_t)15;
+}
+
+/**
+ * Computes the (16 byte aligned) size of every stream of the arena and returns the total.
+ * The order is: indices, positions, material ids, normals, uvs, tangents, bitangents.
+ */
+size_t model_stream_sizes(const model_t *model, size_t sizes[MODEL_STREAM_COUNT]) {
+  size_t vertices = model->vertexCount;
+  sizes[0] = align_stream(sizeof(unsigned int) * model->indexCount);
+  sizes[1] = align_stream(sizeof(aiVector3D) * vertices);
+  sizes[2] = align_stream(sizeof(unsigned int) * vertices);
+  sizes[3] = align_stream(sizeof(aiVector3D) * vertices);
+  sizes[4] = align_stream(sizeof(aiVector2D) * vertices);
+  sizes[5] = align_stream(sizeof(aiVector3D) * vertices);
+  sizes[6] = align_stream(sizeof(aiVector3D) * vertices);
+
+  size_t total = 0;
+  for (int i = 0; i < MODEL_STREAM_COUNT; i++) {
+    total += sizes[i];
+  }
+  return total;
+}
+
+/**
+ * Points the streams of the model into data, which has to be at least model_stream_sizes() bytes.
+ * Each stream starts where the previous one ends.
+ */
+void layout_model(model_t *model, char *data) {
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  model_stream_sizes(model, streamSizes);
+
+  model->indices = (unsigned int*) data;
+  data += streamSizes[0];
+  model->vertices = (aiVector3D*) data;
+  data += streamSizes[1];
+  model->materialIds = (unsigned int*) data;
+  data += streamSizes[2];
+  model->normals = (aiVector3D*) data;
+  data += streamSizes[3];
+  model->uvs = (aiVector2D*) data;
+  data += streamSizes[4];
+  model->tangents = (aiVector3D*) data;
+  data += streamSizes[5];
+  model->bitangents = (aiVector3D*) data;
+}
+
+// Size of one element of the given stream, in the order of model_stream_sizes().
+size_t model_stream_stride(int stream) {
+  static const size_t strides[MODEL_STREAM_COUNT] = {
+    sizeof(unsigned int), sizeof(aiVector3D), sizeof(unsigned int), sizeof(aiVector3D),
+    sizeof(aiVector2D), sizeof(aiVector3D), sizeof(aiVector3D),
+  };
+  return strides[stream];
+}
+
+// Start of the given stream, in the order of model_stream_sizes().
+const char *model_stream(const model_t *model, int stream) {
+  const char *streams[MODEL_STREAM_COUNT] = {
+    (const char *)model->indices, (const char *)model->vertices, (const char *)model->materialIds,
+    (const char *)model->normals, (const char *)model->uvs, (const char *)model->tangents,
+    (const char *)model->bitangents,
+  };
+  return streams[stream];
+}
+
+/**
+ * Allocates one arena that holds exactly model->indexCount indices and model->vertexCount vertices.
+ * count_model() has to be called first.
+ */
+int allocate_model(model_t *model) {
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  size_t total = model_stream_sizes(model, streamSizes);
+
+  // Allocate one chunk of memory
+  char* data = (char *)malloc(total > 0 ? total : 1);
+  if(data == NULL){
+    printf("Failed to allocate %zu bytes for Scene.\n", total);
+    return -1;
+  }
+
+  model->arena = data;
+  model->arenaSize = total;
+  model->mapping = NULL;
+  layout_model(model, data);
+
+  model->vertexOffset = 0;
+  model->indexOffset = 0;
+
+  return 0;
+}
+
+/**
+ * Reallocates the arena so the index stream can hold indexCount indices, keeping the contents of every stream.
+ * The new indices past the old model->indexCount are left uninitialised.
+ */
+int grow_model_indices(model_t *model, unsigned int indexCount) {
+  model_t grown = {};
+  grown.vertexCount = model->vertexCount;
+  grown.indexCount = indexCount;
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  size_t total = model_stream_sizes(&grown, streamSizes);
+
+  char *data = (char *)malloc(total);
+  if (data == NULL) {
+    printf("Failed to allocate %zu bytes for Scene.\n", total);
+    return -1;
+  }
+  layout_model(&grown, data);
+
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t count = stream == 0 ? model->indexCount : model->vertexCount;
+    memcpy((char *)model_stream(&grown, stream), model_stream(model, stream), model_stream_stride(stream) * count);
+  }
+
+  free_model(*model);
+  model->arena = data;
+  model->arenaSize = total;
+  model->indexCount = indexCount;
+  layout_model(model, data);
+  return 0;
+}
+
+/**
+ * Fetches every material's diffuse and normal map into model->diffuseMapPaths and model->normalMapPaths.
+ */
+void extract_textures(model_t *model, const struct aiScene *scene){
+  model->diffuseMapPaths.assign(scene->mNumMaterials, std::string());
+  model->normalMapPaths.assign(scene->mNumMaterials, std::string());
+  for(unsigned int i = 0; i < scene->mNumMaterials; i++){
+    aiMaterial* mat = scene->mMaterials[i];
+    aiString path;
+
+    // The texture path has to be prefixed with "./",
+    // because the path is relative. Otherwise throws an error.
+    if(mat->GetTextureCount(aiTextureType_NORMALS) > 0 && mat->GetTexture(aiTextureType_NORMALS, 0, &path) == AI_SUCCESS){
+      model->normalMapPaths[i] = std::string("./") + std::string(path.C_Str());
+    }
+    if(mat->GetTextureCount(aiTextureType_DIFFUSE) > 0 && mat->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS){
+      model->diffuseMapPaths[i] = std::string("./") + std::string(path.C_Str());
+    }
+  }
+}
+
+/**
+ * Looks up the diffuse colour of every material into model->materials.
+ * Vertices only store the index of their material, so this is the table the shaders index.
+ */
+void extract_materials(model_t *model, const struct aiScene *scene) {
+  model->materials.assign(scene->mNumMaterials, aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+  for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+    if (AI_SUCCESS != aiGetMaterialColor(scene->mMaterials[i], AI_MATKEY_COLOR_DIFFUSE, &model->materials[i])) {
+      printf("Failed to load albedo color!\n");
+    }
+  }
+}
+
+/**
+ * Copies the indices of faces [faceBegin, faceEnd) to model->indices, starting at indexOffset.
+ * The indices are rebased onto vertexOffset, since all meshes share one vertex buffer.
+ */
+static void extract_faces(model_t *model, const struct aiMesh *mesh, unsigned int indexOffset,
+                          unsigned int vertexOffset, unsigned int faceBegin, unsigned int faceEnd) {
+  // Faces are the triangles of our mesh.
+  for (unsigned int faceIdx = faceBegin; faceIdx < faceEnd; faceIdx++) {
+    const struct aiFace &face = mesh->mFaces[faceIdx];
+    for (unsigned int i = 0; i < face.mNumIndices; i++) {
+      model->indices[indexOffset + i] = face.mIndices[i] + vertexOffset;
+    }
+    indexOffset += face.mNumIndices;
+  }
+}
+
+/**
+ * Copies vertices [vertexBegin, vertexEnd) of the mesh to the model, where the mesh starts at vertexOffset.
+ * This comprises: position, material id, normals, uvs, tangents, bitangents.
+ */
+static void extract_vertices(model_t *model, const struct aiMesh *mesh,
+                             unsigned int vertexOffset, unsigned int vertexBegin, unsigned int vertexEnd) {
+  for (unsigned int vertexIdx = vertexBegin; vertexIdx < vertexEnd; vertexIdx++) {
+    unsigned int target = vertexOffset + vertexIdx;
+    model->vertices[target] = mesh->mVertices[vertexIdx];
+    model->materialIds[target] = mesh->mMaterialIndex;
+    model->normals[target] = mesh->mNormals[vertexIdx];
+    // Does the mesh contain vertex coordinates? I.e. is this mesh textured at all?
+    if(mesh->mTextureCoords[0]){
+      aiVector2D uv;
+      uv.x = mesh->mTextureCoords[0][vertexIdx].x;
+      uv.y = mesh->mTextureCoords[0][vertexIdx].y;
+      model->uvs[target] = uv;
+      model->tangents[target] = mesh->mTangents[vertexIdx];
+      model->bitangents[target] = mesh->mBitangents[vertexIdx];
+    }else {
+      // Untextured meshes sample the first texel of their material's maps, which are placeholders unless it has any.
+      model->uvs[target] = (aiVector2D){0.0f, 0.0f};
+      model->tangents[target] = (aiVector3D){0.0f, 0.0f, 0.0f};
+      model->bitangents[target] = (aiVector3D){0.0f, 0.0f, 0.0f};
+    }
+  }
+}
+
+/**
+ * Loads all vertex data & indices from the .gltf file.
+ */
+void extract_indices(model_t *model, struct aiNode *node,
+                     const struct aiScene *scene) {
+  // Iterate over every mesh in the model.
+  // What constitutes a mesh depends on how the model was constructed in Blender, for example.
+  for (int meshIndex = 0; meshIndex < node->mNumMeshes; meshIndex++) {
+    const struct aiMesh *mesh = scene->mMeshes[node->mMeshes[meshIndex]];
+
+    // Store the associated indices first, a second pass extracts the vertex data.
+    unsigned int indexOffset = model->indexOffset;
+    for (unsigned int faceIdx = 0; faceIdx < mesh->mNumFaces; faceIdx++) {
+      model->indexOffset += mesh->mFaces[faceIdx].mNumIndices;
+    }
+    extract_faces(model, mesh, indexOffset, model->vertexOffset, 0, mesh->mNumFaces);
+
+    extract_vertices(model, mesh, model->vertexOffset, 0, mesh->mNumVertices);
+
+    model->vertexOffset += mesh->mNumVertices;
+  }
+
+  // Because assimp's aiScene has a graph structure,
+  // there may be child nodes that describe missing parts of the scene.
+  // Therefore, also recurse into these and extract.
+  for (int childIdx = 0; childIdx < node->mNumChildren; childIdx++) {
+    extract_indices(model, node->mChildren[childIdx], scene);
+  }
+}
+
+/**
+ * Copies one mesh of the flattened mesh list to where count_model() placed it.
+ * Meshes are independent of each other, so they can be extracted in any order, e.g. while others are already uploaded.
+ */
+void extract_mesh(model_t *model, const struct aiScene *scene, const mesh_range_t &range) {
+  const struct aiMesh *mesh = scene->mMeshes[range.meshId];
+  extract_faces(model, mesh, range.indexOffset, range.vertexOffset, 0, mesh->mNumFaces);
+  extract_vertices(model, mesh, range.vertexOffset, 0, mesh->mNumVertices);
+}
+
+/**
+ * Determines the bounds of the mesh from its extracted vertices and indices, and its uv density:
+ * the square root of the ratio of its triangles' total area in uv space to their area in world space.
+ */
+void compute_mesh_bounds(model_t *model, mesh_range_t *range) {
+  range->uvDensity = 0.0f;
+  if (range->vertexCount == 0) {
+    range->boundsMin = range->boundsMax = aiVector3D(0.0f, 0.0f, 0.0f);
+    return;
+  }
+  aiVector3D lower = model->vertices[range->vertexOffset];
+  aiVector3D upper = lower;
+  for (unsigned int v = range->vertexOffset + 1; v < range->vertexOffset + range->vertexCount; v++) {
+    const aiVector3D &p = model->vertices[v];
+    lower = aiVector3D(fminf(lower.x, p.x), fminf(lower.y, p.y), fminf(lower.z, p.z));
+    upper = aiVector3D(fmaxf(upper.x, p.x), fmaxf(upper.y, p.y), fmaxf(upper.z, p.z));
+  }
+  range->boundsMin = lower;
+  range->boundsMax = upper;
+
+  // Both areas are doubled, which cancels out.
+  double uvArea = 0.0, area = 0.0;
+  for (unsigned int i = range->indexOffset; i + 2 < range->indexOffset + range->indexCount; i += 3) {
+    unsigned int a = model->indices[i], b = model->indices[i + 1], c = model->indices[i + 2];
+    aiVector2D uv1 = model->uvs[b] - model->uvs[a];
+    aiVector2D uv2 = model->uvs[c] - model->uvs[a];
+    uvArea += fabsf(uv1.x * uv2.y - uv2.x * uv1.y);
+    area += ((model->vertices[b] - model->vertices[a]) ^ (model->vertices[c] - model->vertices[a])).Length();
+  }
+  if (area > 0.0) {
+    range->uvDensity = (float)sqrt(uvArea / area);
+  }
+}
+
+/**
+ * Area weighted vertex normals, for meshes exported without any.
+ * Assimp would generate them through the profile's GenNormals or GenSmoothNormals step.
+ */
+void compute_mesh_normals(model_t *model, const mesh_range_t &range) {
+  aiVector3D *normals = model->normals + range.vertexOffset;
+  const aiVector3D *positions = model->vertices + range.vertexOffset;
+  for (unsigned int v = 0; v < range.vertexCount; v++) {
+    normals[v] = aiVector3D(0.0f, 0.0f, 0.0f);
+  }
+  for (unsigned int i = range.indexOffset; i + 2 < range.indexOffset + range.indexCount; i += 3) {
+    unsigned int a = model->indices[i] - range.vertexOffset;
+    unsigned int b = model->indices[i + 1] - range.vertexOffset;
+    unsigned int c = model->indices[i + 2] - range.vertexOffset;
+    // Not normalised, so larger triangles weigh more.
+    aiVector3D normal = (positions[b] - positions[a]) ^ (positions[c] - positions[a]);
+    normals[a] += normal;
+    normals[b] += normal;
+    normals[c] += normal;
+  }
+  for (unsigned int v = 0; v < range.vertexCount; v++) {
+    normals[v].NormalizeSafe();
+  }
+}
+
+/**
+ * Per vertex tangent frames from the uv gradients of the adjacent triangles, for meshes exported without tangents.
+ * Like assimp's CalcTangentSpace, the frame is made orthogonal to the normal.
+ */
+void compute_mesh_tangents(model_t *model, const mesh_range_t &range) {
+  unsigned int base = range.vertexOffset;
+  for (unsigned int v = base; v < base + range.vertexCount; v++) {
+    model->tangents[v] = model->bitangents[v] = aiVector3D(0.0f, 0.0f, 0.0f);
+  }
+  for (unsigned int i = range.indexOffset; i + 2 < range.indexOffset + range.indexCount; i += 3) {
+    unsigned int a = model->indices[i], b = model->indices[i + 1], c = model->indices[i + 2];
+    aiVector3D edge1 = model->vertices[b] - model->vertices[a];
+    aiVector3D edge2 = model->vertices[c] - model->vertices[a];
+    aiVector2D uv1 = model->uvs[b] - model->uvs[a];
+    aiVector2D uv2 = model->uvs[c] - model->uvs[a];
+    float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+    if (fabsf(determinant) < 1e-12f) {
+      continue; // the triangle's uvs are degenerate
+    }
+    float scale = 1.0f / determinant;
+    aiVector3D tangent = (edge1 * uv2.y - edge2 * uv1.y) * scale;
+    aiVector3D bitangent = (edge2 * uv1.x - edge1 * uv2.x) * scale;
+    for (unsigned int v : {a, b, c}) {
+      model->tangents[v] += tangent;
+      model->bitangents[v] += bitangent;
+    }
+  }
+  for (unsigned int v = base; v < base + range.vertexCount; v++) {
+    const aiVector3D &normal = model->normals[v];
+    aiVector3D &tangent = model->tangents[v];
+    aiVector3D &bitangent = model->bitangents[v];
+    tangent = (tangent - normal * (normal * tangent)).NormalizeSafe();
+    bitangent = (bitangent - normal * (normal * bitangent)).NormalizeSafe();
+  }
+}
+
+// Number of faces or vertices copied by one task of extract_indices_parallel().
+#define EXTRACT_CHUNK_SIZE 65536
+
+typedef struct {
+  unsigned int range;
+  bool faces;
+  unsigned int begin, end;
+} extract_task_t;
+
+/**
+ * Same result as extract_indices(), byte for byte, but spread over all cores.
+ * Relies on the mesh list of count_model(): since every mesh already knows where its vertices and indices go,
+ * the face and vertex copies of all meshes are independent and run as separate tasks.
+ * Large meshes are split further into chunks, faces only if the mesh is pure triangles,
+ * since only then the index offset of a face is known without a prefix sum.
+ */
+void extract_indices_parallel(model_t *model, const struct aiScene *scene) {
+  std::vector<extract_task_t> tasks;
+
+  for (unsigned int r = 0; r < model->meshes.size(); r++) {
+    const mesh_range_t &range = model->meshes[r];
+    const struct aiMesh *mesh = scene->mMeshes[range.meshId];
+
+    bool triangles = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE &&
+                     range.indexCount == 3 * mesh->mNumFaces;
+    unsigned int faceChunk = triangles ? EXTRACT_CHUNK_SIZE : mesh->mNumFaces;
+    for (unsigned int begin = 0; begin < mesh->mNumFaces; begin += faceChunk) {
+      unsigned int end = begin + faceChunk < mesh->mNumFaces ? begin + faceChunk : mesh->mNumFaces;
+      tasks.push_back({r, true, begin, end});
+    }
+    for (unsigned int begin = 0; begin < mesh->mNumVertices; begin += EXTRACT_CHUNK_SIZE) {
+      unsigned int end = begin + EXTRACT_CHUNK_SIZE < mesh->mNumVertices ? begin + EXTRACT_CHUNK_SIZE : mesh->mNumVertices;
+      tasks.push_back({r, false, begin, end});
+    }
+  }
+
+  parallel_for(tasks.size(), [&](size_t t) {
+    const extract_task_t &task = tasks[t];
+    const mesh_range_t &range = model->meshes[task.range];
+    const struct aiMesh *mesh = scene->mMeshes[range.meshId];
+    if (task.faces) {
+      // Only chunked for triangle meshes, so every face before begin has 3 indices.
+      extract_faces(model, mesh, range.indexOffset + 3 * task.begin, range.vertexOffset, task.begin, task.end);
+    } else {
+      extract_vertices(model, mesh, range.vertexOffset, task.begin, task.end);
+    }
+  });
+
+  model->vertexOffset = model->vertexCount;
+  model->indexOffset = model->indexCount;
+}
+
+/**
+ * Imports the scene at path with assimp and extracts it into an exactly sized model.
+ * The aiScene is released again before returning, so the model holds the only CPU copy.
+ */
+int import_model(model_t *model, const char *path, const load_options_t *options) {
+  const C_STRUCT aiScene *scene = import_scene(path, options->postProcessFlags, options->importReport);
+
+  if (scene == NULL) {
+    printf("Failed to load scene\n");
+    return -1;
+  }
+
+  struct aiNode *root = scene->mRootNode;
+
+  // First pass only counts, so the second pass can write into an exactly sized arena.
+  count_model(model, root, scene);
+  extract_materials(model, scene);
+
+  if (allocate_model(model) < 0) {
+    aiReleaseImport(scene);
+    return -1;
+  }
+
+  if (options->parallelExtract) {
+    extract_indices_parallel(model, scene);
+  } else {
+    extract_indices(model, root, scene);
+  }
+  for (mesh_range_t &range : model->meshes) {
+    compute_mesh_bounds(model, &range);
+  }
+  extract_textures(model, scene);
+
+  aiReleaseImport(scene);
+
+  return run_model_passes(model, options);
+}
+
+/**
+ * Runs the optional passes of options over a freshly loaded model, whichever loader it came from.
+ */
+int run_model_passes(model_t *model, const load_options_t *options) {
+  // Welding first, so the optimiser works on the final vertices.
+  if (options->weld) {
+    weld_stats_t stats = {};
+    weld_model(model, &stats);
+    print_weld_stats(&stats);
+  }
+
+  if (options->optimize) {
+    optimize_stats_t stats = {};
+    optimize_model(model, &stats);
+    print_optimize_stats(&stats);
+  }
+
+  // After optimising, so the simplified levels inherit its vertex order.
+  if (options->lods) {
+    lod_stats_t stats = {};
+    if (build_lods(model, &stats) < 0) {
+      return -1;
+    }
+    print_lod_stats(&stats);
+  }
+
+  // Last, since the clusters fix the triangle order.
+  if (options->meshlets) {
+    meshlet_stats_t stats = {};
+    build_meshlets(model, &stats);
+    print_meshlet_stats(&stats);
+  }
+  return 0;
+}
@@ -0,0 +1,696 @@
+#include <obj_loader.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Smallest chunk parsed by one task. Files are split into several chunks per core, so uneven chunks still balance.
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+#define OBJ_CHUNKS_PER_WORKER 4
+
+// Longest number handled by the fast path, longer ones (and huge exponents) go through strtod.
+#define OBJ_MAX_FAST_DIGITS 18
+#define OBJ_MAX_NUMBER_LENGTH 64
+
+// Doubles represent every power of ten up to 1e22 exactly, so one multiplication or division rounds correctly.
+static const double POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// One face corner, as 0 based indices into the file's positions, uvs and normals. -1 if the corner has none.
+typedef struct {
+  int position;
+  int uv;
+  int normal;
+} obj_corner_t;
+
+// A relative (negative) index that was resolved within its chunk, and still needs the preceding chunks' counts.
+typedef struct {
+  size_t corner;
+  int component; // 0 position, 1 uv, 2 normal
+} obj_fixup_t;
+
+// An o, g or usemtl line. Each starts a new mesh at firstCorner, usemtl also switches the material.
+typedef struct {
+  size_t firstCorner;
+  bool setsMaterial;
+  std::string material;
+} obj_group_t;
+
+// What one line aligned chunk of the file contains. Faces are already triangulated, three corners each.
+typedef struct {
+  const char *begin;
+  const char *end;
+  std::vector<float> positions;
+  std::vector<float> uvs;
+  std::vector<float> normals;
+  std::vector<obj_corner_t> corners;
+  std::vector<obj_fixup_t> fixups;
+  std::vector<obj_group_t> groups;
+  std::vector<std::string> libraries;
+  bool malformed;
+} obj_chunk_t;
+
+/**
+ * A run of one chunk's triangles that belongs to one mesh, deduplicated into its own vertices.
+ * Pieces of a mesh are consecutive, so every mesh's vertices and indices stay contiguous.
+ */
+typedef struct {
+  unsigned int chunk;
+  size_t cornerBegin;
+  size_t cornerEnd;
+  unsigned int mesh;
+  std::vector<obj_corner_t> vertices;
+  std::vector<unsigned int> indices; // into vertices
+  bool missingNormals;
+  bool missingUvs;
+  unsigned int vertexOffset;
+  unsigned int indexOffset;
+} obj_piece_t;
+
+static inline bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline void skip_blanks(const char **cursor, const char *end) {
+  while (*cursor < end && is_blank(**cursor)) {
+    (*cursor)++;
+  }
+}
+
+/**
+ * Number of ASCII digits at text, at most 16. Where 16 bytes are left, one SSE2 compare classifies all of them:
+ * biased by '0' + 128, the digits are exactly the bytes that end up in [-128, -119].
+ */
+static inline size_t digit_run(const char *text, const char *end) {
+#ifdef __SSE2__
+  if (end - text >= 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)text);
+    __m128i biased = _mm_sub_epi8(bytes, _mm_set1_epi8((char)('0' + 128)));
+    __m128i nonDigits = _mm_cmpgt_epi8(biased, _mm_set1_epi8(-128 + 9));
+    return __builtin_ctz(_mm_movemask_epi8(nonDigits) | 0x10000);
+  }
+#endif
+  size_t count = 0;
+  while (count < 16 && text + count < end && (unsigned char)(text[count] - '0') < 10) {
+    count++;
+  }
+  return count;
+}
+
+// The value of eight ASCII digits, combined pairwise within one 64 bit word instead of digit by digit.
+static inline uint32_t parse_eight_digits(const char *text) {
+  uint64_t value;
+  memcpy(&value, text, sizeof(value));
+  value -= 0x3030303030303030ULL;
+  value = value * 10 + (value >> 8);
+  value = (((value & 0x000000ff000000ffULL) * 0x000f424000000064ULL) +
+           (((value >> 16) & 0x000000ff000000ffULL) * 0x0000271000000001ULL)) >> 32;
+  return (uint32_t)value;
+}
+
+// Appends the digits at *cursor to value and returns how many there were. value wraps past 19 digits.
+static inline size_t parse_digits(const char **cursor, const char *end, uint64_t *value) {
+  size_t total = 0;
+  while (true) {
+    size_t run = digit_run(*cursor, end);
+    size_t i = 0;
+    for (; i + 8 <= run; i += 8) {
+      *value = *value * 100000000 + parse_eight_digits(*cursor + i);
+    }
+    for (; i < run; i++) {
+      *value = *value * 10 + ((*cursor)[i] - '0');
+    }
+    *cursor += run;
+    total += run;
+    if (run < 16) {
+      return total;
+    }
+  }
+}
+
+// Fallback for numbers the fast path can't represent exactly. The mapping isn't terminated, so strtod gets a copy.
+static bool parse_float_slow(const char *begin, const char *end, float *value) {
+  char number[OBJ_MAX_NUMBER_LENGTH];
+  size_t length = end - begin;
+  if (length >= sizeof(number)) {
+    return false;
+  }
+  memcpy(number, begin, length);
+  number[length] = '\0';
+  *value = strtof(number, NULL);
+  return true;
+}
+
+static bool parse_float(const char **cursor, const char *end, float *value) {
+  skip_blanks(cursor, end);
+  const char *begin = *cursor;
+  bool negative = *cursor < end && **cursor == '-';
+  if (*cursor < end && (**cursor == '-' || **cursor == '+')) {
+    (*cursor)++;
+  }
+
+  uint64_t mantissa = 0;
+  size_t digits = parse_digits(cursor, end, &mantissa);
+  size_t fractionDigits = 0;
+  if (*cursor < end && **cursor == '.') {
+    (*cursor)++;
+    fractionDigits = parse_digits(cursor, end, &mantissa);
+    digits += fractionDigits;
+  }
+  if (digits == 0) {
+    return false;
+  }
+
+  int exponent = 0;
+  if (*cursor < end && (**cursor == 'e' || **cursor == 'E')) {
+    (*cursor)++;
+    bool negativeExponent = *cursor < end && **cursor == '-';
+    if (*cursor < end && (**cursor == '-' || **cursor == '+')) {
+      (*cursor)++;
+    }
+    uint64_t magnitude = 0;
+    if (parse_digits(cursor, end, &magnitude) == 0 || magnitude > 1000) {
+      return parse_float_slow(begin, *cursor, value);
+    }
+    exponent = negativeExponent ? -(int)magnitude : (int)magnitude;
+  }
+
+  exponent -= (int)fractionDigits;
+  if (digits > OBJ_MAX_FAST_DIGITS || exponent < -22 || exponent > 22) {
+    return parse_float_slow(begin, *cursor, value);
+  }
+  double result = exponent < 0 ? mantissa / POWERS_OF_TEN[-exponent] : mantissa * POWERS_OF_TEN[exponent];
+  *value = (float)(negative ? -result : result);
+  return true;
+}
+
+static bool parse_int(const char **cursor, const char *end, int *value) {
+  bool negative = *cursor < end && **cursor == '-';
+  if (negative) {
+    (*cursor)++;
+  }
+  uint64_t magnitude = 0;
+  if (parse_digits(cursor, end, &magnitude) == 0 || magnitude > 0x7fffffff) {
+    return false;
+  }
+  *value = negative ? -(int)magnitude : (int)magnitude;
+  return true;
+}
+
+// Reads up to count floats, as many as the line has. Returns false if there are fewer than required.
+static bool parse_floats(const char **cursor, const char *end, float *values, int count, int required) {
+  for (int i = 0; i < count; i++) {
+    values[i] = 0.0f;
+  }
+  for (int i = 0; i < count; i++) {
+    skip_blanks(cursor, end);
+    if (*cursor == end || **cursor == '\n') {
+      return i >= required;
+    }
+    if (!parse_float(cursor, end, &values[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The rest of the line without surrounding blanks, e.g. a material or file name.
+static std::string rest_of_line(const char *cursor, const char *end) {
+  skip_blanks(&cursor, end);
+  const char *last = end;
+  while (last > cursor && is_blank(last[-1])) {
+    last--;
+  }
+  return std::string(cursor, last);
+}
+
+/**
+ * Parses a face line: corners of the form v, v/vt, v//vn or v/vt/vn, fanned into triangles.
+ * OBJ counts from 1, and negative indices count back from the last element so far,
+ * which within a chunk is only known relative to the chunk's start, see obj_fixup_t.
+ */
+static bool parse_face(obj_chunk_t *chunk, const char *cursor, const char *end, std::vector<obj_corner_t> *polygon,
+                       std::vector<unsigned char> *relative) {
+  polygon->clear();
+  relative->clear();
+  while (true) {
+    skip_blanks(&cursor, end);
+    if (cursor == end) {
+      break;
+    }
+    int values[3] = {0, 0, 0};
+    if (!parse_int(&cursor, end, &values[0])) {
+      return false;
+    }
+    if (cursor < end && *cursor == '/') {
+      cursor++;
+      if (cursor < end && *cursor != '/' && !parse_int(&cursor, end, &values[1])) {
+        return false;
+      }
+      if (cursor < end && *cursor == '/') {
+        cursor++;
+        if (!parse_int(&cursor, end, &values[2])) {
+          return false;
+        }
+      }
+    }
+    obj_corner_t corner = {values[0] - 1, values[1] - 1, values[2] - 1};
+    unsigned char mask = 0;
+    size_t counts[3] = {chunk->positions.size() / 3, chunk->uvs.size() / 2, chunk->normals.size() / 3};
+    int *components[3] = {&corner.position, &corner.uv, &corner.normal};
+    for (int c = 0; c < 3; c++) {
+      if (values[c] < 0) {
+        *components[c] = (int)counts[c] + values[c];
+        mask |= 1 << c;
+      }
+    }
+    polygon->push_back(corner);
+    relative->push_back(mask);
+  }
+  if (polygon->size() < 3) {
+    return !polygon->empty(); // lines and points in face syntax are skipped
+  }
+
+  for (size_t i = 1; i + 1 < polygon->size(); i++) {
+    for (size_t source : {(size_t)0, i, i + 1}) {
+      for (int c = 0; c < 3; c++) {
+        if ((*relative)[source] & (1 << c)) {
+          chunk->fixups.push_back({chunk->corners.size(), c});
+        }
+      }
+      chunk->corners.push_back((*polygon)[source]);
+    }
+  }
+  return true;
+}
+
+/**
+ * Parses the lines of one chunk. Everything that refers to other chunks is kept local:
+ * relative indices become fixups, and the material is only known to change at the chunk's groups.
+ */
+static void parse_chunk(obj_chunk_t *chunk) {
+  std::vector<obj_corner_t> polygon;
+  std::vector<unsigned char> relative;
+  const char *cursor = chunk->begin;
+  while (cursor < chunk->end && !chunk->malformed) {
+    const char *lineEnd = (const char *)memchr(cursor, '\n', chunk->end - cursor);
+    if (lineEnd == NULL) {
+      lineEnd = chunk->end;
+    }
+    skip_blanks(&cursor, lineEnd);
+    const char *line = cursor;
+    size_t length = lineEnd - line;
+
+    if (length >= 2 && line[0] == 'v' && is_blank(line[1])) {
+      float position[3];
+      cursor = line + 2;
+      chunk->malformed = !parse_floats(&cursor, lineEnd, position, 3, 3);
+      chunk->positions.insert(chunk->positions.end(), position, position + 3);
+    } else if (length >= 3 && line[0] == 'v' && line[1] == 't' && is_blank(line[2])) {
+      float uv[2];
+      cursor = line + 3;
+      chunk->malformed = !parse_floats(&cursor, lineEnd, uv, 2, 1);
+      chunk->uvs.insert(chunk->uvs.end(), uv, uv + 2);
+    } else if (length >= 3 && line[0] == 'v' && line[1] == 'n' && is_blank(line[2])) {
+      float normal[3];
+      cursor = line + 3;
+      chunk->malformed = !parse_floats(&cursor, lineEnd, normal, 3, 3);
+      chunk->normals.insert(chunk->normals.end(), normal, normal + 3);
+    } else if (length >= 2 && line[0] == 'f' && is_blank(line[1])) {
+      chunk->malformed = !parse_face(chunk, line + 2, lineEnd, &polygon, &relative);
+    } else if (length >= 2 && (line[0] == 'o' || line[0] == 'g') && is_blank(line[1])) {
+      chunk->groups.push_back({chunk->corners.size(), false, std::string()});
+    } else if (length >= 7 && strncmp(line, "usemtl", 6) == 0 && is_blank(line[6])) {
+      chunk->groups.push_back({chunk->corners.size(), true, rest_of_line(line + 7, lineEnd)});
+    } else if (length >= 7 && strncmp(line, "mtllib", 6) == 0 && is_blank(line[6])) {
+      chunk->libraries.push_back(rest_of_line(line + 7, lineEnd));
+    }
+    // Comments, smoothing groups, lines, points and anything else are ignored.
+    cursor = lineEnd + 1;
+  }
+}
+
+// Splits [begin, end) into chunks that each end right after a newline.
+static std::vector<obj_chunk_t> split_chunks(const char *begin, const char *end) {
+  size_t size = end - begin;
+  size_t chunkSize = size / (worker_count() * OBJ_CHUNKS_PER_WORKER);
+  if (chunkSize < OBJ_MIN_CHUNK_SIZE) {
+    chunkSize = OBJ_MIN_CHUNK_SIZE;
+  }
+
+  std::vector<obj_chunk_t> chunks;
+  for (const char *cursor = begin; cursor < end;) {
+    const char *chunkEnd = (size_t)(end - cursor) > chunkSize ? cursor + chunkSize : end;
+    const char *newline = (const char *)memchr(chunkEnd - 1, '\n', end - (chunkEnd - 1));
+    chunkEnd = newline != NULL ? newline + 1 : end;
+    obj_chunk_t chunk = {};
+    chunk.begin = cursor;
+    chunk.end = chunkEnd;
+    chunks.push_back(chunk);
+    cursor = chunkEnd;
+  }
+  return chunks;
+}
+
+/**
+ * Reads the diffuse colours and maps of a material library into the model, in the order the materials are defined.
+ * Like assimp, only norm is taken as the normal map, bump and map_Bump are height maps.
+ */
+static void read_material_library(model_t *model, const std::string &path, std::vector<std::string> *names) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    printf("Failed to open material library %s\n", path.c_str());
+    return;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    const char *end = line + strcspn(line, "\r\n");
+    const char *cursor = line;
+    skip_blanks(&cursor, end);
+    if (strncmp(cursor, "newmtl", 6) == 0 && is_blank(cursor[6])) {
+      names->push_back(rest_of_line(cursor + 7, end));
+      model->materials.push_back(aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+      model->diffuseMapPaths.push_back(std::string());
+      model->normalMapPaths.push_back(std::string());
+    } else if (strncmp(cursor, "Kd", 2) == 0 && is_blank(cursor[2]) && !model->materials.empty()) {
+      float colour[3];
+      cursor += 3;
+      if (parse_floats(&cursor, end, colour, 3, 3)) {
+        model->materials.back() = aiColor4D(colour[0], colour[1], colour[2], 1.0f);
+      }
+    } else if ((strncmp(cursor, "map_Kd", 6) == 0 || strncmp(cursor, "norm", 4) == 0) && !model->materials.empty()) {
+      bool diffuse = cursor[0] == 'm';
+      const char *value = cursor + (diffuse ? 6 : 4);
+      if (!is_blank(*value)) {
+        continue;
+      }
+      // Options like -bm 1 precede the file name, which is the last word.
+      std::string map = rest_of_line(value, end);
+      size_t space = map.find_last_of(" \t");
+      map = std::string("./") + (space == std::string::npos ? map : map.substr(space + 1));
+      (diffuse ? model->diffuseMapPaths : model->normalMapPaths).back() = map;
+    }
+  }
+  fclose(file);
+}
+
+static std::string directory_prefix(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash == NULL ? std::string() : std::string(path, slash + 1 - path);
+}
+
+// Index of the material, or -1 for unknown names, which get the default material.
+static int find_material(const std::vector<std::string> &names, const std::string &name) {
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] == name) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Cuts the chunks' triangles into pieces of one mesh each. A new mesh starts at every o, g or usemtl line
+ * that is followed by faces, and runs across chunk boundaries until the next one.
+ * Returns the material of every mesh, -1 for the default material.
+ */
+static std::vector<int> assign_pieces(const std::vector<obj_chunk_t> &chunks, const std::vector<std::string> &names,
+                                      std::vector<obj_piece_t> *pieces) {
+  std::vector<int> meshMaterials;
+  int material = -1;
+  bool newMesh = true;
+  for (unsigned int c = 0; c < chunks.size(); c++) {
+    const obj_chunk_t &chunk = chunks[c];
+    size_t begin = 0;
+    for (size_t g = 0; g <= chunk.groups.size(); g++) {
+      size_t end = g < chunk.groups.size() ? chunk.groups[g].firstCorner : chunk.corners.size();
+      if (end > begin) {
+        if (newMesh || meshMaterials.empty()) {
+          meshMaterials.push_back(material);
+          newMesh = false;
+        }
+        obj_piece_t piece = {};
+        piece.chunk = c;
+        piece.cornerBegin = begin;
+        piece.cornerEnd = end;
+        piece.mesh = meshMaterials.size() - 1;
+        pieces->push_back(piece);
+      }
+      if (g < chunk.groups.size()) {
+        newMesh = true;
+        if (chunk.groups[g].setsMaterial) {
+          material = find_material(names, chunk.groups[g].material);
+        }
+      }
+      begin = end;
+    }
+  }
+  return meshMaterials;
+}
+
+static inline uint32_t hash_corner(const obj_corner_t &corner) {
+  uint32_t hash = (uint32_t)corner.position * 0x9e3779b1u;
+  hash = (hash ^ (uint32_t)corner.uv) * 0x85ebca6bu;
+  hash = (hash ^ (uint32_t)corner.normal) * 0xc2b2ae35u;
+  return hash ^ (hash >> 16);
+}
+
+/**
+ * Turns the piece's corners into unique vertices and indices with an open addressing hash table,
+ * so a corner shared by several faces becomes one vertex like assimp's JoinIdenticalVertices would make it.
+ */
+static void deduplicate_piece(const obj_chunk_t &chunk, obj_piece_t *piece) {
+  size_t count = piece->cornerEnd - piece->cornerBegin;
+  size_t capacity = 16;
+  while (capacity < 2 * count) {
+    capacity *= 2;
+  }
+  std::vector<unsigned int> table(capacity, 0); // vertex index + 1, 0 for empty slots
+  piece->indices.reserve(count);
+
+  for (size_t i = piece->cornerBegin; i < piece->cornerEnd; i++) {
+    const obj_corner_t &corner = chunk.corners[i];
+    size_t slot = hash_corner(corner) & (capacity - 1);
+    while (true) {
+      unsigned int entry = table[slot];
+      if (entry == 0) {
+        table[slot] = piece->vertices.size() + 1;
+        piece->indices.push_back(piece->vertices.size());
+        piece->vertices.push_back(corner);
+        piece->missingNormals = piece->missingNormals || corner.normal < 0;
+        piece->missingUvs = piece->missingUvs || corner.uv < 0;
+        break;
+      }
+      const obj_corner_t &existing = piece->vertices[entry - 1];
+      if (existing.position == corner.position && existing.uv == corner.uv && existing.normal == corner.normal) {
+        piece->indices.push_back(entry - 1);
+        break;
+      }
+      slot = (slot + 1) & (capacity - 1);
+    }
+  }
+}
+
+/**
+ * Builds the model from the parsed chunks: rebases the chunks' relative indices, merges their attributes,
+ * deduplicates the corners per piece and writes every mesh's vertices and indices, all spread over the cores.
+ * Returns 1 if an index points past the file's attributes.
+ */
+static int build_model(model_t *model, std::vector<obj_chunk_t> &chunks, const std::vector<std::string> &names) {
+  std::vector<size_t> positionBase(chunks.size()), uvBase(chunks.size()), normalBase(chunks.size());
+  size_t positionCount = 0, uvCount = 0, normalCount = 0;
+  for (size_t c = 0; c < chunks.size(); c++) {
+    positionBase[c] = positionCount;
+    uvBase[c] = uvCount;
+    normalBase[c] = normalCount;
+    positionCount += chunks[c].positions.size() / 3;
+    uvCount += chunks[c].uvs.size() / 2;
+    normalCount += chunks[c].normals.size() / 3;
+  }
+  if (positionCount > 0x7fffffff) {
+    return 1;
+  }
+
+  std::vector<float> positions(3 * positionCount), uvs(2 * uvCount), normals(3 * normalCount);
+  parallel_for(chunks.size(), [&](size_t c) {
+    obj_chunk_t &chunk = chunks[c];
+    std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + 3 * positionBase[c]);
+    std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + 2 * uvBase[c]);
+    std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + 3 * normalBase[c]);
+    for (const obj_fixup_t &fixup : chunk.fixups) {
+      obj_corner_t &corner = chunk.corners[fixup.corner];
+      int *components[3] = {&corner.position, &corner.uv, &corner.normal};
+      size_t bases[3] = {positionBase[c], uvBase[c], normalBase[c]};
+      *components[fixup.component] += (int)bases[fixup.component];
+    }
+  });
+
+  std::vector<obj_piece_t> pieces;
+  std::vector<int> meshMaterials = assign_pieces(chunks, names, &pieces);
+  parallel_for(pieces.size(), [&](size_t p) {
+    deduplicate_piece(chunks[pieces[p].chunk], &pieces[p]);
+  });
+
+  // Only now the sizes are known: lay the pieces out one after another and allocate exactly.
+  unsigned int defaultMaterial = model->materials.size();
+  model->meshes.resize(meshMaterials.size());
+  for (unsigned int m = 0; m < meshMaterials.size(); m++) {
+    mesh_range_t &range = model->meshes[m];
+    range = {};
+    range.meshId = m;
+    range.materialIndex = meshMaterials[m] < 0 ? defaultMaterial : meshMaterials[m];
+  }
+  for (obj_piece_t &piece : pieces) {
+    mesh_range_t &range = model->meshes[piece.mesh];
+    if (range.vertexCount == 0 && range.indexCount == 0) {
+      range.vertexOffset = model->vertexCount;
+      range.indexOffset = model->indexCount;
+    }
+    piece.vertexOffset = model->vertexCount;
+    piece.indexOffset = model->indexCount;
+    range.vertexCount += piece.vertices.size();
+    range.indexCount += piece.indices.size();
+    model->vertexCount += piece.vertices.size();
+    model->indexCount += piece.indices.size();
+  }
+  for (int material : meshMaterials) {
+    if (material < 0) {
+      model->materials.push_back(aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+      model->diffuseMapPaths.push_back(std::string());
+      model->normalMapPaths.push_back(std::string());
+      break;
+    }
+  }
+  if (allocate_model(model) < 0) {
+    return -1;
+  }
+
+  std::atomic<bool> valid(true);
+  parallel_for(pieces.size(), [&](size_t p) {
+    const obj_piece_t &piece = pieces[p];
+    unsigned int materialIndex = model->meshes[piece.mesh].materialIndex;
+    for (size_t v = 0; v < piece.vertices.size(); v++) {
+      const obj_corner_t &corner = piece.vertices[v];
+      unsigned int target = piece.vertexOffset + v;
+      if (corner.position < 0 || (size_t)corner.position >= positionCount || corner.uv >= (int)uvCount ||
+          corner.normal >= (int)normalCount) {
+        valid = false;
+        return;
+      }
+      const float *position = &positions[3 * corner.position];
+      model->vertices[target] = aiVector3D(position[0], position[1], position[2]);
+      model->materialIds[target] = materialIndex;
+      const float *normal = corner.normal >= 0 ? &normals[3 * corner.normal] : NULL;
+      model->normals[target] = normal != NULL ? aiVector3D(normal[0], normal[1], normal[2]) : aiVector3D(0, 0, 0);
+      const float *uv = corner.uv >= 0 ? &uvs[2 * corner.uv] : NULL;
+      model->uvs[target] = uv != NULL ? aiVector2D(uv[0], uv[1]) : aiVector2D(0.0f, 0.0f);
+    }
+    for (size_t i = 0; i < piece.indices.size(); i++) {
+      model->indices[piece.indexOffset + i] = piece.vertexOffset + piece.indices[i];
+    }
+  });
+  if (!valid) {
+    printf("An OBJ face refers to a vertex that doesn't exist\n");
+    return 1;
+  }
+
+  // Normals and tangents are filled in per mesh, the pieces only tell which meshes lack them.
+  std::vector<char> missingNormals(model->meshes.size(), 0), hasUvs(model->meshes.size(), 0);
+  for (const obj_piece_t &piece : pieces) {
+    missingNormals[piece.mesh] |= piece.missingNormals;
+    hasUvs[piece.mesh] |= !piece.missingUvs;
+  }
+  parallel_for(model->meshes.size(), [&](size_t m) {
+    mesh_range_t &range = model->meshes[m];
+    if (missingNormals[m]) {
+      compute_mesh_normals(model, range);
+    }
+    if (hasUvs[m]) {
+      compute_mesh_tangents(model, range);
+    } else {
+      // Like extract_vertices(), untextured meshes sample the first texel of their material's maps.
+      for (unsigned int v = range.vertexOffset; v < range.vertexOffset + range.vertexCount; v++) {
+        model->uvs[v] = aiVector2D(0.0f, 0.0f);
+        model->tangents[v] = model->bitangents[v] = aiVector3D(0.0f, 0.0f, 0.0f);
+      }
+    }
+    compute_mesh_bounds(model, &range);
+  });
+  model->vertexOffset = model->vertexCount;
+  model->indexOffset = model->indexCount;
+  return 0;
+}
+
+/**
+ * Loads a Wavefront .obj file without assimp. The file is mapped and split into line aligned chunks that are parsed
+ * on all cores, with SSE2 digit scanning for the numbers. Identical face corners are merged through a hash table.
+ * Meshes start at every o, g and usemtl line. Texture paths come from the mtllib files, like assimp reports them.
+ * Returns 1 without touching model if the file isn't a .obj or is malformed, so assimp can report it.
+ */
+int load_obj(model_t *model, const char *path, const load_options_t *options) {
+  size_t length = strlen(path);
+  if (length < 4 || strcmp(path + length - 4, ".obj") != 0) {
+    return 1;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size == 0) {
+    close(fd);
+    return 1;
+  }
+  size_t size = info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  madvise(mapping, size, MADV_WILLNEED);
+
+  const char *text = (const char *)mapping;
+  std::vector<obj_chunk_t> chunks = split_chunks(text, text + size);
+  parallel_for(chunks.size(), [&](size_t c) {
+    parse_chunk(&chunks[c]);
+  });
+  for (const obj_chunk_t &chunk : chunks) {
+    if (chunk.malformed) {
+      munmap(mapping, size);
+      printf("Malformed OBJ line in %s\n", path);
+      return 1;
+    }
+  }
+
+  model_t loaded = {};
+  std::vector<std::string> names;
+  for (const obj_chunk_t &chunk : chunks) {
+    for (const std::string &library : chunk.libraries) {
+      read_material_library(&loaded, directory_prefix(path) + library, &names);
+    }
+  }
+
+  int result = build_model(&loaded, chunks, names);
+  munmap(mapping, size);
+  if (result != 0) {
+    free_model(loaded);
+    return result;
+  }
+
+  *model = loaded;
+  return run_model_passes(model, options);
+}
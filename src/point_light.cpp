@@ -0,0 +1,32 @@
+#include <point_light.h>
+#include <glad/glad.h>
+#include <stdio.h>
+
+/**
+ * Uploads the light table into buffer and binds it to POINT_LIGHT_BLOCK_BINDING.
+ * The shaders take the number of lights in use from their pointLightCount uniform.
+ */
+void upload_point_lights(unsigned int buffer, const std::vector<point_light_t> &lights) {
+  size_t count = lights.size();
+  if (count > MAX_POINT_LIGHTS) {
+    printf("Scene has %zu point lights, only the first %d are used!\n", count, MAX_POINT_LIGHTS);
+    count = MAX_POINT_LIGHTS;
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(point_light_t) * MAX_POINT_LIGHTS, NULL, GL_STATIC_DRAW);
+  if (count > 0) {
+    // std140 pads a struct of two vec4s to 32 bytes, exactly like point_light_t.
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(point_light_t) * count, lights.data());
+  }
+  glBindBufferBase(GL_UNIFORM_BUFFER, POINT_LIGHT_BLOCK_BINDING, buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Connects the program's PointLights block to the table. Programs that do not use it are left alone.
+void bind_point_light_block(unsigned int program) {
+  unsigned int block = glGetUniformBlockIndex(program, "PointLights");
+  if (block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, block, POINT_LIGHT_BLOCK_BINDING);
+  }
+}
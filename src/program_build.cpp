@@ -0,0 +1,135 @@
+#include <program_build.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// Whether the context lists extension.
+static bool has_extension(const char *extension) {
+  int count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (int i = 0; i < count; i++) {
+    const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (name != NULL && strcmp(name, extension) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Lets the driver compile and link on as many threads as it likes, through GL_KHR_parallel_shader_compile or
+ * GL_ARB_parallel_shader_compile, and loads the entry point with load. Returns false if the context has neither,
+ * poll_program() then waits for every program. Call once the context is current.
+ */
+bool enable_parallel_shader_compile(GLADloadproc load) {
+  const char *extensions[][2] = {{"GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR"},
+                                 {"GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB"}};
+  for (const auto &extension : extensions) {
+    if (!has_extension(extension[0])) {
+      continue;
+    }
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(extension[1]);
+    if (maxThreads == NULL) {
+      continue;
+    }
+    // 0xFFFFFFFF leaves the number of threads to the driver.
+    maxThreads(0xFFFFFFFFu);
+    printf("Compiling shaders in parallel through %s\n", extension[0]);
+    return true;
+  }
+  printf("The driver can't report compile progress, shaders are waited for one by one\n");
+  return false;
+}
+
+/**
+ * Starts building a program of stageCount stages from sources, of the shader types in stages, without waiting for
+ * any of it. A program in the cache is restored from it instead, and is ready right away. Otherwise the shaders
+ * are compiled and linked, and the program's status is only queried by poll_program(), since querying it earlier
+ * would wait for the driver.
+ */
+void submit_program(program_build_t *build, const program_cache_t *cache, const char *name, const char *const *sources,
+                    const unsigned int *stages, int stageCount) {
+  *build = {};
+  build->name = name;
+  build->sourceHash = hash_program_sources(sources, stageCount);
+  build->program = load_cached_program(cache, name, build->sourceHash);
+  if (build->program != 0) {
+    build->status = PROGRAM_READY;
+    build->cached = true;
+    return;
+  }
+
+  build->status = PROGRAM_COMPILING;
+  build->program = glCreateProgram();
+  for (int s = 0; s < stageCount && s < PROGRAM_MAX_STAGES; s++) {
+    unsigned int shader = glCreateShader(stages[s]);
+    glShaderSource(shader, 1, &sources[s], NULL);
+    glCompileShader(shader);
+    glAttachShader(build->program, shader);
+    build->shaders[build->shaderCount++] = shader;
+  }
+  mark_program_retrievable(cache, build->program);
+  // Linking right away is fine, a shader that fails to compile fails the link.
+  glLinkProgram(build->program);
+}
+
+// Prints why a shader or program of build failed, from the info log getLog reads.
+static void print_info_log(const program_build_t *build, unsigned int object, int length,
+                           PFNGLGETSHADERINFOLOGPROC getLog, const char *step) {
+  std::vector<char> log(length > 1 ? length : 1, '\0');
+  if (length > 1) {
+    getLog(object, length, NULL, log.data());
+  }
+  printf("%s %s failed!\n%s\n", step, build->name, log.data());
+}
+
+/**
+ * Returns PROGRAM_COMPILING while the driver is still at work on build, which is only known with parallel compiling
+ * enabled, see enable_parallel_shader_compile(). Without it, this waits for the program to link.
+ * Once linked, the program is cached and its shaders are released; returns PROGRAM_READY from then on.
+ * Returns PROGRAM_FAILED, having printed the compile and link logs, if it doesn't compile or link.
+ */
+int poll_program(program_build_t *build, const program_cache_t *cache, bool parallel) {
+  if (build->status != PROGRAM_COMPILING) {
+    return build->status;
+  }
+  GLint done = GL_TRUE;
+  if (parallel) {
+    glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &done);
+  }
+  if (!done) {
+    return PROGRAM_COMPILING;
+  }
+
+  GLint linked = GL_FALSE;
+  glGetProgramiv(build->program, GL_LINK_STATUS, &linked);
+  if (linked) {
+    write_cached_program(cache, build->name, build->sourceHash, build->program);
+  } else {
+    for (int s = 0; s < build->shaderCount; s++) {
+      GLint compiled = GL_FALSE, length = 0;
+      glGetShaderiv(build->shaders[s], GL_COMPILE_STATUS, &compiled);
+      glGetShaderiv(build->shaders[s], GL_INFO_LOG_LENGTH, &length);
+      if (!compiled) {
+        print_info_log(build, build->shaders[s], length, glGetShaderInfoLog, "Compiling a shader of");
+      }
+    }
+    GLint length = 0;
+    glGetProgramiv(build->program, GL_INFO_LOG_LENGTH, &length);
+    print_info_log(build, build->program, length, glGetProgramInfoLog, "Linking");
+  }
+
+  for (int s = 0; s < build->shaderCount; s++) {
+    glDetachShader(build->program, build->shaders[s]);
+    glDeleteShader(build->shaders[s]);
+  }
+  build->shaderCount = 0;
+  if (!linked) {
+    glDeleteProgram(build->program);
+    build->program = 0;
+  }
+  build->status = linked ? PROGRAM_READY : PROGRAM_FAILED;
+  return build->status;
+}
@@ -0,0 +1,158 @@
+#include <program_cache.h>
+#include <scene_cache.h>
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char PROGRAM_CACHE_MAGIC[8] = {'P', 'R', 'O', 'G', 'R', 'A', 'M', 'S'};
+
+// Fixed size header at the start of every program cache, followed by binarySize bytes of the binary.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t binaryFormat;
+  uint64_t sourceHash;
+  uint64_t driverHash;
+  uint64_t binarySize;
+} program_cache_header_t;
+
+/**
+ * Checks whether the context can save and restore programs and identifies its driver. Call once the context is current.
+ * glGetProgramBinary() is core from GL 4.1 on, glad leaves it NULL in older contexts.
+ */
+void open_program_cache(program_cache_t *cache) {
+  *cache = {};
+  GLint formats = 0;
+  if (glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  cache->supported = formats > 0;
+  if (!cache->supported) {
+    printf("The driver can't save program binaries, shaders are compiled on every start\n");
+    return;
+  }
+
+  cache->driverHash = 0xcbf29ce484222325ULL;
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char *value = (const char *)glGetString(name);
+    if (value != NULL) {
+      cache->driverHash = hash_bytes(cache->driverHash, (const unsigned char *)value, strlen(value) + 1);
+    }
+  }
+}
+
+// Where the program called name is cached, e.g. name is the path of its fragment shader.
+std::string program_cache_path(const char *name) {
+  return std::string(name) + ".progcache";
+}
+
+// Hashes the sources of all of a program's stages, in order, as handed to glShaderSource().
+uint64_t hash_program_sources(const char *const *sources, int count) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int s = 0; s < count; s++) {
+    // The terminators keep "ab" + "c" apart from "a" + "bc".
+    hash = hash_bytes(hash, (const unsigned char *)sources[s], strlen(sources[s]) + 1);
+  }
+  return hash;
+}
+
+// Asks the driver to keep program's binary retrievable once linked, for write_cached_program(). Call before linking.
+void mark_program_retrievable(const program_cache_t *cache, unsigned int program) {
+  if (cache->supported) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+}
+
+/**
+ * Creates a program from the cache of name. Returns 0 if there is no cache, it was built from other sources,
+ * by another driver or by an older version, or the driver rejects the binary, e.g. after an update that kept
+ * its version string. The caller then compiles the program from source.
+ */
+unsigned int load_cached_program(const program_cache_t *cache, const char *name, uint64_t sourceHash) {
+  if (!cache->supported) {
+    return 0;
+  }
+  std::string cachePath = program_cache_path(name);
+  FILE *file = fopen(cachePath.c_str(), "rb");
+  if (file == NULL) {
+    return 0;
+  }
+
+  program_cache_header_t header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0 &&
+               header.version == PROGRAM_CACHE_VERSION && header.sourceHash == sourceHash &&
+               header.driverHash == cache->driverHash && header.binarySize > 0 && header.binarySize < (1u << 30);
+  void *binary = valid ? malloc(header.binarySize) : NULL;
+  valid = binary != NULL && fread(binary, 1, header.binarySize, file) == header.binarySize;
+  fclose(file);
+  if (!valid) {
+    printf("Program cache %s is stale, compiling %s.\n", cachePath.c_str(), name);
+    free(binary);
+    return 0;
+  }
+
+  unsigned int program = glCreateProgram();
+  glProgramBinary(program, header.binaryFormat, binary, header.binarySize);
+  free(binary);
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    printf("The driver rejected program cache %s, compiling %s.\n", cachePath.c_str(), name);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+/**
+ * Writes the binary of program, linked from sources hashing to sourceHash, to the cache of name.
+ * The program has to be marked with mark_program_retrievable() before it was linked. Like the scene cache, the file is
+ * written next to the final one first and then renamed.
+ */
+int write_cached_program(const program_cache_t *cache, const char *name, uint64_t sourceHash, unsigned int program) {
+  if (!cache->supported) {
+    return -1;
+  }
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return -1;
+  }
+  void *binary = malloc(length);
+  if (binary == NULL) {
+    return -1;
+  }
+  program_cache_header_t header = {};
+  memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+  header.version = PROGRAM_CACHE_VERSION;
+  header.sourceHash = sourceHash;
+  header.driverHash = cache->driverHash;
+  GLsizei written = 0;
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &written, &format, binary);
+  header.binaryFormat = format;
+  header.binarySize = written;
+
+  std::string cachePath = program_cache_path(name);
+  std::string tempPath = cachePath + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open program cache @ %s\n", tempPath.c_str());
+    free(binary);
+    return -1;
+  }
+  bool ok = written > 0 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(binary, 1, written, file) == (size_t)written;
+  ok = (fclose(file) == 0) && ok;
+  free(binary);
+
+  if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+    fprintf(stderr, "Failed to write program cache @ %s\n", cachePath.c_str());
+    unlink(tempPath.c_str());
+    return -1;
+  }
+  return 0;
+}
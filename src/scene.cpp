@@ -0,0 +1,421 @@
+#include <scene.h>
+#include <asset_watcher.h>
+#include <gltf_loader.h>
+#include <obj_loader.h>
+#include <material.h>
+#include <scene_cache.h>
+#include <vertex_format.h>
+#include <cglm/cglm.h>
+#include <glad/glad.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest asset path in a scene file.
+#define SCENE_MAX_PATH 512
+
+/**
+ * Places the asset: scaled uniformly, then rotated about the y axis by rotationY degrees, then translated.
+ * Uniform scales keep normals and culling exact without a separate normal matrix.
+ */
+void make_asset_transform(scene_asset_t *asset, const float translation[3], float scale, float rotationY) {
+  mat4 transform, inverse;
+  glm_mat4_identity(transform);
+  glm_translate(transform, (float *)translation);
+  glm_rotate_y(transform, glm_rad(rotationY), transform);
+  glm_scale_uni(transform, scale);
+  glm_mat4_inv(transform, inverse);
+  // cglm's matrices are 16 byte aligned, the asset's are not necessarily.
+  memcpy(asset->transform, transform, sizeof(asset->transform));
+  memcpy(asset->inverseTransform, inverse, sizeof(asset->inverseTransform));
+}
+
+/**
+ * Reads a scene description with one asset per line:
+ *   path [x y z [scale [rotationY]]]
+ * The translation is in world units, the rotation about the y axis in degrees. Lines starting with # are comments.
+ * Returns -1 if the file can't be read or lists no assets.
+ */
+int parse_scene_file(const char *path, std::vector<scene_asset_t> *assets) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    printf("Failed to open scene %s\n", path);
+    return -1;
+  }
+
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    char assetPath[SCENE_MAX_PATH];
+    float translation[3] = {0.0f, 0.0f, 0.0f};
+    float scale = 1.0f;
+    float rotationY = 0.0f;
+    if (sscanf(line, "%511s %f %f %f %f %f", assetPath, &translation[0], &translation[1], &translation[2], &scale,
+               &rotationY) < 1 || assetPath[0] == '#') {
+      continue;
+    }
+
+    scene_asset_t asset = {};
+    asset.path = assetPath;
+    make_asset_transform(&asset, translation, scale, rotationY);
+    assets->push_back(asset);
+  }
+  fclose(file);
+
+  if (assets->empty()) {
+    printf("Scene %s lists no assets\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Appends the geometry, meshes, meshlets and materials of part to pool, reallocating pool's arena.
+ * Everything part refers to by position (indices, mesh and meshlet offsets, material ids) is rebased
+ * onto where it lands in pool, so the result draws from one set of buffers like a single file would.
+ */
+int append_model(model_t *pool, const model_t *part) {
+  model_t grown = {};
+  grown.vertexCount = pool->vertexCount + part->vertexCount;
+  grown.indexCount = pool->indexCount + part->indexCount;
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  size_t total = model_stream_sizes(&grown, streamSizes);
+
+  char *data = (char *)malloc(total);
+  if (data == NULL) {
+    printf("Failed to allocate %zu bytes for Scene.\n", total);
+    return -1;
+  }
+  layout_model(&grown, data);
+
+  unsigned int vertexBase = pool->vertexCount;
+  unsigned int indexBase = pool->indexCount;
+  unsigned int materialBase = pool->materials.size();
+  unsigned int meshletBase = pool->meshlets.size();
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    size_t poolCount = stream == 0 ? pool->indexCount : pool->vertexCount;
+    size_t partCount = stream == 0 ? part->indexCount : part->vertexCount;
+    char *destination = (char *)model_stream(&grown, stream);
+    memcpy(destination, model_stream(pool, stream), stride * poolCount);
+    memcpy(destination + stride * poolCount, model_stream(part, stream), stride * partCount);
+  }
+  for (unsigned int i = 0; i < part->indexCount; i++) {
+    grown.indices[indexBase + i] += vertexBase;
+  }
+  for (unsigned int v = 0; v < part->vertexCount; v++) {
+    grown.materialIds[vertexBase + v] += materialBase;
+  }
+
+  for (mesh_range_t range : part->meshes) {
+    range.materialIndex += materialBase;
+    range.vertexOffset += vertexBase;
+    range.indexOffset += indexBase;
+    range.meshletOffset += meshletBase;
+    for (unsigned int l = 0; l < range.lodCount; l++) {
+      range.lods[l].indexOffset += indexBase;
+    }
+    pool->meshes.push_back(range);
+  }
+  for (meshlet_t meshlet : part->meshlets) {
+    meshlet.indexOffset += indexBase;
+    pool->meshlets.push_back(meshlet);
+  }
+  pool->materials.insert(pool->materials.end(), part->materials.begin(), part->materials.end());
+  pool->diffuseMapPaths.insert(pool->diffuseMapPaths.end(), part->diffuseMapPaths.begin(), part->diffuseMapPaths.end());
+  pool->normalMapPaths.insert(pool->normalMapPaths.end(), part->normalMapPaths.begin(), part->normalMapPaths.end());
+
+  free_model(*pool);
+  pool->arena = data;
+  pool->arenaSize = total;
+  pool->vertexCount = grown.vertexCount;
+  pool->indexCount = grown.indexCount;
+  pool->vertexOffset = grown.vertexCount;
+  pool->indexOffset = grown.indexCount;
+  layout_model(pool, data);
+  return 0;
+}
+
+/**
+ * Loads one asset from its scene cache, or else with a native loader or assimp, baking the cache.
+ * The native loaders return 1 for files they leave to assimp. The import report times assimp's steps,
+ * so it always goes through assimp.
+ */
+static int load_asset(model_t *model, const char *path, const load_options_t *options) {
+  const char *source = "warm start";
+  if (options->importReport || load_scene_cache(model, path, options) < 0) {
+    bool native = options->nativeLoaders && !options->importReport;
+    int result = native ? load_gltf(model, path, options) : 1;
+    source = "cold start, native glTF";
+    if (result == 1 && native) {
+      result = load_obj(model, path, options);
+      source = "cold start, native OBJ";
+    }
+    if (result == 1) {
+      result = import_model(model, path, options);
+      source = "cold start, assimp";
+    }
+    if (result < 0) {
+      printf("Failed to load %s\n", path);
+      return -1;
+    }
+    write_scene_cache(model, path, options);
+  }
+  printf("Loaded %s (%s): %u vertices, %u indices\n", path, source, model->vertexCount, model->indexCount);
+  return 0;
+}
+
+/**
+ * Loads every asset into the shared model. Assets are cached one by one, so scenes that share files share
+ * their caches. The first asset is loaded in place, which keeps a single asset scene's warm start zero-copy,
+ * the others are appended to it.
+ */
+int load_scene(model_t *model, std::vector<scene_asset_t> *assets, const load_options_t *options) {
+  for (scene_asset_t &asset : *assets) {
+    bool first = model->arena == NULL;
+    model_t part = {};
+    model_t *target = first ? model : &part;
+    if (load_asset(target, asset.path.c_str(), options) < 0) {
+      free_model(part);
+      return -1;
+    }
+
+    asset.meshOffset = first ? 0 : model->meshes.size();
+    asset.meshCount = target->meshes.size();
+    asset.vertexOffset = first ? 0 : model->vertexCount;
+    asset.vertexCapacity = target->vertexCount;
+    asset.materialOffset = first ? 0 : model->materials.size();
+    asset.materialCapacity = target->materials.size();
+    if (!first) {
+      int result = append_model(model, &part);
+      free_model(part);
+      if (result < 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Records every asset's span of the element buffer, which holds indexBytes of packed indices.
+ * The packing goes mesh by mesh, so each asset's ranges are contiguous, and an asset's span reaches up to the next one's.
+ */
+void assign_index_spans(std::vector<scene_asset_t> *assets, const std::vector<draw_range_t> &ranges, size_t indexBytes) {
+  const draw_range_t *rangesEnd = ranges.data() + ranges.size();
+  auto beforeMesh = [](const draw_range_t &range, unsigned int mesh) { return range.mesh < mesh; };
+  size_t end = indexBytes;
+  for (size_t a = assets->size(); a-- > 0;) {
+    scene_asset_t &asset = (*assets)[a];
+    const draw_range_t *first = std::lower_bound(ranges.data(), rangesEnd, asset.meshOffset, beforeMesh);
+    bool empty = first == rangesEnd || first->mesh >= asset.meshOffset + asset.meshCount;
+    asset.indexByteOffset = empty ? end : first->byteOffset;
+    asset.indexByteCapacity = end - asset.indexByteOffset;
+    end = asset.indexByteOffset;
+  }
+}
+
+/**
+ * Re-imports one asset and writes it over its old share of the buffers with glBufferSubData,
+ * leaving the rest of the scene's buffers untouched. Its meshes in model and its draw ranges are replaced,
+ * and the following assets' meshes shift if the number of meshes changed.
+ * Returns 1 without changing anything if the asset outgrew its share, then only reload_scene() helps,
+ * and -1 if it can't be loaded.
+ */
+int reload_asset(std::vector<scene_asset_t> *assets, unsigned int index, model_t *model, std::vector<draw_range_t> *ranges,
+                 const load_options_t *options, const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                 material_textures_t *textures, texture_loader_t *textureLoader) {
+  scene_asset_t &asset = (*assets)[index];
+  model_t loaded = {};
+  if (load_asset(&loaded, asset.path.c_str(), options) < 0) {
+    free_model(loaded);
+    return -1;
+  }
+  // The copy lives on the heap, so it can be rebased even if the cache was mapped read only.
+  model_t part = {};
+  int copied = append_model(&part, &loaded);
+  free_model(loaded);
+  if (copied < 0) {
+    return -1;
+  }
+  if (part.vertexCount > asset.vertexCapacity || part.materials.size() > asset.materialCapacity) {
+    free_model(part);
+    return 1;
+  }
+
+  // Rebased onto the asset's place in the pool, the packed indices can go straight into its span.
+  for (unsigned int i = 0; i < part.indexCount; i++) {
+    part.indices[i] += asset.vertexOffset;
+  }
+  for (unsigned int v = 0; v < part.vertexCount; v++) {
+    part.materialIds[v] += asset.materialOffset;
+  }
+  std::vector<char> packed;
+  std::vector<draw_range_t> partRanges;
+  for (unsigned int m = 0; m < part.meshes.size(); m++) {
+    const mesh_range_t &range = part.meshes[m];
+    const meshlet_t *meshlets = range.meshletCount > 0 ? &part.meshlets[range.meshletOffset] : NULL;
+    pack_mesh_indices(&part, m, meshlets, asset.indexByteOffset + packed.size(), &packed, &partRanges);
+  }
+  if (packed.size() > asset.indexByteCapacity) {
+    free_model(part);
+    return 1;
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, asset.indexByteOffset, packed.size(), packed.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  upload_vertices_at(buffers, &part, asset.vertexOffset);
+  update_materials(materialBuffer, asset.materialOffset, part.materials.data(), part.materials.size());
+  // A re-export may point the materials at other maps, those are queued.
+  set_material_maps(textures, textureLoader, asset.materialOffset, part.diffuseMapPaths, part.normalMapPaths);
+
+  // Swap the asset's meshes and ranges, the ranges of the assets behind it follow their meshes.
+  int meshDelta = (int)part.meshes.size() - (int)asset.meshCount;
+  auto beforeMesh = [](const draw_range_t &range, unsigned int mesh) { return range.mesh < mesh; };
+  auto begin = std::lower_bound(ranges->begin(), ranges->end(), asset.meshOffset, beforeMesh);
+  auto end = std::lower_bound(begin, ranges->end(), asset.meshOffset + asset.meshCount, beforeMesh);
+  size_t rangeIndex = ranges->erase(begin, end) - ranges->begin();
+  for (size_t r = rangeIndex; r < ranges->size(); r++) {
+    (*ranges)[r].mesh += meshDelta;
+  }
+  for (draw_range_t &draw : partRanges) {
+    draw.mesh += asset.meshOffset;
+  }
+  ranges->insert(ranges->begin() + rangeIndex, partRanges.begin(), partRanges.end());
+
+  for (mesh_range_t &range : part.meshes) {
+    range.vertexOffset += asset.vertexOffset;
+    range.materialIndex += asset.materialOffset;
+  }
+  model->meshes.erase(model->meshes.begin() + asset.meshOffset, model->meshes.begin() + asset.meshOffset + asset.meshCount);
+  model->meshes.insert(model->meshes.begin() + asset.meshOffset, part.meshes.begin(), part.meshes.end());
+  for (size_t a = index + 1; a < assets->size(); a++) {
+    (*assets)[a].meshOffset += meshDelta;
+  }
+  asset.meshCount = part.meshes.size();
+  free_model(part);
+  return 0;
+}
+
+/**
+ * Reloads every asset, the unchanged ones from their caches, and uploads the whole pool again.
+ * For changes that outgrew their asset's share of the buffers. The scene's VAO has to be bound.
+ * Nothing changes if an asset fails to load.
+ */
+int reload_scene(std::vector<scene_asset_t> *assets, model_t *model, std::vector<draw_range_t> *ranges,
+                 const load_options_t *options, const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                 material_textures_t *textures, texture_loader_t *textureLoader) {
+  std::vector<scene_asset_t> reloadedAssets = *assets;
+  model_t reloaded = {};
+  if (load_scene(&reloaded, &reloadedAssets, options) < 0) {
+    free_model(reloaded);
+    return -1;
+  }
+
+  ranges->clear();
+  size_t indexBytes = upload_model_buffers(buffers, &reloaded, ranges);
+  upload_materials(materialBuffer, reloaded.materials);
+  set_material_maps(textures, textureLoader, 0, reloaded.diffuseMapPaths, reloaded.normalMapPaths);
+  assign_index_spans(&reloadedAssets, *ranges, indexBytes);
+  // Like after the first upload, only the meshes stay on the CPU.
+  free_model(reloaded);
+
+  *assets = reloadedAssets;
+  free_model(*model);
+  *model = reloaded;
+  return 0;
+}
+
+/**
+ * Reloads whatever the changed files (canonical paths, see poll_asset_watcher()) belong to:
+ * an asset's geometry goes over its old share of the buffers, a map is queued to replace its layer.
+ * Only if a reloaded asset outgrew its share is the whole pool uploaded again.
+ */
+void reload_changed_assets(const std::vector<std::string> &changed, std::vector<scene_asset_t> *assets, model_t *model,
+                           std::vector<draw_range_t> *ranges, const load_options_t *options,
+                           const unsigned int buffers[MODEL_STREAM_COUNT], unsigned int materialBuffer,
+                           material_textures_t *textures, texture_loader_t *textureLoader) {
+  auto was_changed = [&](const std::string &path) {
+    return !path.empty() && std::find(changed.begin(), changed.end(), canonical_path(path)) != changed.end();
+  };
+
+  bool outgrown = false;
+  for (unsigned int a = 0; a < assets->size(); a++) {
+    scene_asset_t &asset = (*assets)[a];
+    bool geometry = false;
+    for (const std::string &file : scene_source_files(asset.path.c_str())) {
+      geometry = geometry || was_changed(file);
+    }
+    if (geometry && !outgrown) {
+      int result = reload_asset(assets, a, model, ranges, options, buffers, materialBuffer, textures, textureLoader);
+      if (result == 0) {
+        printf("Reloaded %s in place\n", asset.path.c_str());
+      }
+      outgrown = result == 1;
+    }
+  }
+  for (const std::string &path : material_map_paths(textures)) {
+    if (was_changed(path)) {
+      reload_material_map(textures, textureLoader, path);
+    }
+  }
+
+  if (outgrown) {
+    printf("A reloaded asset outgrew its share of the buffers, uploading the whole scene again\n");
+    reload_scene(assets, model, ranges, options, buffers, materialBuffer, textures, textureLoader);
+  }
+}
+
+/**
+ * Draws every asset's share of ranges with program, setting its model matrix. All assets share the bound VAO,
+ * and the materials' maps are bound once for all of them, see bind_material_textures().
+ * view is in world space and moved into every asset's space for culling and level selection, NULL draws everything.
+ * ranges are ordered by mesh, so each asset's share is found by binary search.
+ */
+void draw_scene(unsigned int program, const std::vector<scene_asset_t> &assets, const std::vector<mesh_range_t> &meshes,
+                const std::vector<draw_range_t> &ranges, const cull_view_t *view, cull_stats_t *stats) {
+  int modelLoc = glGetUniformLocation(program, "model");
+  const draw_range_t *rangesEnd = ranges.data() + ranges.size();
+  auto beforeMesh = [](const draw_range_t &range, unsigned int mesh) { return range.mesh < mesh; };
+
+  for (const scene_asset_t &asset : assets) {
+    const draw_range_t *begin = std::lower_bound(ranges.data(), rangesEnd, asset.meshOffset, beforeMesh);
+    const draw_range_t *end = std::lower_bound(begin, rangesEnd, asset.meshOffset + asset.meshCount, beforeMesh);
+    if (begin == end) {
+      continue;
+    }
+
+    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &asset.transform[0][0]);
+
+    cull_view_t local;
+    if (view) {
+      transform_cull_view(&local, view, asset.transform, asset.inverseTransform);
+    }
+    draw_meshes(program, meshes, begin, end - begin, view ? &local : NULL, stats);
+  }
+}
+
+/**
+ * Requests the mip levels every mesh in view needs of its material's maps, see request_material_level().
+ * Like select_mesh_lod(), a mesh is measured at the point of its bounds closest to the eye, where a pixel covers
+ * distance / pixelScale units, pixelScale being the size in pixels of one world unit at distance one.
+ */
+void request_scene_levels(material_textures_t *textures, const std::vector<scene_asset_t> &assets,
+                          const std::vector<mesh_range_t> &meshes, const cull_view_t *view, float pixelScale) {
+  for (const scene_asset_t &asset : assets) {
+    cull_view_t local;
+    transform_cull_view(&local, view, asset.transform, asset.inverseTransform);
+    for (unsigned int m = asset.meshOffset; m < asset.meshOffset + asset.meshCount && m < meshes.size(); m++) {
+      const mesh_range_t &mesh = meshes[m];
+      aiVector3D center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+      float radius = (mesh.boundsMax - center).Length();
+      if (!sphere_visible(&local, &center.x, radius)) {
+        continue;
+      }
+      float distance = (center - aiVector3D(local.eye[0], local.eye[1], local.eye[2])).Length() - radius;
+      float uvPerPixel = distance > 0.0f ? mesh.uvDensity * distance / pixelScale : 0.0f;
+      request_material_level(textures, mesh.materialIndex, uvPerPixel);
+    }
+  }
+}
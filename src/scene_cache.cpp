@@ -0,0 +1,305 @@
+#include <scene_cache.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SCENE_CACHE_MAGIC[8] = {'S', 'C', 'N', 'C', 'A', 'C', 'H', 'E'};
+
+/**
+ * Fixed size header at the start of every cache file.
+ * It is followed by the mesh ranges, the material table, the meshlets and the materials' map paths,
+ * and the arena starts at the next page boundary (arenaOffset),
+ * so every stream can be handed to glBufferData straight from the mapped pages.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t postProcessFlags;
+  uint32_t passes;
+  uint32_t reserved;
+  uint64_t sourceHash;
+
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint64_t arenaOffset;
+  uint64_t arenaSize;
+
+  uint32_t meshCount;
+  uint32_t materialCount;
+  uint32_t meshletCount;
+  uint32_t mapPathsSize; // bytes of map_path_lengths() plus the paths themselves
+} scene_cache_header_t;
+
+/**
+ * Lengths of every material's diffuse and normal map path, in that order, which precede the paths in the cache.
+ * Returns the bytes the lengths and paths take together.
+ */
+static size_t map_path_lengths(const model_t *model, std::vector<uint32_t> *lengths) {
+  size_t size = 0;
+  for (size_t m = 0; m < model->materials.size(); m++) {
+    lengths->push_back(model->diffuseMapPaths[m].size());
+    lengths->push_back(model->normalMapPaths[m].size());
+    size += model->diffuseMapPaths[m].size() + model->normalMapPaths[m].size();
+  }
+  return size + sizeof(uint32_t) * lengths->size();
+}
+
+// Reads the map paths of materialCount materials back, returns false if they don't add up to size bytes.
+static bool read_map_paths(model_t *model, const char *data, size_t size, uint32_t materialCount) {
+  size_t lengthsSize = sizeof(uint32_t) * 2 * (size_t)materialCount;
+  if (lengthsSize > size) {
+    return false;
+  }
+  const char *path = data + lengthsSize;
+  model->diffuseMapPaths.resize(materialCount);
+  model->normalMapPaths.resize(materialCount);
+  for (uint32_t m = 0; m < 2 * materialCount; m++) {
+    uint32_t length;
+    memcpy(&length, data + sizeof(uint32_t) * m, sizeof(length));
+    if (length > (size_t)(data + size - path)) {
+      return false;
+    }
+    (m % 2 == 0 ? model->diffuseMapPaths : model->normalMapPaths)[m / 2].assign(path, length);
+    path += length;
+  }
+  return path == data + size;
+}
+
+// The options that change the model's contents beyond assimp's flags, one bit each.
+static uint32_t model_passes(const load_options_t *options) {
+  uint32_t passes = 0;
+  if (options->optimize) {
+    passes |= 1 << 0;
+  }
+  if (options->weld) {
+    passes |= 1 << 1;
+  }
+  if (options->meshlets) {
+    passes |= 1 << 2;
+  }
+  if (options->lods) {
+    passes |= 1 << 3;
+  }
+  if (options->nativeLoaders) {
+    passes |= 1 << 4;
+  }
+  return passes;
+}
+
+std::string scene_cache_path(const char *scenePath) {
+  return std::string(scenePath) + ".scenecache";
+}
+
+// FNV-1a over 8 byte words, the tail is processed bytewise. Start from 0xcbf29ce484222325 or a previous hash.
+uint64_t hash_bytes(uint64_t hash, const unsigned char *data, size_t size) {
+  const uint64_t prime = 0x100000001b3ULL;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * prime;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ data[i]) * prime;
+  }
+  return hash;
+}
+
+// Hashes the whole file, returns 0 if it does not exist.
+static int hash_file(uint64_t *hash, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, info.st_size, MADV_SEQUENTIAL);
+      *hash = hash_bytes(*hash, (const unsigned char *)data, info.st_size);
+      munmap(data, info.st_size);
+    }
+  }
+  close(fd);
+  return 1;
+}
+
+// Hashes the file at path on its own, e.g. the image behind a texture cache.
+uint64_t hash_source_file(const char *path) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash_file(&hash, path);
+  return hash;
+}
+
+/**
+ * The files a scene is made of: the scene file itself and, for .gltf files, the buffer that holds the geometry,
+ * for .obj files the material library. Blender exports both next to the scene with the same name.
+ */
+std::vector<std::string> scene_source_files(const char *scenePath) {
+  std::vector<std::string> files(1, scenePath);
+  std::string path(scenePath);
+  size_t extension = path.rfind('.');
+  if (extension != std::string::npos && path.compare(extension, std::string::npos, ".gltf") == 0) {
+    files.push_back(path.substr(0, extension) + ".bin");
+  } else if (extension != std::string::npos && path.compare(extension, std::string::npos, ".obj") == 0) {
+    files.push_back(path.substr(0, extension) + ".mtl");
+  }
+  return files;
+}
+
+// Hashes all files of the scene, see scene_source_files().
+uint64_t hash_scene_source(const char *scenePath) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const std::string &file : scene_source_files(scenePath)) {
+    hash_file(&hash, file.c_str());
+  }
+  return hash;
+}
+
+/**
+ * Maps the cache of scenePath and points the model into it.
+ * Returns -1 if there is no cache, or if it was built from a different source, different options or an older version.
+ * The mapping is released by free_model(), typically right after the upload.
+ */
+int load_scene_cache(model_t *model, const char *scenePath, const load_options_t *options) {
+  std::string cachePath = scene_cache_path(scenePath);
+  int fd = open(cachePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(scene_cache_header_t)) {
+    close(fd);
+    return -1;
+  }
+
+  size_t fileSize = info.st_size;
+  char *data = (char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  scene_cache_header_t header;
+  memcpy(&header, data, sizeof(header));
+
+  model_t cached = {};
+  cached.vertexCount = header.vertexCount;
+  cached.indexCount = header.indexCount;
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  size_t arenaSize = model_stream_sizes(&cached, streamSizes);
+  size_t meshesSize = sizeof(mesh_range_t) * (size_t)header.meshCount;
+  size_t materialsSize = sizeof(aiColor4D) * (size_t)header.materialCount;
+  size_t meshletsSize = sizeof(meshlet_t) * (size_t)header.meshletCount;
+  size_t stringsEnd = sizeof(header) + meshesSize + materialsSize + meshletsSize + header.mapPathsSize;
+
+  if (memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0 ||
+      header.version != SCENE_CACHE_VERSION ||
+      header.postProcessFlags != options->postProcessFlags ||
+      header.passes != model_passes(options) ||
+      header.arenaSize != arenaSize ||
+      header.arenaOffset < stringsEnd ||
+      header.arenaOffset + header.arenaSize > fileSize ||
+      header.sourceHash != hash_scene_source(scenePath) ||
+      !read_map_paths(&cached, data + stringsEnd - header.mapPathsSize, header.mapPathsSize, header.materialCount)) {
+    printf("Scene cache %s is stale, re-importing.\n", cachePath.c_str());
+    munmap(data, fileSize);
+    return -1;
+  }
+
+  mesh_range_t *meshes = (mesh_range_t *)(data + sizeof(header));
+  model->meshes.assign(meshes, meshes + header.meshCount);
+
+  aiColor4D *materials = (aiColor4D *)(data + sizeof(header) + meshesSize);
+  model->materials.assign(materials, materials + header.materialCount);
+
+  meshlet_t *meshlets = (meshlet_t *)(data + sizeof(header) + meshesSize + materialsSize);
+  model->meshlets.assign(meshlets, meshlets + header.meshletCount);
+  model->diffuseMapPaths = std::move(cached.diffuseMapPaths);
+  model->normalMapPaths = std::move(cached.normalMapPaths);
+
+  model->vertexCount = header.vertexCount;
+  model->indexCount = header.indexCount;
+  model->vertexOffset = header.vertexCount;
+  model->indexOffset = header.indexCount;
+  model->arena = data + header.arenaOffset;
+  model->arenaSize = header.arenaSize;
+  model->mapping = data;
+  model->mappingSize = fileSize;
+  layout_model(model, model->arena);
+
+  // The whole arena is about to be read front to back by the upload.
+  // Advice values are not flags, so each needs its own call.
+  madvise(model->arena, model->arenaSize, MADV_SEQUENTIAL);
+  madvise(model->arena, model->arenaSize, MADV_WILLNEED);
+
+  return 0;
+}
+
+/**
+ * Writes the extracted model to the cache of scenePath.
+ * The file is written next to the final one first and then renamed, so a crash never leaves a half written cache behind.
+ */
+int write_scene_cache(const model_t *model, const char *scenePath, const load_options_t *options) {
+  scene_cache_header_t header = {};
+  memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+  header.version = SCENE_CACHE_VERSION;
+  header.postProcessFlags = options->postProcessFlags;
+  header.passes = model_passes(options);
+  header.sourceHash = hash_scene_source(scenePath);
+  header.vertexCount = model->vertexCount;
+  header.indexCount = model->indexCount;
+  header.arenaSize = model->arenaSize;
+  header.meshCount = model->meshes.size();
+  header.materialCount = model->materials.size();
+  header.meshletCount = model->meshlets.size();
+  std::vector<uint32_t> mapPathLengths;
+  header.mapPathsSize = map_path_lengths(model, &mapPathLengths);
+
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t meshesSize = sizeof(mesh_range_t) * model->meshes.size();
+  size_t materialsSize = sizeof(aiColor4D) * model->materials.size();
+  size_t meshletsSize = sizeof(meshlet_t) * model->meshlets.size();
+  size_t stringsEnd = sizeof(header) + meshesSize + materialsSize + meshletsSize + header.mapPathsSize;
+  header.arenaOffset = (stringsEnd + pageSize - 1) / pageSize * pageSize;
+
+  std::string cachePath = scene_cache_path(scenePath);
+  std::string tempPath = cachePath + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open scene cache @ %s\n", tempPath.c_str());
+    return -1;
+  }
+
+  char padding[64] = {0};
+  size_t paddingSize = header.arenaOffset - stringsEnd;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && fwrite(model->meshes.data(), 1, meshesSize, file) == meshesSize;
+  ok = ok && fwrite(model->materials.data(), 1, materialsSize, file) == materialsSize;
+  ok = ok && fwrite(model->meshlets.data(), 1, meshletsSize, file) == meshletsSize;
+  ok = ok && fwrite(mapPathLengths.data(), sizeof(uint32_t), mapPathLengths.size(), file) == mapPathLengths.size();
+  for (size_t m = 0; ok && m < model->materials.size(); m++) {
+    for (const std::string *path : {&model->diffuseMapPaths[m], &model->normalMapPaths[m]}) {
+      ok = ok && fwrite(path->data(), 1, path->size(), file) == path->size();
+    }
+  }
+  while (ok && paddingSize > 0) {
+    size_t chunk = paddingSize < sizeof(padding) ? paddingSize : sizeof(padding);
+    ok = fwrite(padding, 1, chunk, file) == chunk;
+    paddingSize -= chunk;
+  }
+  ok = ok && fwrite(model->arena, 1, model->arenaSize, file) == model->arenaSize;
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+    fprintf(stderr, "Failed to write scene cache @ %s\n", cachePath.c_str());
+    unlink(tempPath.c_str());
+    return -1;
+  }
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include <shader.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Allocates memory for the code internally.
 char *read_shader_from_file(const char *filepath) {
@@ -34,3 +35,33 @@ char *read_shader_from_file(const char *filepath) {
   shader[fileSize] = '\0';
   return shader;
 }
+
+// Reads the shader like read_shader_from_file(), but inserts prelude right after the #version line.
+// GLSL 330 has no #include, so this is how shared declarations get into several shaders.
+char *read_shader_with_prelude(const char *filepath, const char *prelude) {
+  char *shader = read_shader_from_file(filepath);
+
+  // The #version directive has to stay the first line, so insert behind its line break.
+  char *version = strstr(shader, "#version");
+  char *insertAt = version ? strchr(version, '\n') : NULL;
+  size_t head = insertAt ? (size_t)(insertAt + 1 - shader) : 0;
+
+  size_t shaderLength = strlen(shader);
+  size_t preludeLength = strlen(prelude);
+  // Add one for a line break behind the prelude and one to accomodate null termination
+  char *combined = (char *)malloc(shaderLength + preludeLength + 2);
+  if (combined == NULL) {
+    fprintf(stderr, "Failed to allocate memory for shader code @ %s\n",
+            filepath);
+    free(shader);
+    exit(EXIT_FAILURE);
+  }
+
+  memcpy(combined, shader, head);
+  memcpy(combined + head, prelude, preludeLength);
+  combined[head + preludeLength] = '\n';
+  memcpy(combined + head + preludeLength + 1, shader + head, shaderLength - head + 1);
+
+  free(shader);
+  return combined;
+}
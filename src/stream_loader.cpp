@@ -0,0 +1,254 @@
+#include <stream_loader.h>
+#include <import_profile.h>
+#include <material.h>
+#include <mesh_optimize.h>
+#include <meshlet.h>
+#include <vertex_weld.h>
+#include <scene_cache.h>
+#include <vertex_format.h>
+#include <thread_pool.h>
+#include <assimp/cimport.h>
+#include <glad/glad.h>
+#include <stdio.h>
+
+static void stream_loader_worker(stream_loader_t *loader) {
+  model_t *model = &loader->model;
+  const char *scenePath = loader->scenePath.c_str();
+
+  if (!loader->options.importReport &&
+      load_scene_cache(model, scenePath, &loader->options) == 0) {
+    loader->state.store(STREAM_EXTRACTING, std::memory_order_release);
+    loader->meshesExtracted.store(model->meshes.size(), std::memory_order_release);
+  } else {
+    const C_STRUCT aiScene *scene = import_scene(scenePath, loader->options.postProcessFlags, loader->options.importReport);
+    if (scene == NULL) {
+      printf("Failed to load scene\n");
+      loader->state.store(STREAM_FAILED, std::memory_order_release);
+      return;
+    }
+
+    count_model(model, scene->mRootNode, scene);
+    extract_materials(model, scene);
+    if (allocate_model(model) < 0) {
+      aiReleaseImport(scene);
+      loader->state.store(STREAM_FAILED, std::memory_order_release);
+      return;
+    }
+    if (loader->options.meshlets) {
+      loader->meshMeshlets.resize(model->meshes.size());
+    }
+
+    // Levels grow the index stream behind the full resolution indices, which can't happen under the render thread.
+    // A cache built without --stream brings them along, this import (and the cache it writes) goes without.
+    if (loader->options.lods) {
+      printf("Detail levels are not built while streaming an import, load once without --stream to cache them\n");
+      loader->options.lods = false;
+    }
+    // Streaming extracts from assimp's scene, so the cache is marked as assimp's whatever the file type.
+    loader->options.nativeLoaders = false;
+
+    // From here on the render thread may reserve the GL buffers.
+    loader->state.store(STREAM_EXTRACTING, std::memory_order_release);
+
+    optimize_stats_t stats = {};
+    weld_stats_t weldStats = {};
+    if (loader->options.parallelExtract) {
+      extract_indices_parallel(model, scene);
+      for (mesh_range_t &range : model->meshes) {
+        compute_mesh_bounds(model, &range);
+      }
+      // No compaction here, the render thread may already be reading the model's sizes.
+      if (loader->options.weld) {
+        for (mesh_range_t &range : model->meshes) {
+          weld_mesh(model, &range, &weldStats);
+        }
+      }
+      if (loader->options.optimize) {
+        optimize_model(model, &stats);
+      }
+      if (loader->options.meshlets) {
+        parallel_for(model->meshes.size(), [&](size_t m) {
+          build_mesh_meshlets(model, model->meshes[m], &loader->meshMeshlets[m]);
+          model->meshes[m].meshletCount = loader->meshMeshlets[m].size();
+        });
+      }
+      loader->meshesExtracted.store(model->meshes.size(), std::memory_order_release);
+    } else {
+      // Each mesh is welded, optimised and clustered before it is published, since the upload may start right after.
+      // Welded meshes keep their place, the unused tail of their range is simply never uploaded.
+      for (unsigned int i = 0; i < model->meshes.size(); i++) {
+        extract_mesh(model, scene, model->meshes[i]);
+        compute_mesh_bounds(model, &model->meshes[i]);
+        if (loader->options.weld) {
+          weld_mesh(model, &model->meshes[i], &weldStats);
+        }
+        if (loader->options.optimize) {
+          optimize_mesh(model, model->meshes[i], &stats);
+        }
+        if (loader->options.meshlets) {
+          build_mesh_meshlets(model, model->meshes[i], &loader->meshMeshlets[i]);
+          model->meshes[i].meshletCount = loader->meshMeshlets[i].size();
+        }
+        loader->meshesExtracted.store(i + 1, std::memory_order_release);
+      }
+      model->vertexOffset = model->vertexCount;
+      model->indexOffset = model->indexCount;
+    }
+    extract_textures(model, scene);
+    aiReleaseImport(scene);
+    if (loader->options.weld) {
+      print_weld_stats(&weldStats);
+    }
+    print_optimize_stats(&stats);
+    if (loader->options.meshlets) {
+      // The render thread keeps reading meshMeshlets, the gathered copy is for the cache.
+      meshlet_stats_t meshletStats = {};
+      gather_meshlets(model, loader->meshMeshlets, &meshletStats);
+      print_meshlet_stats(&meshletStats);
+    }
+
+    write_scene_cache(model, scenePath, &loader->options);
+  }
+
+  loader->state.store(STREAM_DONE, std::memory_order_release);
+}
+
+/**
+ * Starts loading scenePath in the background. Call stream_loader_update() once per frame afterwards.
+ */
+void start_stream_loader(stream_loader_t *loader, const char *scenePath, const load_options_t *options) {
+  loader->scenePath = scenePath;
+  loader->options = *options;
+  loader->state.store(STREAM_IMPORTING);
+  loader->meshesExtracted.store(0);
+  loader->worker = std::thread(stream_loader_worker, loader);
+}
+
+/**
+ * Uploads up to budget bytes of extracted meshes into buffers, which are ordered like the model's streams.
+ * The buffers are reserved at their final size as soon as the sizes are known, so later uploads only fill sub ranges.
+ * A mesh becomes drawable once all of its streams are uploaded. The material table goes to materialBuffer right away.
+ * Returns true once the whole scene is on the GPU. The CPU copy of the geometry is released at that point,
+ * the materials and their map paths stay in model for the caller to queue.
+ */
+bool stream_loader_update(stream_loader_t *loader, const unsigned int buffers[MODEL_STREAM_COUNT],
+                          unsigned int materialBuffer, size_t budget) {
+  if (loader->finished) {
+    return true;
+  }
+
+  int state = loader->state.load(std::memory_order_acquire);
+  if (state == STREAM_IMPORTING) {
+    return false;
+  }
+  if (state == STREAM_FAILED) {
+    loader->worker.join();
+    loader->finished = true;
+    return true;
+  }
+
+  model_t *model = &loader->model;
+
+  // The copy write target leaves the VAO's element buffer binding alone.
+  if (!loader->reserved) {
+    size_t streamSizes[MODEL_STREAM_COUNT];
+    gpu_stream_sizes(model, streamSizes);
+    for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[stream]);
+      glBufferData(GL_COPY_WRITE_BUFFER, streamSizes[stream], NULL, GL_STATIC_DRAW);
+    }
+    // The material table is complete before the first mesh, and small enough to go in one piece.
+    upload_materials(materialBuffer, model->materials);
+    loader->reserved = true;
+  }
+
+  unsigned int meshesExtracted = loader->meshesExtracted.load(std::memory_order_acquire);
+  while (budget > 0 && loader->meshesUploaded < meshesExtracted) {
+    const mesh_range_t &range = model->meshes[loader->meshesUploaded];
+    int stream = loader->uploadStream;
+    size_t stride = model_stream_stride(stream);
+    size_t offset = stride * range.vertexOffset;
+    const char *source = model_stream(model, stream) + offset;
+    size_t size = stride * range.vertexCount;
+    if (stream == 0) {
+      // Indices are packed into 16 or 32 bit draw ranges once per mesh, right behind the previous mesh.
+      if (loader->uploadStreamBytes == 0) {
+        loader->packedIndices.clear();
+        loader->pendingRanges.clear();
+        const meshlet_t *meshlets = NULL;
+        if (range.meshletCount > 0) {
+          meshlets = loader->meshMeshlets.empty() ? &model->meshlets[range.meshletOffset]
+                                                  : loader->meshMeshlets[loader->meshesUploaded].data();
+        }
+        pack_mesh_indices(model, loader->meshesUploaded, meshlets, loader->indexBytes,
+                          &loader->packedIndices, &loader->pendingRanges);
+      }
+      offset = loader->indexBytes;
+      source = loader->packedIndices.data();
+      size = loader->packedIndices.size();
+    }
+#ifdef COMPACT_VERTICES
+    // Stream 1 carries the whole interleaved vertex, encoded once per mesh.
+    if (stream == 1) {
+      if (loader->uploadStreamBytes == 0) {
+        loader->compactVertices.resize(range.vertexCount);
+        encode_compact_vertices(model, range, loader->compactVertices.data());
+      }
+      offset = sizeof(compact_vertex_t) * range.vertexOffset;
+      source = (const char *)loader->compactVertices.data();
+      size = sizeof(compact_vertex_t) * range.vertexCount;
+    }
+#endif
+
+    size_t chunk = size - loader->uploadStreamBytes;
+    if (chunk > budget) {
+      chunk = budget;
+    }
+    if (chunk > 0) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[stream]);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, offset + loader->uploadStreamBytes, chunk,
+                      source + loader->uploadStreamBytes);
+    }
+    budget -= chunk;
+    loader->uploadStreamBytes += chunk;
+
+    if (loader->uploadStreamBytes == size) {
+      if (stream == 0) {
+        loader->indexBytes += size;
+      }
+      loader->uploadStreamBytes = 0;
+      loader->uploadStream++;
+#ifdef COMPACT_VERTICES
+      if (loader->uploadStream == 2) {
+        loader->uploadStream = MODEL_STREAM_COUNT;
+      }
+#endif
+      if (loader->uploadStream == MODEL_STREAM_COUNT) {
+        loader->uploadStream = 0;
+        loader->meshesUploaded++;
+        loader->drawRanges.insert(loader->drawRanges.end(), loader->pendingRanges.begin(), loader->pendingRanges.end());
+      }
+    }
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  if (state != STREAM_DONE || loader->meshesUploaded < model->meshes.size()) {
+    return false;
+  }
+
+  loader->worker.join();
+  free_model(*model);
+  loader->finished = true;
+  return true;
+}
+
+// Fraction of the scene that is drawable, in [0, 1].
+float stream_loader_progress(const stream_loader_t *loader) {
+  if (loader->finished) {
+    return 1.0f;
+  }
+  if (loader->state.load(std::memory_order_acquire) == STREAM_IMPORTING || loader->model.meshes.empty()) {
+    return 0.0f;
+  }
+  return (float)loader->meshesUploaded / (float)loader->model.meshes.size();
+}
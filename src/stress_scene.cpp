@@ -0,0 +1,229 @@
+#include <stress_scene.h>
+#include <thread_pool.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Edge length of a box, and the distance between neighbouring boxes.
+#define STRESS_BOX_SIZE 5.5f
+#define STRESS_BOX_SPACING 6.0f
+// Distance at which a generated light has faded out, a little more than one box.
+#define STRESS_LIGHT_RADIUS 6.0f
+
+// Per box: the white floor, ceiling and back wall, the red wall, the green wall, the short and the tall block.
+#define STRESS_MESHES_PER_BOX 5
+#define STRESS_QUADS_PER_BOX (3 + 1 + 1 + 5 + 5)
+#define STRESS_VERTICES_PER_BOX (4 * STRESS_QUADS_PER_BOX)
+#define STRESS_INDICES_PER_BOX (6 * STRESS_QUADS_PER_BOX)
+
+enum { STRESS_WHITE, STRESS_RED, STRESS_GREEN };
+
+// Write cursor into one box's share of the model.
+typedef struct {
+  model_t *model;
+  unsigned int vertex;
+  unsigned int index;
+} stress_writer_t;
+
+// Small deterministic generator, so runs of the same size build the same scene. Returns a value in [0, 1).
+static float next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float radians(float degrees) {
+  return degrees * (float)M_PI / 180.0f;
+}
+
+/**
+ * Appends a flat quad whose corners are given in order around it, wound counter-clockwise seen from where normal
+ * points to. Its texture coordinates are all 0, the generated materials have no maps.
+ */
+static void add_quad(stress_writer_t *writer, const aiVector3D corners[4], const aiVector3D &normal, unsigned int material) {
+  model_t *model = writer->model;
+  aiVector3D tangent = corners[1] - corners[0];
+  tangent.NormalizeSafe();
+  aiVector3D bitangent = normal ^ tangent;
+
+  unsigned int base = writer->vertex;
+  for (int c = 0; c < 4; c++) {
+    model->vertices[base + c] = corners[c];
+    model->materialIds[base + c] = material;
+    model->normals[base + c] = normal;
+    model->uvs[base + c] = aiVector2D(0.0f, 0.0f);
+    model->tangents[base + c] = tangent;
+    model->bitangents[base + c] = bitangent;
+  }
+
+  static const unsigned int order[6] = {0, 1, 2, 0, 2, 3};
+  static const unsigned int reversed[6] = {0, 2, 1, 0, 3, 2};
+  bool flip = ((corners[1] - corners[0]) ^ (corners[2] - corners[0])) * normal < 0.0f;
+  for (int i = 0; i < 6; i++) {
+    model->indices[writer->index + i] = base + (flip ? reversed[i] : order[i]);
+  }
+  writer->vertex += 4;
+  writer->index += 6;
+}
+
+// Appends a block standing on the floor, its four sides and its top, turned about its vertical axis by angle radians.
+static void add_block(stress_writer_t *writer, const aiVector3D &center, float halfSize, float height, float angle) {
+  aiVector3D axisX(cosf(angle) * halfSize, 0.0f, -sinf(angle) * halfSize);
+  aiVector3D axisZ(sinf(angle) * halfSize, 0.0f, cosf(angle) * halfSize);
+  aiVector3D up(0.0f, height, 0.0f);
+  aiVector3D base[4] = {center - axisX - axisZ, center + axisX - axisZ, center + axisX + axisZ, center - axisX + axisZ};
+
+  for (int side = 0; side < 4; side++) {
+    const aiVector3D &a = base[side];
+    const aiVector3D &b = base[(side + 1) % 4];
+    aiVector3D corners[4] = {a, b, b + up, a + up};
+    aiVector3D normal = (a + b) * 0.5f - center;
+    normal.NormalizeSafe();
+    add_quad(writer, corners, normal, STRESS_WHITE);
+  }
+  aiVector3D top[4] = {base[0] + up, base[1] + up, base[2] + up, base[3] + up};
+  add_quad(writer, top, aiVector3D(0.0f, 1.0f, 0.0f), STRESS_WHITE);
+}
+
+// Boxes are stacked into a wall facing -z, as square as the count allows.
+static aiVector3D box_origin(unsigned int box, unsigned int columns) {
+  return aiVector3D((box % columns) * STRESS_BOX_SPACING, (box / columns) * STRESS_BOX_SPACING, 0.0f);
+}
+
+/**
+ * Writes box number box into its share of the model, laid out like the Cornell box: open towards -z,
+ * the red wall on the viewer's left, the green one on the right, and a short and a tall block whose
+ * height and turn vary from box to box.
+ */
+static void generate_box(model_t *model, unsigned int box, const aiVector3D &origin) {
+  stress_writer_t writer = {model, box * STRESS_VERTICES_PER_BOX, box * STRESS_INDICES_PER_BOX};
+  const float s = STRESS_BOX_SIZE;
+  aiVector3D p000 = origin, p100 = origin + aiVector3D(s, 0, 0), p010 = origin + aiVector3D(0, s, 0),
+             p110 = origin + aiVector3D(s, s, 0), p001 = origin + aiVector3D(0, 0, s),
+             p101 = origin + aiVector3D(s, 0, s), p011 = origin + aiVector3D(0, s, s), p111 = origin + aiVector3D(s, s, s);
+
+  aiVector3D floorQuad[4] = {p000, p100, p101, p001};
+  aiVector3D ceilingQuad[4] = {p010, p110, p111, p011};
+  aiVector3D backQuad[4] = {p001, p101, p111, p011};
+  aiVector3D leftQuad[4] = {p100, p101, p111, p110};
+  aiVector3D rightQuad[4] = {p000, p001, p011, p010};
+  add_quad(&writer, floorQuad, aiVector3D(0, 1, 0), STRESS_WHITE);
+  add_quad(&writer, ceilingQuad, aiVector3D(0, -1, 0), STRESS_WHITE);
+  add_quad(&writer, backQuad, aiVector3D(0, 0, -1), STRESS_WHITE);
+  add_quad(&writer, leftQuad, aiVector3D(-1, 0, 0), STRESS_RED);
+  add_quad(&writer, rightQuad, aiVector3D(1, 0, 0), STRESS_GREEN);
+
+  uint32_t random = box * 2654435761u + 1u;
+  float shortHeight = 1.65f * (0.8f + 0.4f * next_random(&random));
+  float shortAngle = radians(-17.0f + 10.0f * (next_random(&random) - 0.5f));
+  float tallHeight = 3.3f * (0.8f + 0.4f * next_random(&random));
+  float tallAngle = radians(17.0f + 10.0f * (next_random(&random) - 0.5f));
+  add_block(&writer, origin + aiVector3D(1.85f, 0.0f, 1.7f), 0.8f, shortHeight, shortAngle);
+  add_block(&writer, origin + aiVector3D(3.7f, 0.0f, 3.6f), 0.8f, tallHeight, tallAngle);
+}
+
+/**
+ * Builds a scene of stress->boxes Cornell boxes into model, for measuring how load time, memory and frame time
+ * scale with the scene. The model ends up exactly like a loaded one, including the passes of options.
+ * lights receives stress->lights point lights spread over the boxes' ceilings, mirrors one mirror on the back wall
+ * of each of the first stress->mirrors boxes. Both are capped at what the renderer supports.
+ * Returns -1 if the scene doesn't fit 32 bit indices or can't be allocated.
+ */
+int generate_stress_scene(model_t *model, const stress_options_t *stress, const load_options_t *options,
+                          std::vector<point_light_t> *lights, std::vector<mirror_t> *mirrors) {
+  unsigned int boxes = stress->boxes;
+  if (boxes == 0 || (uint64_t)boxes * STRESS_INDICES_PER_BOX > UINT32_MAX) {
+    printf("Can't generate %u boxes, at most %u fit\n", boxes, (unsigned int)(UINT32_MAX / STRESS_INDICES_PER_BOX));
+    return -1;
+  }
+
+  model->materials.push_back(aiColor4D(0.73f, 0.73f, 0.73f, 1.0f));
+  model->materials.push_back(aiColor4D(0.63f, 0.065f, 0.05f, 1.0f));
+  model->materials.push_back(aiColor4D(0.14f, 0.45f, 0.091f, 1.0f));
+  model->diffuseMapPaths.resize(model->materials.size());
+  model->normalMapPaths.resize(model->materials.size());
+
+  // Every box has the same layout, so all ranges are known up front.
+  static const unsigned int meshQuads[STRESS_MESHES_PER_BOX] = {3, 1, 1, 5, 5};
+  static const unsigned int meshMaterials[STRESS_MESHES_PER_BOX] = {STRESS_WHITE, STRESS_RED, STRESS_GREEN,
+                                                                    STRESS_WHITE, STRESS_WHITE};
+  model->meshes.resize((size_t)boxes * STRESS_MESHES_PER_BOX);
+  for (unsigned int box = 0; box < boxes; box++) {
+    for (unsigned int m = 0; m < STRESS_MESHES_PER_BOX; m++) {
+      mesh_range_t &range = model->meshes[box * STRESS_MESHES_PER_BOX + m];
+      range = {};
+      range.meshId = box * STRESS_MESHES_PER_BOX + m;
+      range.materialIndex = meshMaterials[m];
+      range.vertexOffset = model->vertexCount;
+      range.indexOffset = model->indexCount;
+      range.vertexCount = 4 * meshQuads[m];
+      range.indexCount = 6 * meshQuads[m];
+      model->vertexCount += range.vertexCount;
+      model->indexCount += range.indexCount;
+    }
+  }
+  if (allocate_model(model) < 0) {
+    return -1;
+  }
+
+  unsigned int columns = (unsigned int)ceil(sqrt((double)boxes));
+  parallel_for(boxes, [&](size_t box) {
+    generate_box(model, box, box_origin(box, columns));
+    for (unsigned int m = 0; m < STRESS_MESHES_PER_BOX; m++) {
+      compute_mesh_bounds(model, &model->meshes[box * STRESS_MESHES_PER_BOX + m]);
+    }
+  });
+  model->vertexOffset = model->vertexCount;
+  model->indexOffset = model->indexCount;
+
+  unsigned int lightCount = stress->lights;
+  if (lightCount > MAX_POINT_LIGHTS) {
+    printf("Generating %d instead of %u point lights, the most the shaders support\n", MAX_POINT_LIGHTS, lightCount);
+    lightCount = MAX_POINT_LIGHTS;
+  }
+  for (unsigned int i = 0; i < lightCount; i++) {
+    uint32_t random = i * 2246822519u + 7u;
+    aiVector3D origin = box_origin(i % boxes, columns);
+    point_light_t light = {};
+    light.position[0] = origin.x + 0.8f + 3.9f * next_random(&random);
+    light.position[1] = origin.y + STRESS_BOX_SIZE - 0.6f;
+    light.position[2] = origin.z + 0.8f + 3.9f * next_random(&random);
+    light.radius = STRESS_LIGHT_RADIUS;
+    for (int c = 0; c < 3; c++) {
+      light.color[c] = 0.4f + 0.6f * next_random(&random);
+    }
+    lights->push_back(light);
+  }
+
+  unsigned int mirrorCount = stress->mirrors;
+  unsigned int mirrorLimit = boxes < STRESS_MAX_MIRRORS ? boxes : STRESS_MAX_MIRRORS;
+  if (mirrorCount > mirrorLimit) {
+    printf("Generating %u instead of %u mirrors, one per box and at most %d\n", mirrorLimit, mirrorCount,
+           STRESS_MAX_MIRRORS);
+    mirrorCount = mirrorLimit;
+  }
+  // Just in front of the back wall, so the wall is clipped away from the mirrored view.
+  static const float mirrorCorners[4][3] = {
+    {0.6f, 0.4f, STRESS_BOX_SIZE - 0.01f},
+    {2.6f, 0.4f, STRESS_BOX_SIZE - 0.01f},
+    {2.6f, 3.6f, STRESS_BOX_SIZE - 0.01f},
+    {0.6f, 3.6f, STRESS_BOX_SIZE - 0.01f},
+  };
+  for (unsigned int i = 0; i < mirrorCount; i++) {
+    aiVector3D origin = box_origin(i, columns);
+    mirror_t mirror = {};
+    for (int c = 0; c < 4; c++) {
+      for (int k = 0; k < 3; k++) {
+        mirror.corners[c][k] = origin[k] + mirrorCorners[c][k];
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      mirror.point[k] = (mirror.corners[0][k] + mirror.corners[2][k]) * 0.5f;
+    }
+    mirror.normal[2] = -1.0f;
+    mirrors->push_back(mirror);
+  }
+
+  printf("Generated %u boxes (%zu meshes), %zu point lights and %zu mirrors\n", boxes, model->meshes.size(),
+         lights->size(), mirrors->size());
+  return run_model_passes(model, options);
+}
@@ -0,0 +1,185 @@
+#include <texture.h>
+#include <glad/glad.h>
+#include <filesystem>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+/**
+ * Decodes the image at path. Returns -1 and reports why if it cannot be loaded.
+ * Safe to call from any thread, since it does not touch GL.
+ */
+int decode_image(image_t *image, const char *path) {
+  image->data = stbi_load(path, &image->width, &image->height, &image->components, 0);
+  if (image->data == NULL) {
+    std::cout << "Current working dir: " << std::filesystem::current_path() << std::endl;
+    std::cout << path << ": " << stbi_failure_reason() << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+void free_image(image_t *image) {
+  stbi_image_free(image->data);
+  image->data = NULL;
+}
+
+// Sets up repeating, trilinear sampling of the texture bound to target, from its levels baseLevel to maxLevel.
+static void set_texture_sampling(GLenum target, int baseLevel, int maxLevel) {
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, baseLevel);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, maxLevel);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+/**
+ * Copies levels firstLevel to lastLevel of levels, which are contiguous in its data, into pixelBuffer, a pixel
+ * unpack buffer, and leaves it bound. Returns what the GL's data pointers are relative to, the offset of firstLevel
+ * subtracted: NULL for the buffer, or levels->data if there is no buffer or it can't be mapped.
+ */
+static const unsigned char *stage_texture_levels(const texture_levels_t *levels, uint32_t firstLevel,
+                                                 uint32_t lastLevel, unsigned int pixelBuffer) {
+  const unsigned char *first = levels->data + levels->levels[firstLevel].offset;
+  if (pixelBuffer == 0) {
+    return first;
+  }
+  const texture_level_t &last = levels->levels[lastLevel];
+  size_t size = last.offset + last.size - levels->levels[firstLevel].offset;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (mapped == NULL) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return first;
+  }
+  memcpy(mapped, first, size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  return NULL;
+}
+
+// Defines level of the bound array with that many layers of shape's size and format, uninitialised. 0 layers frees it.
+static void define_array_level(const texture_levels_t *shape, uint32_t level, unsigned int layers) {
+  const texture_level_t &size = shape->levels[level];
+  GLsizei width = layers > 0 ? size.width : 0, height = layers > 0 ? size.height : 0;
+  if (shape->format == 0) {
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, shape->internalFormat, width, height, layers, 0,
+                           size.size * layers, NULL);
+  } else {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, shape->internalFormat, width, height, layers, 0, shape->format,
+                 shape->type, NULL);
+  }
+}
+
+/**
+ * Allocates that many empty layers in texture, a GL_TEXTURE_2D_ARRAY, each with the size, format and levels of shape
+ * from firstLevel on. The finer levels are left undefined, which the GL allows below GL_TEXTURE_BASE_LEVEL, so they
+ * take no memory until allocate_texture_array_level() adds them. shape only describes the layers, its data isn't used.
+ * Sets up repeating, trilinear sampling from firstLevel.
+ */
+void allocate_texture_array(unsigned int texture, const texture_levels_t *shape, uint32_t firstLevel,
+                            unsigned int layers) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  for (uint32_t l = firstLevel; l < shape->levelCount; l++) {
+    define_array_level(shape, l, layers);
+  }
+  set_texture_sampling(GL_TEXTURE_2D_ARRAY, firstLevel, shape->levelCount - 1);
+}
+
+/**
+ * Allocates level of an array allocated by allocate_texture_array() for all of its layers, or frees it if layers
+ * is 0. Either way it isn't sampled until set_texture_array_base_level() includes it.
+ */
+void allocate_texture_array_level(unsigned int texture, const texture_levels_t *shape, uint32_t level,
+                                  unsigned int layers) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  define_array_level(shape, level, layers);
+}
+
+// Makes level the finest one texture, an array, is sampled at. The levels from it on have to be allocated.
+void set_texture_array_base_level(unsigned int texture, uint32_t level) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+/**
+ * Uploads levels firstLevel to lastLevel of levels into one layer of texture, an array allocated by
+ * allocate_texture_array() with the same size, format and levels.
+ * With a pixelBuffer the levels are copied into it in one go and the GL sources them from there, so the driver
+ * can transfer them whenever it suits it. Pass 0 to upload straight from levels->data.
+ */
+void upload_texture_layer(unsigned int texture, unsigned int layer, const texture_levels_t *levels,
+                          uint32_t firstLevel, uint32_t lastLevel, unsigned int pixelBuffer) {
+  const unsigned char *source = stage_texture_levels(levels, firstLevel, lastLevel, pixelBuffer);
+  uint64_t firstOffset = levels->levels[firstLevel].offset;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (uint32_t l = firstLevel; l <= lastLevel; l++) {
+    const texture_level_t &level = levels->levels[l];
+    if (levels->format == 0) {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, level.width, level.height, 1,
+                                levels->internalFormat, level.size, source + (level.offset - firstOffset));
+    } else {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, level.width, level.height, 1, levels->format, levels->type,
+                      source + (level.offset - firstOffset));
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/**
+ * Copies the first layers layers of source into target, both arrays of shape's size, format and levels,
+ * allocated from firstLevel on.
+ * GL 3.3 has no direct copy between textures, so every level goes through a buffer on the GPU:
+ * packed into it from source, then unpacked from it into target.
+ */
+void copy_texture_array(unsigned int source, unsigned int target, const texture_levels_t *shape, uint32_t firstLevel,
+                        unsigned int layers) {
+  unsigned int buffer;
+  glGenBuffers(1, &buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (uint32_t l = firstLevel; l < shape->levelCount; l++) {
+    const texture_level_t &level = shape->levels[l];
+    size_t size = level.size * layers;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_COPY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, source);
+    if (shape->format == 0) {
+      glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, l, NULL);
+    } else {
+      glGetTexImage(GL_TEXTURE_2D_ARRAY, l, shape->format, shape->type, NULL);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, target);
+    if (shape->format == 0) {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, level.width, level.height, layers,
+                                shape->internalFormat, size, NULL);
+    } else {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, level.width, level.height, layers, shape->format, shape->type,
+                      NULL);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glDeleteBuffers(1, &buffer);
+}
+
+void free_texture_levels(texture_levels_t *levels) {
+  if (levels->mapping != NULL) {
+    munmap(levels->mapping, levels->mappingSize);
+  } else {
+    free(levels->data);
+  }
+  levels->data = NULL;
+  levels->mapping = NULL;
+}
@@ -0,0 +1,136 @@
+#include <texture_cache.h>
+#include <scene_cache.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char TEXTURE_CACHE_MAGIC[8] = {'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+
+/**
+ * Fixed size header at the start of every texture cache, followed by the levels, finest first, from dataOffset on.
+ * dataOffset is page aligned, so the levels can be handed to the GL straight from the mapped pages.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t levelCount;
+  uint64_t sourceHash;
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t type;
+  uint32_t padding;
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  texture_level_t levels[TEXTURE_MAX_LEVELS]; // offsets are relative to dataOffset
+} texture_cache_header_t;
+
+std::string texture_cache_path(const char *imagePath) {
+  return std::string(imagePath) + ".texcache";
+}
+
+/**
+ * Maps the cache of imagePath and points levels into it.
+ * Returns -1 if there is no cache, or if it was built from a different image or by an older version.
+ * The mapping is released by free_texture_levels(), typically right after the upload.
+ */
+int load_texture_cache(texture_levels_t *levels, const char *imagePath) {
+  std::string cachePath = texture_cache_path(imagePath);
+  int fd = open(cachePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(texture_cache_header_t)) {
+    close(fd);
+    return -1;
+  }
+  size_t fileSize = info.st_size;
+  char *data = (char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  texture_cache_header_t header;
+  memcpy(&header, data, sizeof(header));
+
+  bool valid = memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC)) == 0 &&
+               header.version == TEXTURE_CACHE_VERSION &&
+               header.levelCount > 0 && header.levelCount <= TEXTURE_MAX_LEVELS &&
+               header.dataOffset >= sizeof(header) &&
+               header.dataOffset + header.dataSize <= fileSize;
+  for (uint32_t l = 0; valid && l < header.levelCount; l++) {
+    valid = header.levels[l].offset + header.levels[l].size <= header.dataSize;
+  }
+  if (!valid || header.sourceHash != hash_source_file(imagePath)) {
+    printf("Texture cache %s is stale, decoding %s.\n", cachePath.c_str(), imagePath);
+    munmap(data, fileSize);
+    return -1;
+  }
+
+  *levels = {};
+  levels->internalFormat = header.internalFormat;
+  levels->format = header.format;
+  levels->type = header.type;
+  levels->levelCount = header.levelCount;
+  memcpy(levels->levels, header.levels, sizeof(header.levels));
+  levels->data = (unsigned char *)data + header.dataOffset;
+  levels->dataSize = header.dataSize;
+  levels->mapping = data;
+  levels->mappingSize = fileSize;
+
+  // All levels are about to be copied out front to back.
+  madvise(levels->data, levels->dataSize, MADV_SEQUENTIAL);
+  madvise(levels->data, levels->dataSize, MADV_WILLNEED);
+  return 0;
+}
+
+/**
+ * Writes levels to the cache of imagePath, keyed by the image file's contents.
+ * Like the scene cache, the file is written next to the final one first and then renamed.
+ */
+int write_texture_cache(const texture_levels_t *levels, const char *imagePath) {
+  texture_cache_header_t header = {};
+  memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC));
+  header.version = TEXTURE_CACHE_VERSION;
+  header.levelCount = levels->levelCount;
+  header.sourceHash = hash_source_file(imagePath);
+  header.internalFormat = levels->internalFormat;
+  header.format = levels->format;
+  header.type = levels->type;
+  header.dataSize = levels->dataSize;
+  memcpy(header.levels, levels->levels, sizeof(header.levels));
+
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  header.dataOffset = (sizeof(header) + pageSize - 1) / pageSize * pageSize;
+
+  std::string cachePath = texture_cache_path(imagePath);
+  std::string tempPath = cachePath + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open texture cache @ %s\n", tempPath.c_str());
+    return -1;
+  }
+
+  char padding[64] = {0};
+  size_t paddingSize = header.dataOffset - sizeof(header);
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  while (ok && paddingSize > 0) {
+    size_t chunk = paddingSize < sizeof(padding) ? paddingSize : sizeof(padding);
+    ok = fwrite(padding, 1, chunk, file) == chunk;
+    paddingSize -= chunk;
+  }
+  ok = ok && fwrite(levels->data, 1, levels->dataSize, file) == levels->dataSize;
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+    fprintf(stderr, "Failed to write texture cache @ %s\n", cachePath.c_str());
+    unlink(tempPath.c_str());
+    return -1;
+  }
+  return 0;
+}
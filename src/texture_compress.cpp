@@ -0,0 +1,294 @@
+#include <texture_compress.h>
+#include <thread_pool.h>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Whether the GL can sample BC1 and BC3. BC5 is core since GL 3.0. Call on the GL thread.
+bool s3tc_supported() {
+  int count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (int i = 0; i < count; i++) {
+    const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (name != NULL && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Copies the 4x4 block at block coordinates (bx, by) out of a level as RGBA.
+ * Texels past the level's edge repeat the last row and column, so levels smaller than a block encode as well.
+ */
+static void gather_block(const unsigned char *pixels, uint32_t width, uint32_t height, int components,
+                         uint32_t bx, uint32_t by, unsigned char block[64]) {
+  for (uint32_t y = 0; y < 4; y++) {
+    uint32_t sy = by * 4 + y < height ? by * 4 + y : height - 1;
+    for (uint32_t x = 0; x < 4; x++) {
+      uint32_t sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+      const unsigned char *source = pixels + ((size_t)sy * width + sx) * components;
+      unsigned char *target = block + 4 * (4 * y + x);
+      target[0] = source[0];
+      target[1] = source[1];
+      target[2] = source[2];
+      target[3] = components == 4 ? source[3] : 255;
+    }
+  }
+}
+
+// Channel wise minimum and maximum of the block's 16 texels.
+static void block_bounds(const unsigned char block[64], unsigned char lower[4], unsigned char upper[4]) {
+#ifdef __SSE2__
+  __m128i a = _mm_loadu_si128((const __m128i *)block);
+  __m128i b = _mm_loadu_si128((const __m128i *)(block + 16));
+  __m128i c = _mm_loadu_si128((const __m128i *)(block + 32));
+  __m128i d = _mm_loadu_si128((const __m128i *)(block + 48));
+  __m128i low = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+  __m128i high = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+  // Fold the four texels of each register into one.
+  low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+  low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+  high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+  high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+  int packedLow = _mm_cvtsi128_si32(low);
+  int packedHigh = _mm_cvtsi128_si32(high);
+  memcpy(lower, &packedLow, 4);
+  memcpy(upper, &packedHigh, 4);
+#else
+  for (int c = 0; c < 4; c++) {
+    lower[c] = upper[c] = block[c];
+  }
+  for (int t = 1; t < 16; t++) {
+    for (int c = 0; c < 4; c++) {
+      unsigned char value = block[4 * t + c];
+      lower[c] = value < lower[c] ? value : lower[c];
+      upper[c] = value > upper[c] ? value : upper[c];
+    }
+  }
+#endif
+}
+
+static uint16_t pack_565(const int color[3]) {
+  return (uint16_t)((((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) |
+                    ((color[2] * 31 + 127) / 255));
+}
+
+// Expands a 565 colour back to 8 bits per channel, the way the hardware does.
+static void unpack_565(uint16_t packed, int color[3]) {
+  int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * Where every texel lies along start -> end, rounded to the nearest of the steps + 1 evenly spaced points,
+ * i.e. 0 at start and steps at end. The texels are RGBA, alpha is ignored.
+ */
+static void project_texels(const unsigned char block[64], const int start[3], const int end[3], int steps,
+                           int positions[16]) {
+  int axis[3] = {end[0] - start[0], end[1] - start[1], end[2] - start[2]};
+  int lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float scale = lengthSquared > 0 ? (float)steps / lengthSquared : 0.0f;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i origin = _mm_setr_epi16(start[0], start[1], start[2], 0, start[0], start[1], start[2], 0);
+  const __m128i direction = _mm_setr_epi16(axis[0], axis[1], axis[2], 0, axis[0], axis[1], axis[2], 0);
+  const __m128 scales = _mm_set1_ps(scale);
+  const __m128 highest = _mm_set1_ps((float)steps);
+  for (int t = 0; t < 16; t += 4) {
+    __m128i texels = _mm_loadu_si128((const __m128i *)(block + 4 * t));
+    // Two texels per register as 16 bit channels, relative to start. madd leaves rg and ba partial dot products.
+    __m128i first = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), origin), direction);
+    __m128i second = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), origin), direction);
+    first = _mm_add_epi32(first, _mm_shuffle_epi32(first, _MM_SHUFFLE(2, 3, 0, 1)));
+    second = _mm_add_epi32(second, _mm_shuffle_epi32(second, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128 dots = _mm_shuffle_ps(_mm_cvtepi32_ps(first), _mm_cvtepi32_ps(second), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 scaled = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dots, scales), _mm_setzero_ps()), highest);
+    _mm_storeu_si128((__m128i *)(positions + t), _mm_cvtps_epi32(scaled));
+  }
+#else
+  for (int t = 0; t < 16; t++) {
+    const unsigned char *texel = block + 4 * t;
+    int dot = (texel[0] - start[0]) * axis[0] + (texel[1] - start[1]) * axis[1] + (texel[2] - start[2]) * axis[2];
+    float position = fminf(fmaxf(dot * scale, 0.0f), (float)steps);
+    positions[t] = (int)lrintf(position);
+  }
+#endif
+}
+
+/**
+ * Encodes the block's colour as a BC1 block: two 565 endpoints and a 2 bit index per texel.
+ * The endpoints span the texels' bounding box, inset by a sixteenth to reduce the error of the quantised ends,
+ * with the red and blue ends swapped where they fall while green rises, so the box diagonal follows the texels.
+ */
+static void encode_color_block(const unsigned char block[64], unsigned char *out) {
+  unsigned char lower[4], upper[4];
+  block_bounds(block, lower, upper);
+
+  int high[3], low[3];
+  for (int c = 0; c < 3; c++) {
+    int inset = (upper[c] - lower[c]) >> 4;
+    high[c] = upper[c] - inset;
+    low[c] = lower[c] + inset;
+  }
+
+  int mean[3] = {0, 0, 0};
+  for (int t = 0; t < 16; t++) {
+    for (int c = 0; c < 3; c++) {
+      mean[c] += block[4 * t + c];
+    }
+  }
+  int covarianceRed = 0, covarianceBlue = 0;
+  for (int t = 0; t < 16; t++) {
+    int green = 16 * block[4 * t + 1] - mean[1];
+    covarianceRed += (16 * block[4 * t] - mean[0]) * green;
+    covarianceBlue += (16 * block[4 * t + 2] - mean[2]) * green;
+  }
+  if (covarianceRed < 0) {
+    int swap = high[0];
+    high[0] = low[0];
+    low[0] = swap;
+  }
+  if (covarianceBlue < 0) {
+    int swap = high[2];
+    high[2] = low[2];
+    low[2] = swap;
+  }
+
+  uint16_t color0 = pack_565(high), color1 = pack_565(low);
+  // color0 > color1 selects the four colour mode, equal ends make every index 0.
+  if (color0 < color1) {
+    uint16_t swap = color0;
+    color0 = color1;
+    color1 = swap;
+  }
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    int start[3], end[3], positions[16];
+    unpack_565(color0, start);
+    unpack_565(color1, end);
+    project_texels(block, start, end, 3, positions);
+    // Positions 0..3 run from color0 to color1, the palette is ordered color0, color1, 2/3 color0, 1/3 color0.
+    static const uint32_t paletteIndex[4] = {0, 2, 3, 1};
+    for (int t = 0; t < 16; t++) {
+      indices |= paletteIndex[positions[t]] << (2 * t);
+    }
+  }
+
+  out[0] = color0 & 0xff;
+  out[1] = color0 >> 8;
+  out[2] = color1 & 0xff;
+  out[3] = color1 >> 8;
+  memcpy(out + 4, &indices, 4);
+}
+
+/**
+ * Encodes one channel of the block as a BC4 block, which is also BC3's alpha and each half of BC5:
+ * the channel's maximum and minimum as ends, with six evenly spaced values between them, and a 3 bit index per texel.
+ */
+static void encode_channel_block(const unsigned char block[64], int channel, unsigned char *out) {
+  int high = block[channel], low = block[channel];
+  for (int t = 1; t < 16; t++) {
+    int value = block[4 * t + channel];
+    high = value > high ? value : high;
+    low = value < low ? value : low;
+  }
+
+  uint64_t indices = 0;
+  if (high != low) {
+    // Steps 0..7 run from high to low, the palette is ordered high, low, then the six values between from high on.
+    static const uint64_t paletteIndex[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+    int range = high - low;
+    for (int t = 0; t < 16; t++) {
+      int step = ((high - block[4 * t + channel]) * 14 + range) / (2 * range);
+      indices |= paletteIndex[step] << (3 * t);
+    }
+  }
+
+  out[0] = high;
+  out[1] = low;
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = (indices >> (8 * i)) & 0xff;
+  }
+}
+
+/**
+ * Block compresses every level of source, which has to be 8 bit RGB or RGBA, into compressed.
+ * Colour becomes BC1, or BC3 if source has alpha, normal maps become BC5 with their x and y.
+ * Blocks are encoded on all cores. compressed->data is allocated with malloc.
+ * Returns 1 if source can't be compressed, e.g. colour without s3tc, -1 if the memory can't be allocated.
+ */
+int compress_texture_levels(const texture_levels_t *source, int kind, bool s3tc, texture_levels_t *compressed) {
+  int components = source->format == GL_RGBA ? 4 : source->format == GL_RGB ? 3 : 0;
+  if (components == 0 || source->type != GL_UNSIGNED_BYTE || (kind == TEXTURE_COLOR && !s3tc)) {
+    return 1;
+  }
+
+  *compressed = {};
+  size_t blockSize;
+  if (kind == TEXTURE_NORMAL) {
+    compressed->internalFormat = GL_COMPRESSED_RG_RGTC2;
+    blockSize = 16;
+  } else if (components == 4) {
+    compressed->internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    blockSize = 16;
+  } else {
+    compressed->internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    blockSize = 8;
+  }
+
+  // One task per row of blocks, of all levels, so the small levels don't each wait for their own round.
+  typedef struct {
+    uint32_t level;
+    uint32_t row;
+  } block_row_t;
+  std::vector<block_row_t> rows;
+  compressed->levelCount = source->levelCount;
+  for (uint32_t l = 0; l < source->levelCount; l++) {
+    const texture_level_t &level = source->levels[l];
+    uint32_t blocksWide = (level.width + 3) / 4, blocksHigh = (level.height + 3) / 4;
+    texture_level_t &target = compressed->levels[l];
+    target.width = level.width;
+    target.height = level.height;
+    target.offset = compressed->dataSize;
+    target.size = (uint64_t)blocksWide * blocksHigh * blockSize;
+    compressed->dataSize += target.size;
+    for (uint32_t row = 0; row < blocksHigh; row++) {
+      rows.push_back({l, row});
+    }
+  }
+  compressed->data = (unsigned char *)malloc(compressed->dataSize);
+  if (compressed->data == NULL) {
+    return -1;
+  }
+
+  parallel_for(rows.size(), [&](size_t r) {
+    const texture_level_t &level = source->levels[rows[r].level];
+    const unsigned char *pixels = source->data + level.offset;
+    uint32_t blocksWide = (level.width + 3) / 4;
+    unsigned char *out = compressed->data + compressed->levels[rows[r].level].offset +
+                         (size_t)rows[r].row * blocksWide * blockSize;
+    unsigned char block[64];
+    for (uint32_t bx = 0; bx < blocksWide; bx++, out += blockSize) {
+      gather_block(pixels, level.width, level.height, components, bx, rows[r].row, block);
+      if (kind == TEXTURE_NORMAL) {
+        encode_channel_block(block, 0, out);
+        encode_channel_block(block, 1, out + 8);
+      } else if (components == 4) {
+        encode_channel_block(block, 3, out);
+        encode_color_block(block, out + 8);
+      } else {
+        encode_color_block(block, out);
+      }
+    }
+  });
+  return 0;
+}
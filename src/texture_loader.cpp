@@ -0,0 +1,162 @@
+#include <texture_loader.h>
+#include <texture_cache.h>
+#include <texture_compress.h>
+#include <texture_mips.h>
+#include <thread_pool.h>
+#include <glad/glad.h>
+#include <stdio.h>
+
+/**
+ * Block compresses the levels generated for job and caches the result.
+ * Levels that can't be compressed are cached as they are.
+ */
+static void compress_job(const texture_loader_t *loader, texture_job_t *job) {
+  texture_levels_t compressed;
+  if (compress_texture_levels(&job->levels, job->kind, loader->s3tc, &compressed) == 0) {
+    free_texture_levels(&job->levels);
+    job->levels = compressed;
+  }
+  write_texture_cache(&job->levels, job->path.c_str());
+}
+
+/**
+ * Maps job's texture cache. If there is no cache the GL can sample, the image is decoded,
+ * its mipmaps are generated and compressed, and the result is cached for the next start.
+ * job->levels stays empty if the image can't be loaded.
+ */
+static void load_job(const texture_loader_t *loader, texture_job_t *job) {
+  if (load_texture_cache(&job->levels, job->path.c_str()) == 0) {
+    bool s3tc = job->levels.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+                job->levels.internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if (!s3tc || loader->s3tc) {
+      return;
+    }
+    free_texture_levels(&job->levels);
+    job->levels = {};
+  }
+
+  image_t image;
+  if (decode_image(&image, job->path.c_str()) < 0) {
+    return;
+  }
+  int generated = generate_texture_levels(&image, job->kind, &job->levels);
+  free_image(&image);
+  if (generated < 0) {
+    free_texture_levels(&job->levels);
+    job->levels = {};
+    return;
+  }
+  compress_job(loader, job);
+}
+
+static void texture_loader_worker(texture_loader_t *loader) {
+  std::unique_lock<std::mutex> lock(loader->mutex);
+  while (true) {
+    loader->wake.wait(lock, [loader]() { return loader->stopping || !loader->queued.empty(); });
+    if (loader->stopping) {
+      return;
+    }
+    texture_job_t job = std::move(loader->queued.front());
+    loader->queued.pop_front();
+
+    // Decoding, filtering and compressing are the slow parts, the others may queue and pick up jobs meanwhile.
+    lock.unlock();
+    load_job(loader, &job);
+    lock.lock();
+
+    loader->decoded.push_back(std::move(job));
+  }
+}
+
+/**
+ * Starts one decoding worker per core and creates the pixel unpack buffers. Call on the GL thread.
+ */
+void start_texture_loader(texture_loader_t *loader) {
+  loader->stopping = false;
+  loader->s3tc = s3tc_supported();
+  loader->pending = 0;
+  loader->nextPixelBuffer = 0;
+  glGenBuffers(TEXTURE_UPLOAD_BUFFERS, loader->pixelBuffers);
+  for (unsigned int i = 0; i < worker_count(); i++) {
+    loader->workers.emplace_back(texture_loader_worker, loader);
+  }
+}
+
+/**
+ * Decodes the image at path in the background, a later texture_loader_update() hands out its levels.
+ * kind is TEXTURE_COLOR or TEXTURE_NORMAL, and decides how the texture cache compresses the image.
+ */
+void queue_texture(texture_loader_t *loader, const std::string &path, int kind) {
+  texture_job_t job = {path, kind, {}};
+  {
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    loader->queued.push_back(std::move(job));
+  }
+  loader->wake.notify_one();
+  loader->pending++;
+}
+
+// The pixel unpack buffer to upload through next, they are used in turn.
+unsigned int next_pixel_buffer(texture_loader_t *loader) {
+  unsigned int pixelBuffer = loader->pixelBuffers[loader->nextPixelBuffer];
+  loader->nextPixelBuffer = (loader->nextPixelBuffer + 1) % TEXTURE_UPLOAD_BUFFERS;
+  return pixelBuffer;
+}
+
+/**
+ * Moves the textures whose levels are ready since the last call to loaded, until budget bytes are used up.
+ * The caller uploads them through next_pixel_buffer() and frees their levels. Call once per frame.
+ * Returns how many textures are still to come, 0 once everything queued so far was handed out.
+ */
+unsigned int texture_loader_update(texture_loader_t *loader, size_t budget, std::vector<texture_job_t> *loaded) {
+  while (loader->pending > 0) {
+    texture_job_t job;
+    {
+      std::lock_guard<std::mutex> lock(loader->mutex);
+      if (loader->decoded.empty()) {
+        break;
+      }
+      job = std::move(loader->decoded.front());
+      loader->decoded.pop_front();
+    }
+    loader->pending--;
+
+    if (job.levels.data == NULL) {
+      printf("Failed to load texture %s, keeping its placeholder\n", job.path.c_str());
+      continue;
+    }
+    size_t size = job.levels.dataSize;
+    loaded->push_back(std::move(job));
+    if (size >= budget) {
+      break;
+    }
+    budget -= size;
+  }
+  return loader->pending;
+}
+
+/**
+ * Stops the workers, dropping whatever wasn't handed out yet, and deletes the pixel unpack buffers.
+ */
+void stop_texture_loader(texture_loader_t *loader) {
+  {
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    loader->stopping = true;
+  }
+  loader->wake.notify_all();
+  for (std::thread &worker : loader->workers) {
+    worker.join();
+  }
+  loader->workers.clear();
+
+  for (texture_job_t &job : loader->queued) {
+    free_texture_levels(&job.levels);
+  }
+  for (texture_job_t &job : loader->decoded) {
+    free_texture_levels(&job.levels);
+  }
+  loader->queued.clear();
+  loader->decoded.clear();
+  loader->pending = 0;
+  glDeleteBuffers(TEXTURE_UPLOAD_BUFFERS, loader->pixelBuffers);
+}
@@ -0,0 +1,274 @@
+#include <texture_mips.h>
+#include <thread_pool.h>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Steps of the table that encodes linear values back to sRGB, fine enough that every byte value survives a round trip.
+#define SRGB_ENCODE_STEPS 16384
+
+typedef struct {
+  float decode[256];                           // sRGB byte to linear
+  unsigned char encode[SRGB_ENCODE_STEPS + 1]; // linear, in steps of 1 / SRGB_ENCODE_STEPS, to sRGB byte
+} srgb_tables_t;
+
+static const srgb_tables_t &srgb_tables() {
+  static const srgb_tables_t tables = []() {
+    srgb_tables_t built;
+    for (int i = 0; i < 256; i++) {
+      float value = i / 255.0f;
+      built.decode[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i <= SRGB_ENCODE_STEPS; i++) {
+      float linear = (float)i / SRGB_ENCODE_STEPS;
+      float value = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+      built.encode[i] = (unsigned char)(value * 255.0f + 0.5f);
+    }
+    return built;
+  }();
+  return tables;
+}
+
+/**
+ * Copies a row of the image into level 0, as RGB or RGBA. Grey images are spread over all three colour channels.
+ */
+static void expand_row(const unsigned char *source, int sourceComponents, uint32_t width, int components,
+                       unsigned char *target) {
+  if (sourceComponents == components) {
+    memcpy(target, source, (size_t)width * components);
+    return;
+  }
+  for (uint32_t x = 0; x < width; x++, source += sourceComponents, target += components) {
+    target[0] = target[1] = target[2] = source[0];
+    if (components == 4) {
+      target[3] = sourceComponents == 2 ? source[1] : 255;
+    }
+  }
+}
+
+/**
+ * Turns a row of level 0 into 4 floats per texel to filter with: linear colour, or the normal's xyz in [-1, 1].
+ * Alpha is linear already.
+ */
+static void decode_row(const unsigned char *row, uint32_t width, int components, int kind, float *out) {
+  const float *decode = srgb_tables().decode;
+  for (uint32_t x = 0; x < width; x++, row += components, out += 4) {
+    if (kind == TEXTURE_NORMAL) {
+      out[0] = row[0] * (2.0f / 255.0f) - 1.0f;
+      out[1] = row[1] * (2.0f / 255.0f) - 1.0f;
+      out[2] = row[2] * (2.0f / 255.0f) - 1.0f;
+    } else {
+      out[0] = decode[row[0]];
+      out[1] = decode[row[1]];
+      out[2] = decode[row[2]];
+    }
+    out[3] = components == 4 ? row[3] * (1.0f / 255.0f) : 1.0f;
+  }
+}
+
+/**
+ * Box filters two decoded rows of a level into one row of the next, width texels wide.
+ * An odd last column or row is averaged with itself. Normals are scaled back to unit length, their alpha is not.
+ */
+static void downsample_rows(const float *row0, const float *row1, uint32_t sourceWidth, uint32_t width, int kind,
+                            float *out) {
+  for (uint32_t x = 0; x < width; x++, out += 4) {
+    const float *a = row0 + 8 * (size_t)x, *c = row1 + 8 * (size_t)x;
+    size_t step = 2 * x + 1 < sourceWidth ? 4 : 0;
+#ifdef __SSE2__
+    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(a + step)),
+                            _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(c + step)));
+    __m128 texel = _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+    if (kind == TEXTURE_NORMAL) {
+      // x² + y² + z² in the first three lanes, by adding the squares rotated through them.
+      __m128 squares = _mm_mul_ps(texel, texel);
+      __m128 lengths = _mm_add_ps(_mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(3, 0, 2, 1))),
+                                  _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(3, 1, 0, 2)));
+      __m128 valid = _mm_cmpgt_ps(lengths, _mm_set1_ps(1e-12f));
+      __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(lengths, _mm_set1_ps(1e-12f))));
+      scale = _mm_or_ps(_mm_and_ps(valid, scale), _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+      float alpha = _mm_cvtss_f32(_mm_shuffle_ps(texel, texel, _MM_SHUFFLE(3, 3, 3, 3)));
+      _mm_storeu_ps(out, _mm_mul_ps(texel, scale));
+      out[3] = alpha;
+    } else {
+      _mm_storeu_ps(out, texel);
+    }
+#else
+    for (int channel = 0; channel < 4; channel++) {
+      out[channel] = 0.25f * (a[channel] + a[step + channel] + c[channel] + c[step + channel]);
+    }
+    if (kind == TEXTURE_NORMAL) {
+      float length = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+      float scale = length > 1e-6f ? 1.0f / length : 1.0f;
+      out[0] *= scale;
+      out[1] *= scale;
+      out[2] *= scale;
+    }
+#endif
+  }
+}
+
+// Turns a decoded row back into 8 bit RGB or RGBA, the inverse of decode_row().
+static void encode_row(const float *row, uint32_t width, int components, int kind, unsigned char *out) {
+  const unsigned char *encode = srgb_tables().encode;
+  for (uint32_t x = 0; x < width; x++, row += 4, out += components) {
+    int values[4];
+#ifdef __SSE2__
+    // Colour is scaled to the steps of the sRGB table and looked up, normals and alpha are scaled to bytes.
+    __m128 texel = _mm_loadu_ps(row);
+    __m128 low, high, scale, offset;
+    if (kind == TEXTURE_NORMAL) {
+      low = _mm_setr_ps(-1.0f, -1.0f, -1.0f, 0.0f);
+      scale = _mm_setr_ps(127.5f, 127.5f, 127.5f, 255.0f);
+      offset = _mm_setr_ps(128.0f, 128.0f, 128.0f, 0.5f);
+    } else {
+      low = _mm_setzero_ps();
+      scale = _mm_setr_ps(SRGB_ENCODE_STEPS, SRGB_ENCODE_STEPS, SRGB_ENCODE_STEPS, 255.0f);
+      offset = _mm_set1_ps(0.5f);
+    }
+    high = _mm_set1_ps(1.0f);
+    texel = _mm_min_ps(_mm_max_ps(texel, low), high);
+    _mm_storeu_si128((__m128i *)values, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(texel, scale), offset)));
+#else
+    for (int channel = 0; channel < 3; channel++) {
+      float value = row[channel];
+      if (kind == TEXTURE_NORMAL) {
+        value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+        values[channel] = (int)(value * 127.5f + 128.0f);
+      } else {
+        value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+        values[channel] = (int)(value * SRGB_ENCODE_STEPS + 0.5f);
+      }
+    }
+    float alpha = row[3] < 0.0f ? 0.0f : row[3] > 1.0f ? 1.0f : row[3];
+    values[3] = (int)(alpha * 255.0f + 0.5f);
+#endif
+    for (int channel = 0; channel < 3; channel++) {
+      out[channel] = kind == TEXTURE_NORMAL ? (unsigned char)(values[channel] > 255 ? 255 : values[channel])
+                                            : encode[values[channel]];
+    }
+    if (components == 4) {
+      out[3] = (unsigned char)values[3];
+    }
+  }
+}
+
+/**
+ * Copies rows [first, first + 1 << bandLevels) of the image into level 0 and filters them bandLevels levels down,
+ * where they have become a single row. Every row of those levels comes from the same band, so bands are independent.
+ * The band's rows of the last of those levels are left decoded in lastLevel, for the levels below.
+ */
+static void filter_band(const image_t *image, int kind, texture_levels_t *levels, uint32_t first, uint32_t bandLevels,
+                        float *lastLevel) {
+  int components = levels->format == GL_RGBA ? 4 : 3;
+  const texture_level_t &base = levels->levels[0];
+  uint32_t end = first + (1u << bandLevels) < base.height ? first + (1u << bandLevels) : base.height;
+
+  std::vector<float> current((size_t)(end - first) * base.width * 4), next;
+  for (uint32_t y = first; y < end; y++) {
+    unsigned char *row = levels->data + base.offset + (size_t)y * base.width * components;
+    expand_row(image->data + (size_t)y * base.width * image->components, image->components, base.width, components, row);
+    decode_row(row, base.width, components, kind, &current[(size_t)(y - first) * base.width * 4]);
+  }
+
+  for (uint32_t l = 1; l <= bandLevels; l++) {
+    const texture_level_t &source = levels->levels[l - 1];
+    const texture_level_t &level = levels->levels[l];
+    uint32_t sourceFirst = first >> (l - 1);
+    uint32_t levelFirst = first >> l;
+    // Rounding down, the levels drop the last row of an odd height, so the last band may end early.
+    uint32_t levelEnd = (end + (1u << l) - 1) >> l;
+    levelEnd = levelEnd < level.height ? levelEnd : level.height;
+    next.resize((size_t)(levelEnd > levelFirst ? levelEnd - levelFirst : 0) * level.width * 4);
+    for (uint32_t y = levelFirst; y < levelEnd; y++) {
+      uint32_t y0 = 2 * y, y1 = 2 * y + 1 < source.height ? 2 * y + 1 : 2 * y;
+      float *filtered = &next[(size_t)(y - levelFirst) * level.width * 4];
+      downsample_rows(&current[(size_t)(y0 - sourceFirst) * source.width * 4],
+                      &current[(size_t)(y1 - sourceFirst) * source.width * 4], source.width, level.width, kind,
+                      filtered);
+      encode_row(filtered, level.width, components, kind,
+                 levels->data + level.offset + (size_t)y * level.width * components);
+    }
+    std::swap(current, next);
+  }
+
+  const texture_level_t &last = levels->levels[bandLevels];
+  memcpy(lastLevel + (size_t)(first >> bandLevels) * last.width * 4, current.data(), current.size() * sizeof(float));
+}
+
+/**
+ * Builds every mip level of image on the CPU, as 8 bit RGB, or RGBA if the image has alpha.
+ * Colour is filtered in linear space and stored as sRGB again, so minified textures keep their brightness.
+ * Normal maps are filtered as vectors and renormalised, since averaged unit vectors get shorter.
+ * Bands of rows are filtered several levels down on all cores, only the few rows of the smallest levels are
+ * left to one thread. levels->data is allocated with malloc. Returns -1 if the image is empty or the memory
+ * can't be allocated.
+ */
+int generate_texture_levels(const image_t *image, int kind, texture_levels_t *levels) {
+  *levels = {};
+  if (image->data == NULL || image->width <= 0 || image->height <= 0 || image->components < 1 ||
+      image->components > 4) {
+    return -1;
+  }
+  int components = image->components == 2 || image->components == 4 ? 4 : 3;
+
+  levels->internalFormat = components == 4 ? GL_RGBA8 : GL_RGB8;
+  levels->format = components == 4 ? GL_RGBA : GL_RGB;
+  levels->type = GL_UNSIGNED_BYTE;
+  uint32_t width = image->width, height = image->height;
+  for (uint32_t l = 0; l < TEXTURE_MAX_LEVELS; l++) {
+    texture_level_t &level = levels->levels[l];
+    level.width = width > 1 ? width : 1;
+    level.height = height > 1 ? height : 1;
+    level.offset = levels->dataSize;
+    level.size = (uint64_t)level.width * level.height * components;
+    levels->dataSize += level.size;
+    levels->levelCount++;
+    if (width <= 1 && height <= 1) {
+      break;
+    }
+    width /= 2;
+    height /= 2;
+  }
+  levels->data = (unsigned char *)malloc(levels->dataSize);
+  if (levels->data == NULL) {
+    return -1;
+  }
+
+  // Bands only go as deep as there are levels, and as the image is high.
+  uint32_t bandLevels = 0;
+  while (bandLevels < MIP_BAND_LEVELS && bandLevels + 1 < levels->levelCount &&
+         (levels->levels[0].height >> (bandLevels + 1)) > 0) {
+    bandLevels++;
+  }
+  const texture_level_t &last = levels->levels[bandLevels];
+  std::vector<float> current((size_t)last.width * last.height * 4), next;
+  uint32_t bandCount = (levels->levels[0].height + (1u << bandLevels) - 1) >> bandLevels;
+  parallel_for(bandCount, [&](size_t band) {
+    filter_band(image, kind, levels, (uint32_t)band << bandLevels, bandLevels, current.data());
+  });
+
+  for (uint32_t l = bandLevels + 1; l < levels->levelCount; l++) {
+    const texture_level_t &source = levels->levels[l - 1];
+    const texture_level_t &level = levels->levels[l];
+    next.resize((size_t)level.width * level.height * 4);
+    for (uint32_t y = 0; y < level.height; y++) {
+      uint32_t y0 = 2 * y < source.height ? 2 * y : source.height - 1;
+      uint32_t y1 = 2 * y + 1 < source.height ? 2 * y + 1 : y0;
+      float *filtered = &next[(size_t)y * level.width * 4];
+      downsample_rows(&current[(size_t)y0 * source.width * 4], &current[(size_t)y1 * source.width * 4], source.width,
+                      level.width, kind, filtered);
+      encode_row(filtered, level.width, components, kind,
+                 levels->data + level.offset + (size_t)y * level.width * components);
+    }
+    std::swap(current, next);
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One parallel_for() call, shared with the pool's threads while it is queued.
+typedef struct {
+  const std::function<void(size_t)> *task;
+  size_t count;
+  std::atomic<size_t> next;
+  unsigned int helpers; // pool threads working on it, guarded by the pool's mutex
+} parallel_job_t;
+
+/**
+ * Threads that stay around for the whole run and help with whatever parallel_for() calls are queued.
+ * Starting threads per call made every call pay for it, and callers that run on their own threads,
+ * like the texture loader's workers, started cores^2 threads between them.
+ */
+typedef struct thread_pool_t {
+  std::mutex mutex;
+  std::condition_variable wake; // a job was queued, or the pool is stopping
+  std::condition_variable left; // a helper left its job
+  std::deque<parallel_job_t *> jobs;
+  std::vector<std::thread> threads;
+  bool stopping = false;
+
+  ~thread_pool_t() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+} thread_pool_t;
+
+// Number of threads used by parallel_for(), including the calling thread.
+unsigned int worker_count() {
+  unsigned int count = std::thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
+
+// Runs the job's tasks until all of them were handed out.
+static void run_job(parallel_job_t *job) {
+  for (size_t i = job->next++; i < job->count; i = job->next++) {
+    (*job->task)(i);
+  }
+}
+
+static void pool_thread(thread_pool_t *pool) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  while (true) {
+    pool->wake.wait(lock, [pool]() { return pool->stopping || !pool->jobs.empty(); });
+    if (pool->stopping) {
+      return;
+    }
+    parallel_job_t *job = pool->jobs.front();
+    if (job->next >= job->count) {
+      // Every task is taken, the caller only waits for its helpers now.
+      pool->jobs.pop_front();
+      continue;
+    }
+
+    job->helpers++;
+    lock.unlock();
+    run_job(job);
+    lock.lock();
+    job->helpers--;
+    pool->left.notify_all();
+  }
+}
+
+// The pool, started with one thread less than worker_count() on first use, since callers work as well.
+static thread_pool_t *thread_pool() {
+  static thread_pool_t pool;
+  static std::once_flag started;
+  std::call_once(started, []() {
+    for (unsigned int i = 1; i < worker_count(); i++) {
+      pool.threads.emplace_back(pool_thread, &pool);
+    }
+  });
+  return &pool;
+}
+
+/**
+ * Runs task(0) ... task(count - 1), spread over all cores.
+ * Tasks are handed out one at a time through an atomic counter, so uneven tasks still balance.
+ * The calling thread works as well and returns once every task finished. Calls from several threads at once,
+ * or from inside a task, share the pool's threads instead of each starting their own.
+ */
+void parallel_for(size_t count, const std::function<void(size_t)> &task) {
+  thread_pool_t *pool = thread_pool();
+  parallel_job_t job = {};
+  job.task = &task;
+  job.count = count;
+  if (count > 1 && !pool->threads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->jobs.push_back(&job);
+    }
+    pool->wake.notify_all();
+  }
+  run_job(&job);
+
+  // Nobody can join once the job is out of the queue, so it is done when its last helper left.
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  auto queued = std::find(pool->jobs.begin(), pool->jobs.end(), &job);
+  if (queued != pool->jobs.end()) {
+    pool->jobs.erase(queued);
+  }
+  pool->left.wait(lock, [&job]() { return job.helpers == 0; });
+}
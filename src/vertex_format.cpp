@@ -0,0 +1,327 @@
+#include <vertex_format.h>
+#include <mesh_lod.h>
+#include <glad/glad.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#ifdef COMPACT_VERTICES
+
+static uint16_t quantize_unorm16(float value) {
+  value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+  return (uint16_t)(value * 65535.0f + 0.5f);
+}
+
+static int16_t quantize_snorm16(float value) {
+  value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+  return (int16_t)roundf(value * 32767.0f);
+}
+
+// IEEE half float, rounded to nearest. Denormals flush to zero, which is fine for texture coordinates.
+static uint16_t float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent <= 0) {
+    return sign;
+  }
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+
+  uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+  // Round to nearest, a carry into the exponent is still correct.
+  if (mantissa & 0x1000) {
+    half++;
+  }
+  return half;
+}
+
+// Octahedral encoding (Cigolle et al.): project onto the octahedron, fold the lower half over the upper one.
+static void encode_octahedral(const aiVector3D &v, int16_t out[2]) {
+  float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+  if (l1 == 0.0f) {
+    // Untextured meshes have no tangent, any direction will do.
+    out[0] = out[1] = 0;
+    return;
+  }
+  float x = v.x / l1;
+  float y = v.y / l1;
+  if (v.z < 0.0f) {
+    float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = foldedX;
+    y = foldedY;
+  }
+  out[0] = quantize_snorm16(x);
+  out[1] = quantize_snorm16(y);
+}
+
+/**
+ * Encodes the vertices of one mesh, quantising positions to the mesh's bounds.
+ * The bitangent is not stored, the shader rebuilds it as cross(normal, tangent) times the stored sign.
+ */
+void encode_compact_vertices(const model_t *model, const mesh_range_t &range, compact_vertex_t *destination) {
+  aiVector3D extent = range.boundsMax - range.boundsMin;
+  for (unsigned int v = 0; v < range.vertexCount; v++) {
+    unsigned int source = range.vertexOffset + v;
+    compact_vertex_t &out = destination[v];
+
+    const aiVector3D &p = model->vertices[source];
+    for (int axis = 0; axis < 3; axis++) {
+      out.position[axis] = extent[axis] > 0.0f ? quantize_unorm16((p[axis] - range.boundsMin[axis]) / extent[axis]) : 0;
+    }
+
+    const aiVector3D &n = model->normals[source];
+    const aiVector3D &t = model->tangents[source];
+    const aiVector3D &b = model->bitangents[source];
+    aiVector3D cross(n.y * t.z - n.z * t.y, n.z * t.x - n.x * t.z, n.x * t.y - n.y * t.x);
+    out.position[3] = cross.x * b.x + cross.y * b.y + cross.z * b.z < 0.0f ? 0 : 65535;
+
+    out.material = model->materialIds[source];
+    out.padding = 0;
+
+    encode_octahedral(n, out.normal);
+    encode_octahedral(t, out.tangent);
+    out.uv[0] = float_to_half(model->uvs[source].x);
+    out.uv[1] = float_to_half(model->uvs[source].y);
+  }
+}
+
+#endif
+
+/**
+ * Size each of the buffers needs on the GPU at most. The buffers are ordered like the model's streams,
+ * with the compact format only the first two (indices, interleaved vertices) are used.
+ * The indices are packed per draw range, see pack_mesh_indices(), so their size is an upper bound.
+ */
+size_t gpu_stream_sizes(const model_t *model, size_t sizes[MODEL_STREAM_COUNT]) {
+#ifdef COMPACT_VERTICES
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    sizes[stream] = 0;
+  }
+  sizes[0] = max_packed_index_size(model);
+  sizes[1] = sizeof(compact_vertex_t) * model->vertexCount;
+  return sizes[0] + sizes[1];
+#else
+  size_t total = 0;
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    sizes[stream] = stream == 0 ? max_packed_index_size(model) : model_stream_stride(stream) * model->vertexCount;
+    total += sizes[stream];
+  }
+  return total;
+#endif
+}
+
+/**
+ * Points the attributes of the bound VAO at the buffers, and binds the element buffer to it.
+ */
+void setup_vertex_attributes(const unsigned int buffers[MODEL_STREAM_COUNT]) {
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[0]);
+
+#ifdef COMPACT_VERTICES
+  GLsizei stride = sizeof(compact_vertex_t);
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+  glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)offsetof(compact_vertex_t, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, stride, (void *)offsetof(compact_vertex_t, material));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void *)offsetof(compact_vertex_t, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offsetof(compact_vertex_t, uv));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(4, 2, GL_SHORT, GL_TRUE, stride, (void *)offsetof(compact_vertex_t, tangent));
+  glEnableVertexAttribArray(4);
+#else
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+  glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void *)0);
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
+  glEnableVertexAttribArray(2);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[4]);
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(aiVector2D), (void *)0);
+  glEnableVertexAttribArray(3);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[5]);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
+  glEnableVertexAttribArray(4);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[6]);
+  glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(aiVector3D), (void *)0);
+  glEnableVertexAttribArray(5);
+#endif
+}
+
+/**
+ * Uploads the whole model into the buffers, in the vertex format chosen at build time,
+ * and appends the draw calls that cover it to ranges.
+ * If the model is empty, the buffers are merely created, e.g. to be filled by the streaming loader.
+ * Returns the size of the packed indices in the element buffer.
+ */
+size_t upload_model_buffers(const unsigned int buffers[MODEL_STREAM_COUNT], const model_t *model,
+                            std::vector<draw_range_t> *ranges) {
+  size_t sizes[MODEL_STREAM_COUNT];
+  gpu_stream_sizes(model, sizes);
+
+  std::vector<char> indices;
+  if (model->indices) {
+    sizes[0] = pack_model_indices(model, &indices, ranges);
+    print_draw_range_stats(model, *ranges, sizes[0]);
+  }
+
+#ifdef COMPACT_VERTICES
+  std::vector<compact_vertex_t> vertices(model->vertexCount);
+  if (model->vertices) {
+    for (const mesh_range_t &range : model->meshes) {
+      encode_compact_vertices(model, range, &vertices[range.vertexOffset]);
+    }
+  }
+  const void *data[MODEL_STREAM_COUNT] = {indices.data(), vertices.data()};
+#else
+  const void *data[MODEL_STREAM_COUNT];
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    data[stream] = model_stream(model, stream);
+  }
+  data[0] = indices.data();
+#endif
+
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[stream]);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizes[stream], sizes[stream] ? data[stream] : NULL, GL_STATIC_DRAW);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  setup_vertex_attributes(buffers);
+  return sizes[0];
+}
+
+/**
+ * Overwrites the vertex buffers from vertex vertexOffset on with all vertices of model, with glBufferSubData.
+ * The buffers keep their size, so the vertices have to fit.
+ */
+void upload_vertices_at(const unsigned int buffers[MODEL_STREAM_COUNT], const model_t *model, unsigned int vertexOffset) {
+#ifdef COMPACT_VERTICES
+  std::vector<compact_vertex_t> vertices(model->vertexCount);
+  for (const mesh_range_t &range : model->meshes) {
+    encode_compact_vertices(model, range, &vertices[range.vertexOffset]);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(compact_vertex_t) * vertexOffset,
+                  sizeof(compact_vertex_t) * model->vertexCount, vertices.data());
+#else
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[stream]);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, stride * vertexOffset, stride * model->vertexCount, model_stream(model, stream));
+  }
+#endif
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/**
+ * Per mesh uniforms of the vertex format, set before drawing the mesh with program.
+ * Only the compact format has any, its position dequantisation.
+ */
+void set_mesh_uniforms(unsigned int program, const mesh_range_t &range) {
+#ifdef COMPACT_VERTICES
+  aiVector3D extent = range.boundsMax - range.boundsMin;
+  glUniform3f(glGetUniformLocation(program, "positionScale"), extent.x, extent.y, extent.z);
+  glUniform3f(glGetUniformLocation(program, "positionOffset"), range.boundsMin.x, range.boundsMin.y, range.boundsMin.z);
+#endif
+}
+
+/**
+ * Makes program take positions as they are, for geometry that is not part of the model, e.g. the mirror's quad.
+ */
+void reset_mesh_uniforms(unsigned int program) {
+#ifdef COMPACT_VERTICES
+  glUniform3f(glGetUniformLocation(program, "positionScale"), 1.0f, 1.0f, 1.0f);
+  glUniform3f(glGetUniformLocation(program, "positionOffset"), 0.0f, 0.0f, 0.0f);
+#endif
+}
+
+/**
+ * Draws the ranges from the bound VAO's element buffer with program, skipping those that are outside view
+ * or face away from it, and those of other detail levels than the one view selects for their mesh.
+ * Pass NULL to draw everything at full resolution. stats may be NULL as well.
+ * The ranges of one mesh have to be adjacent, as packed by pack_mesh_indices().
+ * The surviving ranges are batched into one multi draw per mesh and index type,
+ * and ranges that continue each other in the element buffer are merged into one draw.
+ */
+void draw_meshes(unsigned int program, const std::vector<mesh_range_t> &meshes, const draw_range_t *ranges,
+                 size_t rangeCount, const cull_view_t *view, cull_stats_t *stats) {
+  // Reused from call to call, all draws happen on the render thread.
+  static std::vector<GLsizei> counts;
+  static std::vector<const void *> offsets;
+  static std::vector<GLint> baseVertices;
+
+  unsigned int currentMesh = ~0u;
+  unsigned int currentType = 0;
+  auto flush = [&]() {
+    if (!counts.empty()) {
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), currentType, offsets.data(), counts.size(), baseVertices.data());
+      counts.clear();
+      offsets.clear();
+      baseVertices.clear();
+    }
+  };
+
+  // A mesh's ranges are adjacent, so its level is picked once when they begin.
+  unsigned int selectedMesh = ~0u;
+  unsigned int selectedLod = 0;
+  for (size_t r = 0; r < rangeCount; r++) {
+    const draw_range_t &range = ranges[r];
+    if (range.mesh != selectedMesh && view) {
+      selectedLod = select_mesh_lod(meshes[range.mesh], view->eye, view->lodScale, view->lodPixelError);
+      if (stats) {
+        stats->levels[selectedLod]++;
+      }
+    }
+    selectedMesh = range.mesh;
+    if (range.lod != selectedLod) {
+      continue;
+    }
+    if (view && view->cull) {
+      bool visible = sphere_visible(view, range.center, range.radius) &&
+                     !cone_backfacing(view, range.center, range.radius, range.coneAxis, range.coneCutoff);
+      if (stats) {
+        stats->tested++;
+        stats->drawn += visible;
+      }
+      if (!visible) {
+        continue;
+      }
+    }
+
+    if (range.mesh != currentMesh || range.indexType != currentType) {
+      flush();
+      if (range.mesh != currentMesh) {
+        set_mesh_uniforms(program, meshes[range.mesh]);
+      }
+      currentMesh = range.mesh;
+      currentType = range.indexType;
+    }
+
+    size_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    if (!counts.empty() && baseVertices.back() == range.baseVertex &&
+        (size_t)offsets.back() + indexSize * counts.back() == range.byteOffset) {
+      counts.back() += range.indexCount;
+    } else {
+      counts.push_back(range.indexCount);
+      offsets.push_back((const void *)range.byteOffset);
+      baseVertices.push_back(range.baseVertex);
+    }
+  }
+  flush();
+}
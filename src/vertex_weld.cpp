@@ -0,0 +1,155 @@
+#include <vertex_weld.h>
+#include <thread_pool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Bytes one vertex occupies across all attribute streams.
+static size_t vertex_size() {
+  size_t size = 0;
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size += model_stream_stride(stream);
+  }
+  return size;
+}
+
+// FNV-1a over every attribute of the vertex.
+static uint64_t hash_vertex(const model_t *model, unsigned int vertex) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    const unsigned char *data = (const unsigned char *)model_stream(model, stream) + stride * vertex;
+    for (size_t i = 0; i < stride; i++) {
+      hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+// Bitwise comparison of the whole vertex tuple, i.e. -0.0 and 0.0 are different on purpose.
+static bool equal_vertices(const model_t *model, unsigned int a, unsigned int b) {
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    const char *data = model_stream(model, stream);
+    if (memcmp(data + stride * a, data + stride * b, stride) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void copy_vertex(model_t *model, unsigned int destination, unsigned int source) {
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    size_t stride = model_stream_stride(stream);
+    char *data = (char *)model_stream(model, stream);
+    memcpy(data + stride * destination, data + stride * source, stride);
+  }
+}
+
+/**
+ * Collapses bit-identical vertices of one mesh and rewrites its indices.
+ * Unique vertices are compacted to the front of the mesh's range in place, and range->vertexCount shrinks accordingly.
+ * The rest of the range becomes unused until compact_model() closes the gap.
+ */
+void weld_mesh(model_t *model, mesh_range_t *range, weld_stats_t *stats) {
+  unsigned int base = range->vertexOffset;
+  unsigned int count = range->vertexCount;
+
+  // Open addressing, at most half full. Slots hold the (new) mesh local index of a unique vertex.
+  size_t tableSize = 1;
+  while (tableSize < 2 * (size_t)count) {
+    tableSize <<= 1;
+  }
+  std::vector<unsigned int> table(tableSize, ~0u);
+  std::vector<unsigned int> remap(count);
+
+  unsigned int unique = 0;
+  for (unsigned int v = 0; v < count; v++) {
+    size_t slot = hash_vertex(model, base + v) & (tableSize - 1);
+    while (table[slot] != ~0u && !equal_vertices(model, base + table[slot], base + v)) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+
+    if (table[slot] == ~0u) {
+      // unique <= v, so moving forward never overwrites a vertex that is still to be visited.
+      if (unique != v) {
+        copy_vertex(model, base + unique, base + v);
+      }
+      table[slot] = unique++;
+    }
+    remap[v] = table[slot];
+  }
+
+  unsigned int *indices = model->indices + range->indexOffset;
+  for (unsigned int i = 0; i < range->indexCount; i++) {
+    indices[i] = base + remap[indices[i] - base];
+  }
+
+  stats->verticesBefore += count;
+  stats->verticesAfter += unique;
+  range->vertexCount = unique;
+}
+
+/**
+ * Closes the gaps weld_mesh() leaves behind: moves every mesh down to the end of the previous one,
+ * rebasing its indices, and then moves the streams themselves together so the arena matches
+ * the layout of the new, smaller model->vertexCount again. The allocation itself is not shrunk.
+ */
+void compact_model(model_t *model) {
+  unsigned int vertexCount = 0;
+  for (mesh_range_t &range : model->meshes) {
+    if (range.vertexOffset != vertexCount) {
+      for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+        size_t stride = model_stream_stride(stream);
+        char *data = (char *)model_stream(model, stream);
+        memmove(data + stride * vertexCount, data + stride * range.vertexOffset, stride * range.vertexCount);
+      }
+      unsigned int *indices = model->indices + range.indexOffset;
+      for (unsigned int i = 0; i < range.indexCount; i++) {
+        indices[i] = indices[i] - range.vertexOffset + vertexCount;
+      }
+      range.vertexOffset = vertexCount;
+    }
+    vertexCount += range.vertexCount;
+  }
+
+  // Every stream only moves towards the front, so moving them in order never overwrites one that is yet to move.
+  const char *oldStreams[MODEL_STREAM_COUNT];
+  for (int stream = 0; stream < MODEL_STREAM_COUNT; stream++) {
+    oldStreams[stream] = model_stream(model, stream);
+  }
+
+  model->vertexCount = vertexCount;
+  model->vertexOffset = vertexCount;
+  size_t streamSizes[MODEL_STREAM_COUNT];
+  model->arenaSize = model_stream_sizes(model, streamSizes);
+  layout_model(model, model->arena);
+
+  for (int stream = 1; stream < MODEL_STREAM_COUNT; stream++) {
+    memmove((char *)model_stream(model, stream), oldStreams[stream], model_stream_stride(stream) * vertexCount);
+  }
+}
+
+/**
+ * Welds every mesh of the model, in parallel, and compacts the result.
+ */
+void weld_model(model_t *model, weld_stats_t *stats) {
+  std::vector<weld_stats_t> meshStats(model->meshes.size(), weld_stats_t{});
+  parallel_for(model->meshes.size(), [&](size_t m) {
+    weld_mesh(model, &model->meshes[m], &meshStats[m]);
+  });
+
+  for (const weld_stats_t &meshStat : meshStats) {
+    stats->verticesBefore += meshStat.verticesBefore;
+    stats->verticesAfter += meshStat.verticesAfter;
+  }
+
+  compact_model(model);
+}
+
+void print_weld_stats(const weld_stats_t *stats) {
+  size_t saved = (stats->verticesBefore - stats->verticesAfter) * vertex_size();
+  printf("Welded %zu -> %zu vertices, saving %.1f KB of vertex memory\n",
+         stats->verticesBefore, stats->verticesAfter, saved / 1024.0);
+}